@@ -0,0 +1,159 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Console.h"
+
+// Micro-benchmarks for the pieces of the hot path: opcode dispatch, operand
+// resolution for each addressing mode, and memory reads. Results go to stdout
+// (or the file given as the first argument) as JSON, one entry per benchmark.
+
+namespace {
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+};
+
+// Times op() over iterations calls, taking the best of a few runs to shave off
+// scheduling noise
+Result measure(const std::string& name, uint64_t iterations, const std::function<uint64_t()>& op) {
+    double best = 1e30;
+    uint64_t sink = 0;
+    for (int run = 0; run < 5; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            sink += op();
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count() / iterations);
+    }
+    // Keep the work from being optimised away
+    if (sink == 0x5eed) {
+        fprintf(stderr, " ");
+    }
+    return {name, iterations, best};
+}
+
+/**
+ * 32KiB of PRG-ROM repeating one instruction. The tail jumps back to $8000, and
+ * every vector points there too, so the CPU loops over the instruction forever.
+ */
+struct Program {
+    std::vector<uint8_t> prg;
+
+    Program(std::vector<uint8_t> instruction) : prg(MEMORY_SIZE - ROM_START, 0x18 /* CLC */) {
+        const std::size_t tail = prg.size() - 0x10;
+        for (std::size_t i = 0; i + instruction.size() <= tail; i += instruction.size()) {
+            std::copy(instruction.begin(), instruction.end(), prg.begin() + i);
+        }
+        const uint8_t jump[] = {0x4C, 0x00, 0x80};
+        std::copy(std::begin(jump), std::end(jump), prg.begin() + tail);
+        for (uint16_t vector : {NMI_VECTOR, RESET_VECTOR, IRQ_VECTOR}) {
+            prg[vector - ROM_START] = 0x00;
+            prg[vector - ROM_START + 1] = 0x80;
+        }
+    }
+};
+
+Result benchmarkInstruction(const std::string& name, std::vector<uint8_t> instruction) {
+    auto console = std::make_unique<console::Console>();
+    Program program(instruction);
+    console->memory_map.mapReadOnly(ROM_START, program.prg.size(), program.prg.data());
+    // Pointers used by the indirect modes: ($10,X)/($10),Y -> $0200, JMP ($0300) -> $8000
+    console->memory_map.write(0x10, 0x00);
+    console->memory_map.write(0x11, 0x02);
+    console->memory_map.write(0x300, 0x00);
+    console->memory_map.write(0x301, 0x80);
+    console->processor.reset();
+    cpu::CPU& processor = console->processor;
+    return measure(name, 5000000, [&processor]() -> uint64_t { return processor.processNextOpcode(); });
+}
+
+void writeJSON(FILE* out, const std::vector<Result>& results) {
+    fprintf(out, "{\n  \"benchmarks\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.3f}%s\n",
+            results[i].name.c_str(), static_cast<unsigned long>(results[i].iterations),
+            results[i].ns_per_op, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<Result> results;
+
+    // Dispatch: fetch, table lookup and call of an implied instruction
+    results.push_back(benchmarkInstruction("dispatch/implied_CLC", {0x18}));
+
+    // Operand resolution, one instruction per addressing mode
+    results.push_back(benchmarkInstruction("operand/immediate_LDA", {0xA9, 0x42}));
+    results.push_back(benchmarkInstruction("operand/accumulator_ASL", {0x0A}));
+    results.push_back(benchmarkInstruction("operand/zero_page_LDA", {0xA5, 0x10}));
+    results.push_back(benchmarkInstruction("operand/zero_page_x_LDA", {0xB5, 0x10}));
+    results.push_back(benchmarkInstruction("operand/zero_page_y_LDX", {0xB6, 0x10}));
+    results.push_back(benchmarkInstruction("operand/absolute_LDA", {0xAD, 0x00, 0x02}));
+    results.push_back(benchmarkInstruction("operand/absolute_x_LDA", {0xBD, 0x00, 0x02}));
+    results.push_back(benchmarkInstruction("operand/absolute_y_LDA", {0xB9, 0x00, 0x02}));
+    results.push_back(benchmarkInstruction("operand/pre_indexed_indirect_LDA", {0xA1, 0x10}));
+    results.push_back(benchmarkInstruction("operand/post_indexed_indirect_LDA", {0xB1, 0x10}));
+    results.push_back(benchmarkInstruction("operand/indirect_JMP", {0x6C, 0x00, 0x03}));
+
+    // Operations that update the status flags
+    results.push_back(benchmarkInstruction("flags/immediate_ADC", {0x69, 0x42}));
+    results.push_back(benchmarkInstruction("flags/immediate_ORA", {0x09, 0x42}));
+    results.push_back(benchmarkInstruction("flags/zero_page_BIT", {0x24, 0x10}));
+    results.push_back(benchmarkInstruction("flags/zero_page_ROL", {0x26, 0x20}));
+    results.push_back(benchmarkInstruction("flags/accumulator_LSR", {0x4A}));
+
+    // Memory reads through the page table
+    {
+        auto console = std::make_unique<console::Console>();
+        Program program({0x18});
+        console->memory_map.mapReadOnly(ROM_START, program.prg.size(), program.prg.data());
+        memory::MemoryMap& memory_map = console->memory_map;
+
+        std::mt19937 rng(1);
+        std::vector<uint16_t> ram_addresses(1 << 12), rom_addresses(1 << 12);
+        for (auto& address : ram_addresses) {
+            address = rng() % RAM_MIRROR_END;
+        }
+        for (auto& address : rom_addresses) {
+            address = ROM_START + rng() % (MEMORY_SIZE - ROM_START);
+        }
+        std::size_t i = 0;
+        results.push_back(measure("memory/read_ram_random", 20000000, [&]() -> uint64_t {
+            return memory_map.read(ram_addresses[i++ & (ram_addresses.size() - 1)]);
+        }));
+        results.push_back(measure("memory/read_rom_random", 20000000, [&]() -> uint64_t {
+            return memory_map.read(rom_addresses[i++ & (rom_addresses.size() - 1)]);
+        }));
+        uint16_t address = ROM_START;
+        results.push_back(measure("memory/read_rom_sequential", 20000000, [&]() -> uint64_t {
+            return memory_map.read(address++ | ROM_START);
+        }));
+        results.push_back(measure("memory/read_open_bus", 20000000, [&]() -> uint64_t {
+            return memory_map.read(0x5000 + (i++ & 0xFF));
+        }));
+        results.push_back(measure("memory/write_ram", 20000000, [&]() -> uint64_t {
+            memory_map.write(ram_addresses[i & (ram_addresses.size() - 1)], i);
+            return ++i;
+        }));
+    }
+
+    FILE* out = argc > 1 ? fopen(argv[1], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+    writeJSON(out, results);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
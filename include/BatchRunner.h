@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CPU.h"
+#include "CodeDataLog.h"
+
+namespace batch {
+/**
+ * One ROM to run. It passes as soon as every expected memory signature
+ * matches, and fails if that hasn't happened within cycle_limit cycles.
+ */
+struct BatchEntry {
+    std::string rom_path;
+    uint64_t cycle_limit;
+    // (address, bytes expected from that address on)
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> signatures;
+};
+
+enum class BatchStatus {
+    PASS,
+    FAIL,
+    // The ROM couldn't be loaded at all
+    ERROR
+};
+
+struct BatchResult {
+    BatchStatus status;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t illegal_opcodes;
+    double seconds;
+    // Why the ROM failed to load, if it did
+    std::string error;
+    // What the run used the ROM for, if asked
+    std::shared_ptr<memory::CodeDataLog> code_data_log;
+};
+
+/**
+ * Parses a manifest with one ROM per line:
+ *
+ *     # path                  limit          signatures...
+ *     roms/01-implied.nes     frames=600     6001=DEB061 6000=00
+ *     roms/branch_timing.nes  cycles=2000000 6000=00
+ *
+ * Limits are given in cycles or NTSC frames. Each signature is a hex address
+ * and the hex bytes expected there. Paths are relative to the manifest.
+ * Throws std::runtime_error on malformed lines.
+ */
+std::vector<BatchEntry> parseManifest(const std::string& path);
+
+// Runs a single entry to completion on the calling thread in the given mode,
+// falling back to the interpreter if the host can't run the JIT, and keeping
+// a code/data log if log_code_data
+BatchResult runEntry(const BatchEntry& entry,
+    cpu::CPU::ExecutionMode mode = cpu::CPU::ExecutionMode::INTERPRETER, bool log_code_data = false);
+
+// Runs every entry as its own console on a work-stealing pool of jobs threads
+// (0 for one per core) and returns results in manifest order
+std::vector<BatchResult> runAll(const std::vector<BatchEntry>& entries, unsigned jobs,
+    cpu::CPU::ExecutionMode mode = cpu::CPU::ExecutionMode::INTERPRETER, bool log_code_data = false);
+
+// Merges the results' code/data logs per ROM, along with any .cdl already in
+// directory for it, and writes them there as the ROM's file name with a .cdl
+// extension. Throws std::runtime_error
+void writeCodeDataLogs(const std::vector<BatchEntry>& entries, const std::vector<BatchResult>& results,
+    const std::string& directory);
+
+// Writes the aggregated report as JSON
+void writeReport(FILE* out, const std::vector<BatchEntry>& entries,
+    const std::vector<BatchResult>& results, unsigned jobs, double seconds);
+} // batch::
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "Memory.h"
+
+namespace cartridge {
+enum class Mirroring {
+    HORIZONTAL,
+    VERTICAL,
+    FOUR_SCREEN
+};
+
+/**
+ * A cartridge loaded from an iNES or NES 2.0 file.
+ * The file is mapped read-only into memory rather than read, so PRG-ROM and
+ * CHR-ROM are spans into the mapping: nothing is copied, and pages of a ROM are
+ * only faulted in once something touches them.
+ */
+class Cartridge {
+public:
+    // Throws romException if the file can't be mapped or isn't a valid ROM
+    Cartridge(const std::string& path);
+    ~Cartridge();
+    Cartridge(const Cartridge&) = delete;
+    Cartridge& operator=(const Cartridge&) = delete;
+
+    // Maps PRG-ROM into $8000-$FFFF and copies any trainer to $7000
+    void mapInto(memory::MemoryMap& memory_map) const;
+
+    std::span<const uint8_t> prgROM() const { return prg_rom; }
+    // Empty if the board uses CHR-RAM instead
+    std::span<const uint8_t> chrROM() const { return chr_rom; }
+    uint16_t mapper() const { return mapper_number; }
+    Mirroring mirroring() const { return nametable_mirroring; }
+    bool hasBattery() const { return battery; }
+    bool isNES2() const { return nes2; }
+    // FNV-1a hash of PRG-ROM and CHR-ROM, identifying the game a save state is for
+    uint64_t romHash() const { return rom_hash; }
+
+    static constexpr std::size_t header_size = 16;
+    static constexpr std::size_t trainer_size = 512;
+    static constexpr std::size_t prg_bank_size = 0x4000;
+    static constexpr std::size_t chr_bank_size = 0x2000;
+
+private:
+    void parseHeader(const std::string& path);
+
+    const uint8_t* file_data;
+    std::size_t file_size;
+
+    std::span<const uint8_t> trainer;
+    std::span<const uint8_t> prg_rom;
+    std::span<const uint8_t> chr_rom;
+    uint64_t rom_hash;
+    uint16_t mapper_number;
+    Mirroring nametable_mirroring;
+    bool battery;
+    bool nes2;
+};
+} // cartridge::
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace memory {
+/**
+ * Code/data log: what each byte of PRG-ROM has been used for, kept in the .cdl
+ * layout FCEUX and Mesen read and write. The file is one flag byte per PRG-ROM
+ * byte followed by one per CHR-ROM byte. PRG-ROM bytes are flagged:
+ *
+ *     CODE           run as an opcode or operand
+ *     DATA           read by an instruction, or as a vector
+ *     INDIRECT_CODE  jumped to through JMP ($nnnn)
+ *     INDIRECT_DATA  read through ($nn,X) or ($nn),Y
+ *     PCM_DATA       fetched by the APU's DMC
+ *
+ * and bits 2-3 hold which 8KiB window of $8000-$FFFF the byte was seen through.
+ * Nothing is logged for CHR-ROM here, its flags are only carried through from
+ * files merged in. Logs of the same ROM combine by or-ing their flags, so runs
+ * on separate consoles, or in separate processes, each keep their own and
+ * merge them afterwards.
+ **/
+class CodeDataLog {
+public:
+    enum Flag : uint8_t {
+        CODE = 0x01,
+        DATA = 0x02,
+        INDIRECT_CODE = 0x10,
+        INDIRECT_DATA = 0x20,
+        PCM_DATA = 0x40
+    };
+    // The window bits for a byte seen at address
+    static constexpr uint8_t windowBits(uint16_t address) {
+        return (address >> 11) & 0x0C;
+    }
+
+    // A log with nothing flagged, for a ROM with the given PRG-ROM and
+    // chr_size bytes of CHR-ROM
+    CodeDataLog(std::span<const uint8_t> prg_rom, std::size_t chr_size);
+
+    // The PRG-ROM logged. The memory map flags a byte read through a page it
+    // maps from here
+    inline std::span<const uint8_t> prgROM() const {
+        return prg_rom;
+    }
+    inline uint8_t* prgFlags() {
+        return flags.data();
+    }
+    inline std::span<const uint8_t> prgFlags() const {
+        return {flags.data(), prg_rom.size()};
+    }
+    inline std::span<const uint8_t> chrFlags() const {
+        return {flags.data() + prg_rom.size(), flags.size() - prg_rom.size()};
+    }
+
+    // Both throw std::runtime_error if the other log is for a ROM of a
+    // different size, or the file can't be read
+    void merge(const CodeDataLog& other);
+    void mergeFile(const std::string& path);
+    // Throws std::runtime_error if the file can't be written
+    void writeFile(const std::string& path) const;
+
+    // PRG-ROM bytes with each flag set, and with none
+    struct Coverage {
+        std::size_t code;
+        std::size_t data;
+        std::size_t indirect_code;
+        std::size_t indirect_data;
+        std::size_t pcm_data;
+        std::size_t unused;
+    };
+    Coverage coverage() const;
+
+private:
+    std::span<const uint8_t> prg_rom;
+    // PRG-ROM's then CHR-ROM's, as in the file
+    std::vector<uint8_t> flags;
+};
+} // namespace memory
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "APU.h"
+#include "Cartridge.h"
+#include "Controller.h"
+#include "Memory.h"
+#include "CPU.h"
+#include "PPU.h"
+
+namespace console {
+// Owns everything making up one emulated NES. Consoles share no state, so any
+// number of them can run side by side in one process.
+class Console {
+public:
+    Console();
+
+    // Inserts the cartridge at path and resets the CPU. Throws romException
+    void loadROM(const std::string& path);
+
+    // Runs the CPU for at least cycles cycles, then brings the PPU up to date
+    // and hands the batch's audio to the APU's output. Returns the cycles run
+    uint64_t run(uint64_t cycles);
+
+    /**
+     * Save states capture the whole machine (CPU, RAM and every device) but not
+     * the cartridge, which must be the same one when the state is restored.
+     * Restoring throws saveStateException if the state is for a different ROM
+     * or isn't valid.
+     */
+
+    // Replaces the contents of state
+    void saveState(std::vector<uint8_t>& state) const;
+    void loadState(const uint8_t* state, std::size_t size);
+    // File variants also throw saveStateException if the file can't be used
+    void saveState(const std::string& path) const;
+    void loadState(const std::string& path);
+
+    // Declared before the CPU, which holds a reference to it
+    memory::MemoryMap memory_map;
+    cpu::CPU processor;
+    ppu::PPU ppu;
+    apu::APU apu;
+    // Ports 1 and 2
+    std::array<Controller, 2> controllers;
+    std::unique_ptr<cartridge::Cartridge> cartridge;
+
+private:
+    // The APU, controller and I/O registers at $4000-$40FF
+    struct IORegisters : memory::IOHandler {
+        IORegisters(Console& console) : console(console) {}
+        uint8_t read(uint16_t address) override;
+        void write(uint16_t address, uint8_t value) override;
+        Console& console;
+    };
+    IORegisters io_registers;
+};
+} // console::
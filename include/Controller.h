@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+#include "SaveState.h"
+
+namespace console {
+/**
+* A standard controller, read serially through $4016 (port 1) or $4017 (port 2).
+* Writing 1 to bit 0 of $4016 holds both controllers' shift registers loading
+* the buttons; once it goes back to 0 each read returns the next button in
+* bit 0, in the order of Button, then 1s. The buttons held are set from
+* outside, by a frontend or a movie.
+**/
+class Controller {
+public:
+    enum Button : uint8_t {
+        A = 0x01,
+        B = 0x02,
+        SELECT = 0x04,
+        START = 0x08,
+        UP = 0x10,
+        DOWN = 0x20,
+        LEFT = 0x40,
+        RIGHT = 0x80
+    };
+
+    Controller() : held(0), shift_register(0), strobe(false) {}
+
+    inline void setButtons(uint8_t buttons) {
+        held = buttons;
+    }
+    inline uint8_t buttons() const {
+        return held;
+    }
+
+    // Bit 0 of a write to $4016
+    inline void writeStrobe(uint8_t value) {
+        strobe = value & 1;
+        if (strobe) {
+            shift_register = held;
+        }
+    }
+    // Bit 0 of a read from the controller's port. The other bits are left
+    // to the caller
+    inline uint8_t read() {
+        if (strobe) {
+            return held & 1;
+        }
+        uint8_t bit = shift_register & 1;
+        // Official controllers shift 1s in behind the buttons
+        shift_register = shift_register >> 1 | 0x80;
+        return bit;
+    }
+
+    // Port is 0 or 1, each controller has a chunk of its own
+    void saveState(savestate::StateWriter& writer, unsigned port) const;
+    void loadState(savestate::StateReader& reader, unsigned port);
+
+private:
+    uint8_t held;
+    uint8_t shift_register;
+    bool strobe;
+};
+} // namespace console
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <stdint-gcc.h>
 #include <cstdio>
+#include <string>
 
 class opcodeException : public std::exception {
 public:
@@ -18,4 +19,30 @@ private:
     static constexpr char format[] = "Unexpected opcode 0x%x";
     char message[strlen(format) + 2];
     uint8_t opcode_;
+};
+
+class romException : public std::exception {
+public:
+    romException(const std::string& path, const std::string& reason)
+        : message("Can't load ROM " + path + ": " + reason) {}
+
+    const char * what () const noexcept override {
+        return message.c_str();
+    }
+
+private:
+    std::string message;
+};
+
+class saveStateException : public std::exception {
+public:
+    saveStateException(const std::string& reason)
+        : message("Can't restore save state: " + reason) {}
+
+    const char * what () const noexcept override {
+        return message.c_str();
+    }
+
+private:
+    std::string message;
 };
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+
+namespace json {
+// Escapes text for use inside a JSON string: quotes, backslashes and control
+// characters. Everything else, UTF-8 included, passes through as is
+std::string escape(const std::string& text);
+} // json::
@@ -1,27 +1,43 @@
 #pragma once
 
-#include <iostream>
-#include <fstream>
-#include <chrono>
-#include <ctime>
-#include <stdarg.h>
-
-inline void LOG(const char* msg, ...){
-    va_list vl;
-    va_start(vl, msg);
-    char buffer[1000];
-    char outmsg[1000];
-    char format[] = "[%s]: %s\n";
-    time_t now = time(NULL);
-    // convert now to string form
-    char dt[20];
-    struct tm * p = localtime(&now);
-    strftime(dt, 20, "%F %H:%M:%S ", p);
-    snprintf(buffer, 1000, format, dt, msg);
-    vsnprintf(outmsg, 1000, buffer, vl);
-    std::string filePath ="debug_log.txt";
-    std::ofstream ofs;
-    ofs.open(filePath.c_str(), std::ios_base::out | std::ios_base::app );
-    ofs << outmsg;
-    ofs.close();
-}
\ No newline at end of file
+#include <cstdint>
+
+/**
+ * Asynchronous, level-filtered logging to debug_log.txt.
+ * Messages are formatted on the calling thread straight into a slot of a
+ * lock-free ring buffer, and a background thread batches them out to the file.
+ * Logging never blocks: if the ring is full the message is dropped and counted.
+ *
+ * Levels below LOG_LEVEL are compiled out entirely, arguments included.
+ */
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+namespace logger {
+void write(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Blocks until everything logged so far has been written to the file
+void flush();
+
+// Number of messages dropped because the ring was full
+uint64_t droppedCount();
+} // logger::
+
+#define LOG_AT(level, ...) \
+    do { \
+        if constexpr ((level) >= LOG_LEVEL) { \
+            logger::write((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
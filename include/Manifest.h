@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "WorkStealingPool.h"
+
+namespace console {
+class Console;
+}
+
+namespace batch {
+/**
+ * Shared by the manifest-driven modes, --batch (BatchRunner.h) and --regress
+ * (Regression.h). A manifest has one ROM per line, its path first and then
+ * fields that depend on the mode. Text from a '#' on is a comment, and blank
+ * lines are skipped.
+ */
+
+// Calls parse_line for each ROM in the manifest with its path, relative to
+// the manifest's directory unless absolute, and the rest of the line. Throws
+// std::runtime_error if the manifest can't be opened, and with the file and
+// line number in front of the message of anything parse_line throws
+void readManifest(const std::string& path,
+    const std::function<void(const std::string& rom_path, std::istream& fields)>& parse_line);
+
+// Loads the ROM into a new console, or returns nullptr with why it couldn't
+// in error
+std::unique_ptr<console::Console> loadConsole(const std::string& rom_path, std::string& error);
+
+// Calls run(entry) for every entry on a work-stealing pool of jobs threads
+// (0 for one per core) and returns the results in manifest order
+template <typename Entry, typename Run>
+auto runInManifestOrder(const std::vector<Entry>& entries, unsigned jobs, const Run& run) {
+    std::vector<std::invoke_result_t<const Run&, const Entry&>> results(entries.size());
+    threading::WorkStealingPool pool(jobs);
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        // Each task writes only its own slot, so results needs no locking
+        pool.submit([&entries, &results, &run, i] {
+            results[i] = run(entries[i]);
+        });
+    }
+    pool.wait();
+    return results;
+}
+} // batch::
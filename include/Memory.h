@@ -1,17 +1,159 @@
 #pragma once
 #include <array>
+#include <cstddef>
+#include <cstdint>
 
+#include "CodeDataLog.h"
 #include "Logger.h"
+#include "SaveState.h"
 #define MEMORY_SIZE 0x10000
+#define PAGE_SIZE 0x100
+#define PAGE_COUNT (MEMORY_SIZE / PAGE_SIZE)
+// 2KiB of internal RAM, mirrored up to RAM_MIRROR_END
+#define RAM_SIZE 0x800
+#define RAM_MIRROR_END 0x2000
 // descending stack so start is further along than end
 #define STACK_START 0x1FF
 #define STACK_END 0x100
+// Battery/work RAM on the cartridge
+#define PRG_RAM_START 0x6000
+#define PRG_RAM_SIZE 0x2000
 #define ROM_START 0x8000 // takes up the rest of memory from here
+// RAM and PRG-RAM pages, the only memory a snapshot needs to capture
+#define STATE_PAGE_COUNT ((RAM_SIZE + PRG_RAM_SIZE) / PAGE_SIZE)
+// Interrupt vectors at the top of ROM
+#define NMI_VECTOR 0xFFFA
+#define RESET_VECTOR 0xFFFC
+#define IRQ_VECTOR 0xFFFE
 
 namespace memory {
-// Singleton class, allowing operations on RAM
+/**
+ * Interface for memory-mapped devices (PPU/APU registers, mappers etc.) that
+ * need to see every access to the pages they are mapped to.
+ */
+struct IOHandler {
+    virtual ~IOHandler() = default;
+    virtual uint8_t read(uint16_t address) = 0;
+    virtual void write(uint16_t address, uint8_t value) = 0;
+};
+
+/**
+ * The CPU's view of the address space, built from a table of 256 pages of 256
+ * bytes each. A page is either backed directly by host memory (RAM and ROM),
+ * which is read or written with a single indexed load, or handed to an
+ * IOHandler for memory-mapped I/O.
+ */
 struct MemoryMap{
+    // Maps internal RAM (with its mirrors) and PRG-RAM; everything else reads as
+    // open bus until something is mapped over it
     MemoryMap();
+    MemoryMap(const MemoryMap&) = delete;
+    MemoryMap& operator=(const MemoryMap&) = delete;
+
+    /**
+     * Functions for changing what backs a range of the address space. Ranges
+     * must start on a page boundary and cover whole pages.
+     */
+
+    // Reads come straight from host memory, writes go to the handler if given and
+    // are dropped otherwise
+    void mapReadOnly(uint16_t start, std::size_t size, const uint8_t* host, IOHandler* write_handler = nullptr);
+    void mapReadWrite(uint16_t start, std::size_t size, uint8_t* host);
+    void mapIO(uint16_t start, std::size_t size, IOHandler* handler);
+
+    // Saves and restores RAM and PRG-RAM. What is mapped where belongs to the
+    // cartridge and devices, which restore their own state
+    void saveState(savestate::StateWriter& writer) const;
+    void loadState(savestate::StateReader& reader);
+
+    /**
+     * Page-granular access to the saved memory for incremental snapshots and
+     * hashes. State pages number RAM first, then PRG-RAM. Writes through any
+     * mirror mark the page dirty, so a snapshot only needs to copy what
+     * takeDirtyPages() returns (bit n set for state page n) since its last
+     * call. Each tracker has its own view of what is dirty.
+     */
+    enum class DirtyTracker : uint8_t {
+        SNAPSHOT,
+        HASH,
+        COUNT
+    };
+    uint64_t takeDirtyPages(DirtyTracker tracker = DirtyTracker::SNAPSHOT) {
+        for (uint64_t& pending : pending_dirty_pages) {
+            pending |= dirty_pages;
+        }
+        dirty_pages = 0;
+        uint64_t& pending = pending_dirty_pages[static_cast<std::size_t>(tracker)];
+        uint64_t dirty = pending;
+        pending = 0;
+        return dirty;
+    }
+    const uint8_t* statePage(unsigned index) const;
+    void restoreStatePage(unsigned index, const uint8_t* data);
+
+    /**
+     * Support for caches of decoded instructions. Only pages backed by host
+     * memory (hostPage() isn't nullptr) can be cached. The cache calls
+     * watchCode() for each page it decodes from, then takeCodeWrites() reports
+     * which watched state pages were written since (with the same bits as
+     * takeDirtyPages()), or all bits set if the mapping or the whole of memory
+     * changed and everything cached must go.
+     */
+    inline const uint8_t* hostPage(uint8_t page) const {
+        return pages[page].read;
+    }
+    inline uint64_t statePageBit(uint8_t page) const {
+        return pages[page].dirty_bit;
+    }
+    inline void watchCode(uint8_t page) {
+        code_pages |= pages[page].dirty_bit;
+    }
+    inline bool codeWritten() const {
+        return code_written != 0;
+    }
+    // For generated code that polls codeWritten() itself
+    inline const uint64_t* codeWrittenFlag() const {
+        return &code_written;
+    }
+    uint64_t takeCodeWrites() {
+        uint64_t written = code_written;
+        code_written = 0;
+        code_pages &= ~written;
+        return written;
+    }
+
+    /**
+     * Code/data logging. While a log is attached, pages mapped read-only from
+     * its PRG-ROM flag the bytes accessed through loggedRead() and logAccess();
+     * plain read() is left for accesses that aren't the program's own, like
+     * decoding. Attaching counts as a change of mapping, so code cached before
+     * gets decoded, and logged, again. nullptr detaches. The log must outlive
+     * its use here.
+     */
+    void setCodeDataLog(CodeDataLog* log);
+    inline void logAccess(uint16_t address, uint8_t flags) {
+        const Page& page = pages[address >> 8];
+        if (__builtin_expect(page.log != nullptr, false)) {
+            logByte(page, address, flags);
+        }
+    }
+    // Flags length bytes from address as code
+    inline void logCode(uint16_t address, uint8_t length) {
+        for (uint8_t i = 0; i < length; ++i) {
+            logAccess(address + i, CodeDataLog::CODE);
+        }
+    }
+    // read() that flags the byte read
+    inline uint8_t loggedRead(uint16_t address, uint8_t flags = CodeDataLog::DATA) {
+        const Page& page = pages[address >> 8];
+        if (page.read) {
+            if (__builtin_expect(page.log != nullptr, false)) {
+                logByte(page, address, flags);
+            }
+            return page.read[address & 0xFF];
+        }
+        return page.handler->read(address);
+    }
 
     /**
     * Convenience functions for read/write memory operations in different addressing modes.
@@ -28,34 +170,91 @@ struct MemoryMap{
     void postIndexedIndirectWrite(uint16_t program_counter, uint8_t index, uint8_t value);
     void preIndexedIndirectWrite(uint16_t program_counter, uint8_t index, uint8_t value);
 
-    uint8_t* absoluteRead(uint16_t program_counter) const;
-    uint8_t* immediateRead(uint16_t program_counter) const;
-    uint8_t* indexedRead(uint16_t program_counter, uint8_t index) const;
-    uint8_t* zeroPageRead(uint16_t program_counter) const;
-    uint8_t* zeroPageIndexedRead(uint16_t program_counter, uint8_t index) const;
-    uint8_t* postIndexedIndirectRead(uint16_t program_counter, uint8_t index) const;
-    uint8_t* preIndexedIndirectRead(uint16_t program_counter, uint8_t index) const;
+    uint8_t absoluteRead(uint16_t program_counter);
+    uint8_t immediateRead(uint16_t program_counter);
+    uint8_t indexedRead(uint16_t program_counter, uint8_t index);
+    uint8_t zeroPageRead(uint16_t program_counter);
+    uint8_t zeroPageIndexedRead(uint16_t program_counter, uint8_t index);
+    uint8_t postIndexedIndirectRead(uint16_t program_counter, uint8_t index);
+    uint8_t preIndexedIndirectRead(uint16_t program_counter, uint8_t index);
 
-    /** 
+    /**
      * Functions for returning an address during a memory operation, where
      * other functions return value at that pointer
      */
 
-    uint16_t absoluteReadPointer(uint16_t program_counter) const;
-    uint16_t indirectReadPointer(uint16_t program_counter) const;
+    uint16_t absoluteReadPointer(uint16_t program_counter);
+    uint16_t indirectReadPointer(uint16_t program_counter);
 
     /**
      * Direct memory read/write
      */
 
-    void write(uint16_t address, uint8_t value);
-    uint8_t* read(uint16_t address) const;
+    inline void write(uint16_t address, uint8_t value){
+        const Page& page = pages[address >> 8];
+        if (page.write) {
+            page.write[address & 0xFF] = value;
+            dirty_pages |= page.dirty_bit;
+            code_written |= page.dirty_bit & code_pages;
+            return;
+        }
+        if (page.handler) {
+            page.handler->write(address, value);
+        }
+    }
+
+    inline uint8_t read(uint16_t address){
+        const Page& page = pages[address >> 8];
+        if (page.read) {
+            return page.read[address & 0xFF];
+        }
+        return page.handler->read(address);
+    }
 
 private:
-    uint16_t preIndexGetAddress(uint16_t program_counter, uint8_t index) const;
+    struct Page {
+        // Host memory backing this page, nullptr if accesses go to the handler
+        const uint8_t* read;
+        uint8_t* write;
+        IOHandler* handler;
+        // Bit for this page in dirty_pages, 0 if it isn't saved memory
+        uint64_t dirty_bit;
+        // Code/data log flags for the page's bytes, nullptr if not logged
+        uint8_t* log;
+    };
+
+    // Unmapped pages read as zero and ignore writes
+    struct OpenBus : IOHandler {
+        uint8_t read(uint16_t) override { return 0; }
+        void write(uint16_t, uint8_t) override {}
+    };
+
+    uint16_t preIndexGetAddress(uint16_t program_counter, uint8_t index);
+
+    uint16_t postIndexGetAddress(uint16_t program_counter, uint8_t index);
 
-    uint16_t postIndexGetAddress(uint16_t program_counter, uint8_t index) const;
+    uint64_t dirtyBitFor(const uint8_t* host) const;
+    uint8_t* logFor(const uint8_t* host) const;
+    static inline void logByte(const Page& page, uint16_t address, uint8_t flags) {
+        uint8_t& logged = page.log[address & 0xFF];
+        flags |= CodeDataLog::windowBits(address);
+        // Mostly they are already, and leaving the line clean is cheaper
+        if ((logged & flags) != flags) {
+            logged |= flags;
+        }
+    }
 
-    static std::array<uint8_t, MEMORY_SIZE> memory_map;
+    std::array<Page, PAGE_COUNT> pages;
+    OpenBus open_bus;
+    std::array<uint8_t, RAM_SIZE> ram;
+    std::array<uint8_t, PRG_RAM_SIZE> prg_ram;
+    uint64_t dirty_pages;
+    // Dirty pages already taken from dirty_pages that each tracker hasn't
+    // taken yet
+    std::array<uint64_t, static_cast<std::size_t>(DirtyTracker::COUNT)> pending_dirty_pages;
+    // State pages holding cached code, and which of them have been written
+    uint64_t code_pages;
+    uint64_t code_written;
+    CodeDataLog* code_data_log;
 };
-} // memory::
\ No newline at end of file
+} // memory::
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Console.h"
+#include "Scheduler.h"
+#include "StateHash.h"
+
+namespace console {
+/**
+* Controller input recorded a frame at a time, with the state hash at the end
+* of each frame so a replay can check it ends every frame where the recording
+* did. A frame is one scheduler batch, so recording and replay split the run
+* the same way whatever the wall clock does, and replays run uncapped. Movies
+* start from a save state held in the file.
+*
+* Files are compact: the input is stored as runs of frames with the same
+* buttons held, then 12 bytes per frame of hash and instruction count.
+**/
+class Movie {
+public:
+    struct Frame {
+        // Held on ports 1 and 2, see Controller::Button
+        std::array<uint8_t, 2> buttons;
+        // StateHash at the end of the frame
+        uint64_t state_hash;
+        // Instructions run during the frame
+        uint32_t instructions;
+    };
+
+    Movie(uint64_t rom_hash, std::vector<uint8_t> start_state);
+    // Throws std::runtime_error if the file can't be read or isn't a movie
+    explicit Movie(const std::string& path);
+    // Throws std::runtime_error
+    void save(const std::string& path) const;
+
+    inline uint64_t romHash() const {
+        return rom_hash;
+    }
+    inline const std::vector<uint8_t>& startState() const {
+        return start_state;
+    }
+    inline const std::vector<Frame>& frames() const {
+        return recorded;
+    }
+    inline void append(const Frame& frame) {
+        recorded.push_back(frame);
+    }
+
+private:
+    uint64_t rom_hash;
+    std::vector<uint8_t> start_state;
+    std::vector<Frame> recorded;
+};
+
+// Buttons to hold from a frame on, as read by parseInputScript()
+struct InputChange {
+    uint64_t frame;
+    std::array<uint8_t, 2> buttons;
+};
+
+/**
+ * Reads input to record from a text file with lines of
+ *
+ *     # frame  port 1    port 2 (optional)
+ *     120      ....T...
+ *     300      R......A  .L......
+ *
+ * giving the buttons held from that frame on, in FM2 order ("RLDUTSBA", T is
+ * start and S select), with anything else for a button released. Lines must
+ * be in frame order. Throws std::runtime_error on malformed lines.
+ */
+std::vector<InputChange> parseInputScript(const std::string& path);
+
+/**
+ * Runs frames for recording and replay. Opcodes that throw are skipped and
+ * counted, as the emulator does elsewhere, which keeps runs deterministic.
+ */
+class MovieRunner {
+public:
+    // Runs the console as it is now, uncapped
+    explicit MovieRunner(Console& console);
+
+    // Runs one frame with buttons held, returns it as a movie records it
+    Movie::Frame runFrame(std::array<uint8_t, 2> buttons);
+
+    struct Divergence {
+        // The first frame whose state hash differs, counted from 0
+        uint64_t frame;
+        // Run before that frame, all known to match
+        uint64_t instructions_before;
+        Movie::Frame expected;
+        Movie::Frame actual;
+        // At the end of the frame
+        uint16_t program_counter;
+        // The console at the start of the frame, to look into the divergence
+        // from
+        std::vector<uint8_t> start_state;
+    };
+    // Loads the movie's start state and replays every frame. Returns the
+    // first divergence, if there is one. Throws saveStateException if the
+    // start state is for another ROM
+    std::optional<Divergence> replay(const Movie& movie);
+
+    // StateHash::frameHash() of the console now
+    inline uint64_t frameHash() const {
+        return state_hash.frameHash();
+    }
+
+    inline uint64_t illegalOpcodes() const {
+        return illegal_opcodes;
+    }
+
+private:
+    Console& console;
+    cpu::Scheduler scheduler;
+    StateHash state_hash;
+    uint64_t illegal_opcodes;
+};
+} // namespace console
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "CPU.h"
+
+namespace batch {
+/**
+ * One ROM run for a fixed number of frames from reset with no buttons held,
+ * then checked against the state hash (CPU registers and RAM, see
+ * console::StateHash) and the hash of the frame the PPU drew last. Frames are
+ * scheduler batches, as in movies, so a hash here is the one a movie of the
+ * same run records for its last frame.
+ */
+struct RegressionEntry {
+    std::string rom_path;
+    uint64_t frames;
+    // Unset for ROMs that have no golden hashes yet
+    std::optional<uint64_t> state_hash;
+    std::optional<uint64_t> frame_hash;
+};
+
+enum class RegressionStatus {
+    PASS,
+    FAIL,
+    // Ran, but there was nothing to check it against
+    NEW,
+    // The ROM couldn't be loaded at all
+    ERROR
+};
+
+struct RegressionResult {
+    RegressionStatus status;
+    uint64_t state_hash;
+    uint64_t frame_hash;
+    uint64_t instructions;
+    uint64_t illegal_opcodes;
+    double seconds;
+    // Why the ROM failed to load, or where its save state went if it failed
+    std::string error;
+    std::string state_path;
+};
+
+/**
+ * Parses a manifest with one ROM per line:
+ *
+ *     # path              frames     golden hashes (optional)
+ *     roms/nestest.nes    frames=60  state=8d1f0c2a7be34419 frame=03b6e2a1c9d04f57
+ *     roms/new_game.nes   frames=600
+ *
+ * Paths are relative to the manifest. Throws std::runtime_error on malformed
+ * lines.
+ */
+std::vector<RegressionEntry> parseRegressionManifest(const std::string& path);
+
+// Runs a single entry on the calling thread. If it fails, its state at the
+// end of the run is saved to state_directory as the ROM's file name with the
+// frame count and a .state extension, for loading with --load-state
+RegressionResult runRegression(const RegressionEntry& entry, cpu::CPU::ExecutionMode mode,
+    const std::string& state_directory);
+
+// Runs every entry on a work-stealing pool of jobs threads (0 for one per
+// core) and returns results in manifest order
+std::vector<RegressionResult> runRegressions(const std::vector<RegressionEntry>& entries, unsigned jobs,
+    cpu::CPU::ExecutionMode mode, const std::string& state_directory);
+
+// Writes the results as JSON, with the hashes each ROM ended on so new
+// entries' golden hashes can be copied from it
+void writeRegressionReport(FILE* out, const std::vector<RegressionEntry>& entries,
+    const std::vector<RegressionResult>& results, unsigned jobs, double seconds);
+} // batch::
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "Console.h"
+
+namespace console {
+/**
+* Bounded history of per-frame snapshots for rewinding and seeking.
+* Each captured frame stores the CPU, PPU, APU and controller state and only the RAM/PRG-RAM pages
+* written since the previous capture. Every keyframe_interval frames a full
+* copy of memory is taken instead, which bounds how far back a seek has to
+* look. When the history is full the oldest frame is dropped, and if it was a
+* keyframe the next frame is filled in to become one, so every frame held stays
+* reachable.
+**/
+class RewindBuffer {
+public:
+    RewindBuffer(Console& console, std::size_t capacity_frames, unsigned keyframe_interval = 60);
+
+    // Snapshots the console as it is now. Call once per frame
+    void capture();
+
+    // Restores the console to the frame captured frames_back captures ago
+    // (0 is the latest) and forgets everything after it, so capturing carries
+    // on from there. Returns false, leaving the console alone, if the history
+    // doesn't go back that far
+    bool seekBack(std::size_t frames_back);
+
+    inline std::size_t frameCount() const {
+        return frames.size();
+    }
+
+    // Heap bytes held by the snapshots
+    std::size_t memoryUsage() const;
+
+private:
+    struct Frame {
+        // CPU, PPU, APU and controller chunks
+        std::vector<uint8_t> device_state;
+        // Bit n set if state page n is stored, in order, in pages
+        uint64_t page_mask;
+        std::vector<uint8_t> pages;
+    };
+
+    static constexpr uint64_t all_pages = ~uint64_t(0) >> (64 - STATE_PAGE_COUNT);
+
+    void storePages(Frame& frame, uint64_t page_mask);
+    void evictOldest();
+
+    Console& console;
+    std::size_t capacity_frames;
+    unsigned keyframe_interval;
+    unsigned frames_since_keyframe;
+    std::deque<Frame> frames;
+    // Storage from the last evicted frame, reused by the next capture
+    Frame spare;
+};
+} // console::
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "Expections.h"
+
+/**
+ * Binary save state format.
+ *
+ * A state is a header followed by chunks:
+ *
+ *     "NESSTATE" | u32 version | chunk*
+ *     chunk:     | u32 tag     | u32 size | size bytes
+ *
+ * Each component writes its own chunk, so new components add chunks without
+ * breaking old states: readers skip tags they don't know. Values are stored in
+ * host byte order (little-endian on every platform we build for).
+ */
+namespace savestate {
+constexpr char magic[8] = {'N', 'E', 'S', 'S', 'T', 'A', 'T', 'E'};
+constexpr uint32_t version = 1;
+
+constexpr uint32_t makeTag(const char (&name)[5]) {
+    return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8 |
+        uint32_t(uint8_t(name[2])) << 16 | uint32_t(uint8_t(name[3])) << 24;
+}
+
+class StateWriter {
+public:
+    StateWriter(std::vector<uint8_t>& buffer) : buffer(buffer), chunk_start(0) {
+        buffer.clear();
+        writeBytes(magic, sizeof(magic));
+        write(version);
+    }
+
+    void beginChunk(uint32_t tag) {
+        write(tag);
+        chunk_start = buffer.size();
+        write(uint32_t(0));
+    }
+
+    void endChunk() {
+        uint32_t size = buffer.size() - chunk_start - sizeof(uint32_t);
+        memcpy(buffer.data() + chunk_start, &size, sizeof(size));
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        writeBytes(&value, sizeof(T));
+    }
+
+    void writeBytes(const void* data, std::size_t size) {
+        std::size_t offset = buffer.size();
+        buffer.resize(offset + size);
+        memcpy(buffer.data() + offset, data, size);
+    }
+
+private:
+    std::vector<uint8_t>& buffer;
+    std::size_t chunk_start;
+};
+
+class StateReader {
+public:
+    // Throws saveStateException if data isn't a state this version understands
+    StateReader(const uint8_t* data, std::size_t size)
+        : data(data), size(size), position(0), limit(size) {
+        char header[sizeof(magic)];
+        readBytes(header, sizeof(header));
+        if (memcmp(header, magic, sizeof(magic)) != 0) {
+            throw saveStateException("not a save state");
+        }
+        if (read<uint32_t>() != version) {
+            throw saveStateException("unsupported version");
+        }
+    }
+
+    // Moves to the chunk with the given tag, which must exist. Reads are then
+    // limited to that chunk
+    void findChunk(uint32_t tag) {
+        if (!seekChunk(tag)) {
+            throw saveStateException("missing or truncated chunk");
+        }
+    }
+
+    // As findChunk(), but returns false if there is no such chunk, for
+    // components that older states don't have
+    bool seekChunk(uint32_t tag) {
+        position = sizeof(magic) + sizeof(uint32_t);
+        limit = size;
+        while (position + 2 * sizeof(uint32_t) <= size) {
+            uint32_t chunk_tag = read<uint32_t>();
+            uint32_t chunk_size = read<uint32_t>();
+            if (position + chunk_size > size) {
+                break;
+            }
+            if (chunk_tag == tag) {
+                limit = position + chunk_size;
+                return true;
+            }
+            position += chunk_size;
+        }
+        return false;
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+        readBytes(&value, sizeof(T));
+        return value;
+    }
+
+    // Bytes left in the current chunk
+    inline std::size_t remaining() const {
+        return limit - position;
+    }
+
+    void readBytes(void* out, std::size_t count) {
+        if (position + count > limit) {
+            throw saveStateException("truncated");
+        }
+        memcpy(out, data + position, count);
+        position += count;
+    }
+
+private:
+    const uint8_t* data;
+    std::size_t size;
+    std::size_t position;
+    std::size_t limit;
+};
+} // savestate::
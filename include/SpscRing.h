@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+
+namespace threading {
+/**
+ * Lock-free ring buffer for exactly one producer thread and one consumer
+ * thread, e.g. the emulator handing samples to an audio callback. Each side
+ * only writes its own index, so the only synchronisation is a release store
+ * of that index and an acquire load of the other one. The indices live on
+ * separate cache lines so the two threads don't fight over them.
+ */
+template <typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(std::size_t capacity)
+        : capacity(std::bit_ceil(std::max<std::size_t>(capacity, 2))), slots(new T[this->capacity]),
+          write_index(0), read_index(0) {}
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. Copies as many of the count values as fit and returns
+    // how many that was
+    std::size_t push(const T* values, std::size_t count) {
+        std::size_t write = write_index.load(std::memory_order_relaxed);
+        std::size_t read = read_index.load(std::memory_order_acquire);
+        count = std::min(count, capacity - (write - read));
+        for (std::size_t i = 0; i < count; ++i) {
+            slots[(write + i) & (capacity - 1)] = values[i];
+        }
+        write_index.store(write + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Takes up to count values and returns how many it took
+    std::size_t pop(T* values, std::size_t count) {
+        std::size_t read = read_index.load(std::memory_order_relaxed);
+        std::size_t write = write_index.load(std::memory_order_acquire);
+        count = std::min(count, write - read);
+        for (std::size_t i = 0; i < count; ++i) {
+            values[i] = slots[(read + i) & (capacity - 1)];
+        }
+        read_index.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    // Either side, only a snapshot while the other one is running
+    std::size_t size() const {
+        return write_index.load(std::memory_order_acquire) - read_index.load(std::memory_order_acquire);
+    }
+
+private:
+    // Indices count up forever and are masked on use, so full and empty
+    // don't need telling apart
+    const std::size_t capacity;
+    std::unique_ptr<T[]> slots;
+    alignas(64) std::atomic<std::size_t> write_index;
+    alignas(64) std::atomic<std::size_t> read_index;
+};
+} // threading::
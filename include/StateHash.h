@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Console.h"
+
+namespace console {
+/**
+* Hash of a console's CPU registers, cycle count, RAM and PRG-RAM, for checking
+* that two runs are in the same state. Each 256-byte page of memory keeps its
+* own hash, and only pages written since the last update() (as the memory map
+* tracks them for snapshots) are hashed again, so an update mostly costs the
+* few pages a frame touches.
+**/
+class StateHash {
+public:
+    // Hashes every page, later updates only those written since
+    explicit StateHash(Console& console);
+
+    // Brings the page hashes up to date and returns the hash of the state now
+    uint64_t update();
+
+    // Hash of the last frame the PPU drew, hashed in full each call
+    uint64_t frameHash() const;
+
+private:
+    Console& console;
+    std::array<uint64_t, STATE_PAGE_COUNT> page_hashes;
+};
+} // namespace console
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace threading {
+/**
+ * Fixed-size thread pool where every worker has its own task deque.
+ * Workers take their own newest task first (it's the one most likely to still
+ * be in cache) and, when they run dry, steal the oldest task from another
+ * worker. Tasks are meant to be coarse - a whole emulator run - so each deque is
+ * simply guarded by its own mutex.
+ */
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    // 0 threads means one per hardware thread
+    explicit WorkStealingPool(unsigned threads = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Tasks submitted from a worker go on its own deque, others are dealt out
+    // round-robin. Tasks must not throw.
+    void submit(Task task);
+
+    // Blocks until every submitted task has finished
+    void wait();
+
+    inline unsigned threadCount() const {
+        return static_cast<unsigned>(workers.size());
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void run(unsigned index);
+    bool popLocal(unsigned index, Task& task);
+    bool steal(unsigned thief, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<unsigned> next_worker;
+    // Tasks submitted but not yet finished
+    std::atomic<std::size_t> pending;
+    std::atomic<bool> stopping;
+
+    // Idle workers and wait() sleep here
+    std::mutex idle_mutex;
+    // Tasks submitted but not yet taken off a deque, guarded by idle_mutex.
+    // Idle workers sleep until it is non-zero
+    std::size_t queued;
+    std::condition_variable work_available;
+    std::condition_variable all_done;
+};
+} // threading::
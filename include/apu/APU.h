@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "AudioOutput.h"
+#include "BlipBuffer.h"
+#include "CPU.h"
+#include "Memory.h"
+#include "SaveState.h"
+
+namespace apu {
+/**
+* The 2A03's audio processing unit: two pulse channels, a triangle, a noise
+* channel and the delta modulation channel (DMC), sequenced by the frame
+* counter. Registers are $4000-$4013, $4015 and $4017.
+*
+* Like the PPU it runs lazily. Channels are event driven: each one steps from
+* timer clock to timer clock and reports only the changes in its output to a
+* BlipBuffer, so nothing is done per CPU cycle. Register accesses catch the
+* channels up first, and endFrame(), called at the end of each batch of CPU
+* cycles, turns the batch into samples in one go and hands them to the output.
+*
+* Channels are mixed linearly (per-channel weights fitted to the 2A03's
+* non-linear mixer), which lets each channel's deltas go straight into one
+* buffer. The frame IRQ and DMC IRQ drive the CPU's IRQ line; the DMC's
+* sample fetches read through the memory map and stall the CPU for 4 cycles
+* each. Both are scheduled as CPU events, so they happen on time without the
+* CPU asking. Only NTSC timing is implemented.
+**/
+class APU : public cpu::EventHandler {
+public:
+    static constexpr unsigned default_sample_rate = 44100;
+    static constexpr double cpu_clock_hz = 1789773.0;
+
+    APU(cpu::CPU& cpu, memory::MemoryMap& memory_map, unsigned sample_rate = default_sample_rate);
+    APU(const APU&) = delete;
+    APU& operator=(const APU&) = delete;
+
+    // $4015
+    uint8_t readStatus();
+    // $4000-$4013, $4015 and $4017; other addresses are ignored
+    void writeRegister(uint16_t address, uint8_t value);
+
+    // Runs the channels and frame counter up to the start of the given CPU
+    // cycle. Cycles already passed are ignored
+    void catchUp(uint64_t cpu_cycle);
+    void handleEvent(cpu::Event event, uint64_t cycle) override;
+    // Catches up to cpu_cycle, then synthesises every sample up to it and
+    // writes them to the output
+    void endFrame(uint64_t cpu_cycle);
+
+    // Samples go to output from now on, nullptr discards them. The output
+    // must outlive its use here
+    inline void setOutput(SampleSink* sink) {
+        output = sink;
+    }
+    inline unsigned sampleRate() const {
+        return blip.sampleRate();
+    }
+
+    // Host time spent in endFrame() and the number of calls, for profiling
+    inline uint64_t synthesisNanoseconds() const {
+        return synthesis_ns;
+    }
+    inline uint64_t framesSynthesised() const {
+        return frames_synthesised;
+    }
+
+    void saveState(savestate::StateWriter& writer) const;
+    // States without an APU chunk leave the APU as it is
+    void loadState(savestate::StateReader& reader);
+
+private:
+    // Volume control shared by the pulse and noise channels
+    struct Envelope {
+        bool start;
+        // Also halts the channel's length counter
+        bool loop;
+        bool constant;
+        // Constant volume, or the divider period
+        uint8_t period;
+        uint8_t divider;
+        uint8_t decay;
+
+        void clock();
+        inline uint8_t volume() const {
+            return constant ? period : decay;
+        }
+    };
+
+    struct Pulse {
+        Envelope envelope;
+        uint8_t duty;
+        uint8_t step;
+        uint16_t timer_period;
+        uint8_t length;
+        bool enabled;
+        bool sweep_enabled;
+        bool sweep_negate;
+        bool sweep_reload;
+        uint8_t sweep_period;
+        uint8_t sweep_shift;
+        uint8_t sweep_divider;
+        // Pulse 1 negates with ones' complement, pulse 2 with two's
+        bool ones_complement;
+        uint64_t next_clock;
+        int32_t level;
+
+        uint16_t sweepTarget() const;
+        // Silent whatever the sequencer's step
+        bool muted() const;
+        int32_t output() const;
+        void clockSweep();
+    };
+
+    struct Triangle {
+        uint16_t timer_period;
+        uint8_t step;
+        uint8_t length;
+        bool enabled;
+        // Also halts the length counter
+        bool control;
+        bool linear_reload;
+        uint8_t linear_period;
+        uint8_t linear_counter;
+        uint64_t next_clock;
+        int32_t level;
+
+        int32_t output() const;
+    };
+
+    struct Noise {
+        Envelope envelope;
+        bool short_mode;
+        uint16_t timer_period;
+        uint16_t shift_register;
+        uint8_t length;
+        bool enabled;
+        uint64_t next_clock;
+        int32_t level;
+
+        inline bool muted() const {
+            return length == 0 || envelope.volume() == 0;
+        }
+        int32_t output() const;
+    };
+
+    struct DMC {
+        bool irq_enabled;
+        bool loop;
+        uint16_t timer_period;
+        uint16_t sample_address;
+        uint16_t sample_length;
+        // Memory reader
+        uint16_t address;
+        uint16_t bytes_remaining;
+        uint8_t buffer;
+        bool buffer_full;
+        // Output unit
+        uint8_t shift_register;
+        uint8_t bits_remaining;
+        bool silence;
+        uint8_t output_level;
+        uint64_t next_clock;
+        int32_t level;
+    };
+
+    // Steps every channel's timer up to end, reporting output changes
+    void runChannels(uint64_t end);
+    void runPulse(Pulse& pulse, uint64_t end);
+    void runTriangle(uint64_t end);
+    void runNoise(uint64_t end);
+    void runDMC(uint64_t end);
+    // A sample ending here raises its IRQ as on cycle at, see updateIRQ()
+    void fetchDMCSample(uint64_t at);
+    // Reports a channel's output if it changed since it was last reported
+    void update(int32_t& level, int32_t output, int32_t weight, uint64_t time);
+    void updateAll(uint64_t time);
+
+    void clockFrameCounter();
+    void clockQuarterFrame();
+    void clockHalfFrame();
+    // Sets the CPU's IRQ line, as raised on cycle at if it wasn't already
+    void updateIRQ(uint64_t at);
+    // Schedules the CPU events for the next frame IRQ and DMC fetch
+    void scheduleCPUEvents();
+
+    // Passes every field of the channels and frame counter to visit(field),
+    // for save states. Self is APU or const APU
+    template <typename Self, typename Visit>
+    static void visitState(Self& self, Visit&& visit);
+
+    cpu::CPU& cpu;
+    memory::MemoryMap& memory_map;
+    BlipBuffer blip;
+    SampleSink* output;
+    std::vector<int16_t> samples;
+
+    Pulse pulses[2];
+    Triangle triangle;
+    Noise noise;
+    DMC dmc;
+
+    // Frame counter
+    bool five_step;
+    bool irq_inhibit;
+    bool frame_irq;
+    bool dmc_irq;
+    uint8_t frame_step;
+    uint64_t next_frame_step;
+    // Everything before this CPU cycle has been run
+    uint64_t time;
+
+    uint64_t synthesis_ns;
+    uint64_t frames_synthesised;
+};
+} // namespace apu
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "SpscRing.h"
+
+namespace apu {
+// Where the APU sends its samples (mono, signed 16-bit) after each batch
+struct SampleSink {
+    virtual ~SampleSink() = default;
+    virtual void write(const int16_t* samples, std::size_t count) = 0;
+};
+
+/**
+ * Hands samples to another thread, typically an audio callback, through a
+ * lock-free ring. The emulator thread writes and the consumer calls read().
+ * Samples that don't fit are dropped rather than blocking the emulator.
+ */
+class SampleRing : public SampleSink {
+public:
+    explicit SampleRing(std::size_t capacity) : ring(capacity), dropped(0) {}
+
+    void write(const int16_t* samples, std::size_t count) override {
+        dropped += count - ring.push(samples, count);
+    }
+
+    // Consumer side, returns the samples copied to out
+    inline std::size_t read(int16_t* out, std::size_t count) {
+        return ring.pop(out, count);
+    }
+    // Producer side
+    inline uint64_t droppedSamples() const {
+        return dropped;
+    }
+
+private:
+    threading::SpscRing<int16_t> ring;
+    uint64_t dropped;
+};
+
+// Writes samples to a WAV file, for headless runs
+class WavWriter : public SampleSink {
+public:
+    // Throws std::runtime_error if the file can't be created
+    WavWriter(const std::string& path, unsigned sample_rate);
+    // Finishes the header, see close()
+    ~WavWriter();
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    void write(const int16_t* samples, std::size_t count) override;
+    // Fills in the sizes in the header and closes the file. Returns false if
+    // anything failed to write
+    bool close();
+
+private:
+    FILE* file;
+    unsigned sample_rate;
+    uint32_t data_bytes;
+    bool failed;
+};
+} // namespace apu
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace apu {
+/**
+* Band-limited synthesis in the style of blargg's Blip_Buffer. Sound sources
+* don't produce samples: they report each change of their output level as a
+* delta at the clock it happens on. Each delta is added to the buffer as a
+* band-limited step (a windowed sinc, integrated, at one of phase_count
+* sub-sample positions), so sharp edges come out without aliasing. endFrame()
+* then turns everything up to a clock into samples with one running sum,
+* which also removes DC with a gentle high-pass.
+*
+* The work is proportional to the number of changes, not to the clock rate,
+* which is what makes a 1.79MHz source affordable.
+**/
+class BlipBuffer {
+public:
+    BlipBuffer(double clock_rate, unsigned sample_rate);
+
+    // Forgets any pending output and starts counting from clock
+    void reset(uint64_t clock);
+
+    // Adds a step of delta at clock, which must not be before the last
+    // endFrame(). Deltas are in output units (full scale is +-32767)
+    void addDelta(uint64_t clock, int32_t delta);
+
+    // Makes the samples up to clock available to readSamples()
+    void endFrame(uint64_t clock);
+
+    inline std::size_t samplesAvailable() const {
+        return samples_available;
+    }
+    // Moves up to count samples to out, returns how many
+    std::size_t readSamples(int16_t* out, std::size_t count);
+
+    inline unsigned sampleRate() const {
+        return sample_rate;
+    }
+
+    // Kernel shape, shared by all buffers
+    static constexpr unsigned phase_bits = 5;
+    static constexpr unsigned phase_count = 1 << phase_bits;
+    static constexpr unsigned kernel_width = 16;
+    // Kernel taps are fixed point with this many fraction bits
+    static constexpr unsigned delta_bits = 15;
+
+private:
+    // Sample positions are 32.32 fixed point
+    static constexpr unsigned fraction_bits = 32;
+
+    // Fixed point position of clock, in samples from the start of buffer
+    inline uint64_t position(uint64_t clock) const {
+        return offset + (clock - frame_clock) * factor;
+    }
+
+    unsigned sample_rate;
+    // Samples per clock, fixed point
+    uint64_t factor;
+    // Clock and fixed point sample position that the current frame starts at
+    uint64_t frame_clock;
+    uint64_t offset;
+    std::size_t samples_available;
+    // Differences between consecutive samples, waiting to be summed
+    std::vector<int32_t> buffer;
+    // Running sum, with delta_bits of fraction
+    int64_t integrator;
+};
+} // namespace apu
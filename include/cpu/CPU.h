@@ -1,26 +1,162 @@
 #pragma once 
 
 #include <array>
-#include <bitset>
-#include <functional>
-#include <optional>
-#include <map>
 #include <memory>
+#include <string>
+#include <utility>
 
 #include "Logger.h"
 #include "Memory.h"
+#include "EventScheduler.h"
 #include "Expections.h"
+#include "Profiler.h"
+#include "SaveState.h"
+#include "Trace.h"
 
 namespace cpu {
+class Jit;
+
 class CPU {
 public:
-    CPU();
-    void processNextOpcode();
+    // How run() executes instructions
+    enum class ExecutionMode {
+        INTERPRETER,
+        // Recompiles basic blocks to native code, see Jit.h
+        JIT,
+        // Makes exactly one bus access per cycle, dummy reads and writes
+        // included, advancing the cycle count as it goes. Slower, but devices
+        // see every access the real CPU makes at the cycle it makes it
+        CYCLE_STEPPED
+    };
+
+    // Sees every bus access made in CYCLE_STEPPED mode
+    struct BusMonitor {
+        virtual ~BusMonitor() = default;
+        virtual void access(uint64_t cycle, uint16_t address, uint8_t value, bool write) = 0;
+    };
+
+    // The memory map is owned by the console the CPU belongs to
+    CPU(memory::MemoryMap& memory_map);
+    ~CPU();
+    // Jumps to the address in the reset vector, as on power-up or reset
+    void reset();
+    // Executes one instruction, and the interrupt sequence if it ends with one
+    // being taken. Returns the number of cycles that took. Events aren't
+    // fired, see run()
+    uint8_t processNextOpcode();
+    // Executes instructions until at least cycles have passed, ending on the
+    // same instruction as calling processNextOpcode() in a loop would, and
+    // fires each event as the cycle count reaches it. Returns the cycles taken
+    uint64_t run(uint64_t cycles);
+
+    // Device events, fired by run()
+    inline EventScheduler& events() {
+        return event_scheduler;
+    }
+
+    // Returns false if the mode isn't supported on this host, leaving the mode
+    // unchanged. Tracing always runs through the interpreter
+    bool setExecutionMode(ExecutionMode mode);
+    inline ExecutionMode executionMode() const {
+        return execution_mode;
+    }
+
+    // Records every instruction executed to trace_writer from now on, nullptr
+    // stops tracing. The writer must outlive its use here.
+    inline void setTraceWriter(TraceWriter* trace_writer_) {
+        trace_writer = trace_writer_;
+    }
+
+    // Reports bus accesses to monitor from now on, nullptr stops. Only
+    // CYCLE_STEPPED mode reports them. The monitor must outlive its use here.
+    inline void setBusMonitor(BusMonitor* monitor) {
+        bus_monitor = monitor;
+    }
+
+    // Profiles every instruction run from now on, nullptr stops. Profiling
+    // runs the interpreter (or the cycle-stepped core) in place of the JIT.
+    // Does nothing unless the profiler is compiled in, see Profiler.h. The
+    // profiler must outlive its use here.
+    inline void setProfiler(Profiler* profiler_) {
+        profiler = profiler_;
+        updateSlowPath();
+    }
+
+    /**
+     * Interrupt inputs. NMI is edge triggered: a request stays pending until
+     * it is taken. IRQ is level triggered and ignored while the INTERRUPT flag
+     * is set. Like the 6502, the CPU checks for interrupts before the last
+     * cycle of each instruction, so one raised after that waits for the end of
+     * the next instruction. Devices give the cycle a request was made on, so
+     * one found while catching up after an instruction is timed as if it
+     * had been made on the cycle the cycle-stepped CPU would have seen it.
+     */
+    void requestNMI(uint64_t at);
+    void setIRQLine(bool asserted, uint64_t at);
+
+    // Halts the CPU for cycles after the current instruction, as when DMA
+    // takes over the bus
+    inline void stall(unsigned cycles) {
+        stall_cycles += cycles;
+        updateSlowPath();
+    }
+
+    // Cycles executed since the CPU was created
+    inline uint64_t cycleCount() const {
+        return cycle_count;
+    }
+
+    // Instructions executed since the CPU was created
+    inline uint64_t instructionCount() const {
+        return instruction_count;
+    }
+
+    // The programmer-visible registers, with the flags worked out
+    struct Registers {
+        uint8_t accumulator;
+        uint8_t X;
+        uint8_t Y;
+        uint8_t status;
+        // Low byte, the stack is always in page 1
+        uint8_t stack_pointer;
+        uint16_t program_counter;
+    };
+    inline Registers registers() const {
+        return {accumulator, X, Y, processorStatus(), static_cast<uint8_t>(stack_pointer), program_counter};
+    }
+    // Loads every register at once, as for running an instruction from a
+    // known state. BREAK and ALWAYS1 in the status are ignored, as in PLP
+    void setRegisters(const Registers& registers);
+
+    // Instructions executed from the decode cache vs decoded from memory
+    struct DecodeCacheStats {
+        uint64_t hits;
+        uint64_t misses;
+
+        inline double hitRate() const {
+            uint64_t total = hits + misses;
+            return total ? double(hits) / total : 0.0;
+        }
+    };
+    inline DecodeCacheStats decodeCacheStats() const {
+        return decode_cache_stats;
+    }
+
+    void saveState(savestate::StateWriter& writer) const;
+    // Throws saveStateException
+    void loadState(savestate::StateReader& reader);
+
+    // Formats an instruction as assembly, e.g. "LDA ($20),Y". bytes holds the
+    // opcode followed by its operand, program_counter is where it was fetched
+    // from and gives the targets of branches
+    static std::string disassemble(const uint8_t* bytes, uint16_t program_counter);
+    // Bytes an instruction takes up, including the opcode
+    static uint8_t instructionLength(uint8_t opcode);
 
 private:
+    friend class Jit;
 
-    typedef std::bitset<8> Register8;
-    enum class AddressingMode {
+    enum class AddressingMode : uint8_t {
         ZERO_PAGE,
         PRE_INDEXED_INDIRECT,
         IMMEDIATE,
@@ -32,7 +168,9 @@ private:
         INDEXED_Y,
         IMPLIED,
         ACCUMULATOR,
-        INDIRECT
+        INDIRECT,
+        // Signed offset from the next instruction, used by branches
+        RELATIVE
     };
 
     // Bit locations of flags in processor status register
@@ -48,37 +186,393 @@ private:
     };
 
 
-    typedef std::bitset<8> Operand;
-    typedef std::function<void(CPU&, Operand&)> Operator;
+    // Resolved operand of an instruction. Holds where the operand lives rather
+    // than its value, so resolving it never touches the heap and handlers can
+    // write results back through it.
+    struct Operand {
+        // Effective address. Unused for IMPLIED and ACCUMULATOR
+        uint16_t address;
+        AddressingMode addressing_mode;
+        // Indexing carried the effective address into the next page
+        bool crossed_page_boundary;
+    };
+    typedef void (*Operator)(CPU&, Operand&);
 
     // Tuple holding information about CPU operations
     struct OperationTuple {
         Operator op;
+        const char* mnemonic;
         AddressingMode addressing_mode;
         uint8_t cycles;
         bool plus_if_crossed_page_boundary;
     };
 
-    void performOperation(const OperationTuple& operation);
-    std::shared_ptr<std::bitset<8>> getOperandFromMemory(const AddressingMode& addressing_mode);
+    typedef uint8_t Opcode;
+    // The official instruction set, see Opcodes.h
+    typedef std::array<std::pair<Opcode, OperationTuple>, 151> OpcodeList;
+    static constexpr OpcodeList describeOpcodes();
+
+    struct DecodedInstruction;
+    // Runs one instruction: resolves its operand, steps the program counter
+    // over it, performs the operation and adds the cycles taken
+    typedef void (*Executor)(CPU&, const DecodedInstruction&);
+    // As Executor, for CYCLE_STEPPED mode. Called once the opcode is fetched
+    typedef void (*SteppedExecutor)(CPU&);
+
+    // An instruction as fetched from memory, everything needed to run it
+    // without touching the opcode table or the instruction bytes again
+    struct DecodedInstruction {
+        Executor exec;
+        // Operand bytes, little-endian
+        uint16_t operand_bytes;
+        // 0 for entries that haven't been decoded
+        uint8_t length;
+        uint8_t opcode;
+    };
+    typedef std::array<DecodedInstruction, PAGE_SIZE> DecodedPage;
+
+    /**
+     * Decode cache, keyed by program counter. Pages are allocated the first time
+     * code runs from them. Only code in host memory is cached; the memory map
+     * reports writes to RAM holding cached code, and changes to the mapping,
+     * which drop the affected pages before the next instruction is fetched.
+     */
+    inline const DecodedInstruction& fetchInstruction() {
+        const std::unique_ptr<DecodedPage>& page = decoded_pages[program_counter >> 8];
+        if (page) {
+            const DecodedInstruction& instruction = (*page)[program_counter & 0xFF];
+            if (instruction.length) {
+                ++decode_cache_stats.hits;
+                return instruction;
+            }
+        }
+        return decodeInstruction();
+    }
+    const DecodedInstruction& decodeInstruction();
+
+    // Runs the instruction at the program counter, returns its opcode
+    inline uint8_t runDecodedInstruction() {
+        const DecodedInstruction& instruction = fetchInstruction();
+        if (__builtin_expect(trace_writer != nullptr, false)) {
+            traceInstruction(instruction.opcode, opcodes_to_operations[instruction.opcode]);
+        }
+        instruction.exec(*this, instruction);
+        return instruction.opcode;
+    }
+    // processNextOpcode() while slow_path is set
+    uint8_t processNextOpcodeSlowly();
+    // Runs the next instruction for processNextOpcodeSlowly() while a profiler
+    // is attached, returns its opcode
+    uint8_t runProfiledInstruction();
+    void invalidateDecodedPages(uint64_t written_state_pages);
+
+    void traceInstruction(uint8_t opcode, const OperationTuple& operation);
+
+    /**
+     * One handler per official opcode, generated from describeOpcodes() in
+     * Operations.cpp. The addressing mode, operation and cycle count are all
+     * known at compile time, so each one compiles down to the operand fetch
+     * for its mode with the operation inlined after it.
+     */
+    template <Operator OP, AddressingMode MODE, uint8_t CYCLES, bool PLUS_IF_CROSSED_PAGE_BOUNDARY>
+    static void exec(CPU& cpu_, const DecodedInstruction& instruction);
+
+    /**
+     * The CYCLE_STEPPED version of exec(), generated from the same table. It
+     * makes the bus accesses of the addressing mode itself, including the
+     * dummy ones, and leaves the operation to make its own, so the handlers
+     * are shared between the modes.
+     */
+    template <Operator OP, AddressingMode MODE, uint8_t CYCLES, bool PLUS_IF_CROSSED_PAGE_BOUNDARY>
+    static void step(CPU& cpu_);
+    // Resolves the operand one bus access per cycle, with the program counter
+    // on the opcode. WRITES is set for instructions that write their operand,
+    // which always take the indexed modes' extra cycle
+    template <AddressingMode MODE, bool WRITES>
+    Operand fetchOperand();
+
+    // Operands are resolved with the program counter still on the opcode
+    template <AddressingMode MODE>
+    inline Operand getOperandFromMemory(uint16_t operand_bytes) {
+        uint8_t zero_page_address = static_cast<uint8_t>(operand_bytes);
+        Operand operand{0, MODE, false};
+
+        // Reads a little-endian address from the zero page, wrapping within it
+        auto readZeroPageAddress = [this](uint8_t zero_page_address) -> uint16_t {
+            return memory_map.read(static_cast<uint8_t>(zero_page_address + 1)) << 8 |
+                memory_map.read(zero_page_address);
+        };
+        auto index = [&operand](uint16_t base, uint8_t offset) {
+            operand.address = base + offset;
+            operand.crossed_page_boundary = (base ^ operand.address) & 0xFF00;
+        };
+
+        if constexpr (MODE == AddressingMode::IMMEDIATE) {
+            // The operand byte follows the opcode
+            operand.address = program_counter + 1;
+        }
+        else if constexpr (MODE == AddressingMode::ZERO_PAGE) {
+            operand.address = zero_page_address;
+        }
+        else if constexpr (MODE == AddressingMode::ZERO_PAGE_INDEXED_X) {
+            // Zero page indexing wraps around within the zero page
+            operand.address = static_cast<uint8_t>(zero_page_address + X);
+        }
+        else if constexpr (MODE == AddressingMode::ZERO_PAGE_INDEXED_Y) {
+            operand.address = static_cast<uint8_t>(zero_page_address + Y);
+        }
+        else if constexpr (MODE == AddressingMode::ABSOLUTE) {
+            operand.address = operand_bytes;
+        }
+        else if constexpr (MODE == AddressingMode::INDEXED_X) {
+            index(operand_bytes, X);
+        }
+        else if constexpr (MODE == AddressingMode::INDEXED_Y) {
+            index(operand_bytes, Y);
+        }
+        else if constexpr (MODE == AddressingMode::PRE_INDEXED_INDIRECT) {
+            // (zp,X): index into the zero page, then read the address stored there
+            operand.address = readZeroPageAddress(zero_page_address + X);
+        }
+        else if constexpr (MODE == AddressingMode::POST_INDEXED_INDIRECT) {
+            // (zp),Y: read the address stored in the zero page, then index it
+            index(readZeroPageAddress(zero_page_address), Y);
+        }
+        else if constexpr (MODE == AddressingMode::INDIRECT) {
+            // The 6502 doesn't carry into the high byte when fetching the target, so
+            // JMP ($10FF) reads its high byte from $1000 rather than $1100
+            uint16_t high_byte_address = (operand_bytes & 0xFF00) | static_cast<uint8_t>(operand_bytes + 1);
+            operand.address = memory_map.loggedRead(high_byte_address) << 8 | memory_map.loggedRead(operand_bytes);
+            memory_map.logAccess(operand.address, memory::CodeDataLog::INDIRECT_CODE);
+        }
+        else if constexpr (MODE == AddressingMode::RELATIVE) {
+            // The branch target. Taking a branch costs a cycle more if it
+            // lands in another page from the next instruction
+            uint16_t next_instruction = program_counter + 2;
+            operand.address = next_instruction + static_cast<int8_t>(zero_page_address);
+            operand.crossed_page_boundary = (next_instruction ^ operand.address) & 0xFF00;
+        }
+        return operand;
+    }
+    // For modes only known at run time
+    Operand getOperandFromMemory(AddressingMode addressing_mode, uint16_t operand_bytes);
+
+    // Number of bytes an instruction takes up, including the opcode
+    static constexpr uint8_t instructionLength(AddressingMode addressing_mode) {
+        switch (addressing_mode)
+        {
+        case AddressingMode::IMPLIED:
+        case AddressingMode::ACCUMULATOR:
+            return 1;
+        case AddressingMode::IMMEDIATE:
+        case AddressingMode::ZERO_PAGE:
+        case AddressingMode::ZERO_PAGE_INDEXED_X:
+        case AddressingMode::ZERO_PAGE_INDEXED_Y:
+        case AddressingMode::PRE_INDEXED_INDIRECT:
+        case AddressingMode::POST_INDEXED_INDIRECT:
+        case AddressingMode::RELATIVE:
+            return 2;
+        case AddressingMode::ABSOLUTE:
+        case AddressingMode::INDEXED_X:
+        case AddressingMode::INDEXED_Y:
+        case AddressingMode::INDIRECT:
+            return 3;
+        }
+        return 1;
+    }
+
+    // Bus accesses made by operations. In CYCLE_STEPPED mode each one takes a
+    // cycle of its own. Reads are logged as data, see MemoryMap::setCodeDataLog()
+    inline uint8_t read(uint16_t address, uint8_t log_flags = memory::CodeDataLog::DATA) {
+        if (__builtin_expect(cycle_stepped, false)) {
+            memory_map.logAccess(address, log_flags);
+            return stepRead(address);
+        }
+        return memory_map.loggedRead(address, log_flags);
+    }
+    // read() for the instruction's own bytes, which were logged as code when
+    // it was decoded
+    inline uint8_t fetch(uint16_t address) {
+        if (__builtin_expect(cycle_stepped, false)) {
+            return stepRead(address);
+        }
+        return memory_map.read(address);
+    }
+
+    inline void write(uint16_t address, uint8_t value) {
+        if (__builtin_expect(cycle_stepped, false)) {
+            stepWrite(address, value);
+            return;
+        }
+        memory_map.write(address, value);
+    }
+
+    uint8_t stepRead(uint16_t address);
+    void stepWrite(uint16_t address, uint8_t value);
+
+    // Reads a little-endian address, e.g. an interrupt vector
+    inline uint16_t readAddress(uint16_t address) {
+        uint8_t low_byte = read(address);
+        return read(address + 1) << 8 | low_byte;
+    }
+
+    inline uint8_t readOperand(const Operand& operand) {
+        if (operand.addressing_mode == AddressingMode::ACCUMULATOR) {
+            return accumulator;
+        }
+        if (operand.addressing_mode == AddressingMode::IMMEDIATE) {
+            return fetch(operand.address);
+        }
+        if (operand.addressing_mode == AddressingMode::PRE_INDEXED_INDIRECT ||
+            operand.addressing_mode == AddressingMode::POST_INDEXED_INDIRECT) {
+            return read(operand.address, memory::CodeDataLog::DATA | memory::CodeDataLog::INDIRECT_DATA);
+        }
+        return read(operand.address);
+    }
+
+    inline void writeOperand(const Operand& operand, uint8_t value) {
+        if (operand.addressing_mode == AddressingMode::ACCUMULATOR) {
+            accumulator = value;
+            return;
+        }
+        write(operand.address, value);
+    }
+
+    // For read-modify-write operations. The 6502 writes the unmodified value
+    // back in the cycle it spends modifying it, which only CYCLE_STEPPED mode
+    // reproduces
+    inline void writeModifiedOperand(const Operand& operand, uint8_t original, uint8_t value) {
+        if (operand.addressing_mode == AddressingMode::ACCUMULATOR) {
+            accumulator = value;
+            return;
+        }
+        if (__builtin_expect(cycle_stepped, false)) {
+            stepWrite(operand.address, original);
+            stepWrite(operand.address, value);
+            return;
+        }
+        memory_map.write(operand.address, value);
+    }
+
+    /**
+     * N, Z, C and V are evaluated lazily. Operations record the values the
+     * flags come from rather than the flags themselves, and the flags are only
+     * worked out when something reads them: branches, pushes of the status
+     * register, interrupts, save states and the trace.
+     * - NEGATIVE is bit 7 of negative_result
+     * - ZERO is set when zero_result is 0
+     * - CARRY is bit 8 of carry_result
+     * - OVERFLOW is bit 7 of overflow_result
+     * processor_status holds the other flags; its bits for these four are stale.
+     */
+    inline uint8_t processorStatus() const {
+        return (processor_status & ~(flagBit(NEGATIVE) | flagBit(ZERO) | flagBit(CARRY) | flagBit(OVERFLOW))) |
+               (negative_result & 0x80) |
+               (zero_result == 0 ? flagBit(ZERO) : 0) |
+               ((carry_result >> 8) & 1) |
+               ((overflow_result & 0x80) >> 1);
+    }
+
+    inline void setProcessorStatus(uint8_t status) {
+        // BREAK only exists in copies of the register pushed to the stack, and
+        // ALWAYS1 always reads as set
+        processor_status = (status & ~flagBit(BREAK)) | flagBit(ALWAYS1);
+        negative_result = status;
+        zero_result = ~status & flagBit(ZERO);
+        carry_result = (status & flagBit(CARRY)) << 8;
+        overflow_result = status << 1;
+    }
+
     inline void setProcessorStatus(pFlag flag, bool value){
-        processor_status.set(flag, value);
+        switch (flag) {
+        case NEGATIVE:
+            negative_result = value ? 0x80 : 0;
+            break;
+        case ZERO:
+            zero_result = !value;
+            break;
+        case CARRY:
+            carry_result = value << 8;
+            break;
+        case OVERFLOW:
+            overflow_result = value ? 0x80 : 0;
+            break;
+        default:
+            processor_status = (processor_status & ~flagBit(flag)) | (value ? flagBit(flag) : 0);
+        }
     }
 
     inline uint8_t getProcessorStatus(pFlag pflag){
-        return processor_status.test(static_cast<std::size_t>(pflag));
+        switch (pflag) {
+        case NEGATIVE:
+            return negative_result >> 7;
+        case ZERO:
+            return zero_result == 0;
+        case CARRY:
+            return (carry_result >> 8) & 1;
+        case OVERFLOW:
+            return overflow_result >> 7;
+        default:
+            return (processor_status >> pflag) & 1;
+        }
     }
 
+    static constexpr uint8_t flagBit(pFlag flag) {
+        return 1 << flag;
+    }
+
+    // The stack pointer holds the address of the next free byte, always
+    // within the stack page
     inline void pushToStack(uint8_t value){
-        memory_map.write(value, --stack_pointer);
+        write(stack_pointer, value);
+        stack_pointer = STACK_END | static_cast<uint8_t>(stack_pointer - 1);
     }
 
     inline uint8_t pullFromStack(){
-        return *memory_map.read(stack_pointer++);
+        stack_pointer = STACK_END | static_cast<uint8_t>(stack_pointer + 1);
+        return read(stack_pointer);
+    }
+
+    inline void pushAddressToStack(uint16_t address){
+        pushToStack(address >> 8);
+        pushToStack(static_cast<uint8_t>(address));
+    }
+
+    inline uint16_t pullAddressFromStack(){
+        uint8_t low_byte = pullFromStack();
+        return pullFromStack() << 8 | low_byte;
+    }
+
+    // Takes a branch to operand if condition holds, which costs a cycle, or two
+    // if the target is in another page
+    inline void branch(const Operand& operand, bool condition){
+        if (condition) {
+            if (__builtin_expect(cycle_stepped, false)) {
+                // The CPU reads the next opcode while adding the offset, and
+                // again before fixing up the high byte of the target
+                stepRead(program_counter);
+                if (operand.crossed_page_boundary) {
+                    stepRead((program_counter & 0xFF00) | (operand.address & 0xFF));
+                }
+            }
+            else {
+                cycle_count += 1 + operand.crossed_page_boundary;
+            }
+            program_counter = operand.address;
+        }
+    }
+
+    // Compare register with the operand, setting the flags as for a subtraction
+    inline void compare(uint8_t register_value, const Operand& operand){
+        uint8_t value = readOperand(operand);
+        // Carry is set when there's no borrow, i.e. register_value >= value
+        carry_result = register_value + 0x100 - value;
+        negative_result = zero_result = register_value - value;
     }
 
     // Operations
     // TODO figure out a nice way to remove these from CPU class
+    static void ILLEGAL(CPU& cpu_, Operand&);
     static void BRK(CPU& cpu_, Operand&);
     static void ORA(CPU& cpu_, Operand& operand);
     static void ASL(CPU& cpu_, Operand& operand);
@@ -90,67 +584,126 @@ private:
     static void LSR(CPU& cpu_, Operand& operand);
     static void ADC(CPU& cpu_, Operand& operand);
     static void ROR(CPU& cpu_, Operand& operand);
-    static void BPL(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CLC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void JSL(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BMI(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void SEC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void RTI(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void JMP(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BVC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CLI(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void RTS(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void PLA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BVS(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void SET(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void STA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void STY(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void STX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void DEY(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void TXA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void SDA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void SDX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BCC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void TYA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void TXS(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void LDY(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void LDA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void LDX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void TAY(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BCS(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CLV(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void TAX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void TSX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CPY(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CMP(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void DEC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void INY(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void PLP(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void PHA(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void DEX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BNE(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CLD(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void CPX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void SBC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void INC(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void INX(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void NOP(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void BEQ(CPU& /*cpu_*/, Operand& /*operand*/){}
-    static void SED(CPU& /*cpu_*/, Operand& /*operand*/){}
+    static void BPL(CPU& cpu_, Operand& operand);
+    static void CLC(CPU& cpu_, Operand&);
+    static void JSR(CPU& cpu_, Operand& operand);
+    static void BMI(CPU& cpu_, Operand& operand);
+    static void SEC(CPU& cpu_, Operand&);
+    static void RTI(CPU& cpu_, Operand&);
+    static void JMP(CPU& cpu_, Operand& operand);
+    static void BVC(CPU& cpu_, Operand& operand);
+    static void CLI(CPU& cpu_, Operand&);
+    static void RTS(CPU& cpu_, Operand&);
+    static void PLA(CPU& cpu_, Operand&);
+    static void BVS(CPU& cpu_, Operand& operand);
+    static void SEI(CPU& cpu_, Operand&);
+    static void STA(CPU& cpu_, Operand& operand);
+    static void STY(CPU& cpu_, Operand& operand);
+    static void STX(CPU& cpu_, Operand& operand);
+    static void DEY(CPU& cpu_, Operand&);
+    static void TXA(CPU& cpu_, Operand&);
+    static void BCC(CPU& cpu_, Operand& operand);
+    static void TYA(CPU& cpu_, Operand&);
+    static void TXS(CPU& cpu_, Operand&);
+    static void LDY(CPU& cpu_, Operand& operand);
+    static void LDA(CPU& cpu_, Operand& operand);
+    static void LDX(CPU& cpu_, Operand& operand);
+    static void TAY(CPU& cpu_, Operand&);
+    static void BCS(CPU& cpu_, Operand& operand);
+    static void CLV(CPU& cpu_, Operand&);
+    static void TAX(CPU& cpu_, Operand&);
+    static void TSX(CPU& cpu_, Operand&);
+    static void CPY(CPU& cpu_, Operand& operand);
+    static void CMP(CPU& cpu_, Operand& operand);
+    static void DEC(CPU& cpu_, Operand& operand);
+    static void INY(CPU& cpu_, Operand&);
+    static void PLP(CPU& cpu_, Operand&);
+    static void PHA(CPU& cpu_, Operand&);
+    static void DEX(CPU& cpu_, Operand&);
+    static void BNE(CPU& cpu_, Operand& operand);
+    static void CLD(CPU& cpu_, Operand&);
+    static void CPX(CPU& cpu_, Operand& operand);
+    static void SBC(CPU& cpu_, Operand& operand);
+    static void INC(CPU& cpu_, Operand& operand);
+    static void INX(CPU& cpu_, Operand&);
+    static void NOP(CPU&, Operand&);
+    static void BEQ(CPU& cpu_, Operand& operand);
+    static void SED(CPU& cpu_, Operand&);
 
-    typedef uint8_t Opcode;
+    typedef std::array<OperationTuple, 256> OpcodeTable;
 
-    const static std::map<Opcode, OperationTuple> opcodes_to_operations;
-    memory::MemoryMap memory_map;
+    static constexpr OpcodeTable buildOpcodeTable();
+    const static OpcodeTable opcodes_to_operations;
+    typedef std::array<Executor, 256> ExecutorTable;
+    static constexpr ExecutorTable buildExecutorTable();
+    // Specialised handlers indexed by opcode, see exec()
+    const static ExecutorTable executors;
+    typedef std::array<SteppedExecutor, 256> SteppedExecutorTable;
+    static constexpr SteppedExecutorTable buildSteppedExecutorTable();
+    // As executors, for CYCLE_STEPPED mode, see step()
+    const static SteppedExecutorTable stepped_executors;
+
+    // run() between events: executes instructions until the cycle count
+    // reaches target or the next event, whichever is first
+    void runUntil(uint64_t target);
+    // processNextOpcode() for CYCLE_STEPPED mode, returns the opcode run
+    uint8_t stepInstruction();
+    // Called after an instruction while an interrupt input is active, takes
+    // the interrupt if the instruction saw it. opcode is the instruction's,
+    // status_before the status register it started with
+    void pollInterrupts(uint8_t opcode, uint8_t status_before);
+    // Pushes the program counter and status, then jumps through the NMI or
+    // IRQ vector. The 6502 does this in place of fetching the next opcode
+    void serviceInterrupt();
+    inline void updateSlowPath() {
+        slow_path = cycle_stepped || nmi_pending || (irq_line && !(processor_status & flagBit(INTERRUPT))) || stall_cycles ||
+                    (PROFILER && profiler);
+    }
+    memory::MemoryMap& memory_map;
     // 8-bit register
-    Register8 X;
-    Register8 Y;
-    Register8 accumulator;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t accumulator;
     // Made up of flags defined in pFlag, access with member functions
-    Register8 processor_status;
+    uint8_t processor_status;
+    // Sources of the lazily evaluated flags, see processorStatus()
+    uint8_t negative_result;
+    uint8_t zero_result;
+    uint16_t carry_result;
+    uint8_t overflow_result;
     // 16-bit register
     uint16_t stack_pointer;
     uint16_t program_counter;
 
+    uint64_t cycle_count;
+    uint64_t instruction_count;
+    TraceWriter* trace_writer;
+    ExecutionMode execution_mode;
+    // Set in CYCLE_STEPPED mode
+    bool cycle_stepped;
+    // Set while an instruction takes more than runDecodedInstruction(): in
+    // CYCLE_STEPPED mode, while profiling, while an NMI or an unmasked IRQ could be taken or
+    // while a stall is due. Instructions that clear the INTERRUPT flag (CLI,
+    // PLP and RTI) update it, and RTI polls for interrupts itself, since the
+    // 6502 can take an IRQ straight after it
+    bool slow_path;
+    BusMonitor* bus_monitor;
+    Profiler* profiler;
+
+    // Interrupt inputs, with the cycle each request was made in
+    bool nmi_pending;
+    bool irq_line;
+    uint64_t nmi_requested_at;
+    uint64_t irq_asserted_at;
+    // Cycles to spend halted before the next instruction, see stall()
+    uint64_t stall_cycles;
+    EventScheduler event_scheduler;
+    std::unique_ptr<Jit> jit;
+
+    std::array<std::unique_ptr<DecodedPage>, PAGE_COUNT> decoded_pages;
+    // Holds instructions that can't be cached, e.g. run from I/O space
+    DecodedInstruction uncached_instruction;
+    DecodeCacheStats decode_cache_stats;
+
 };
 } // namespace cpu
\ No newline at end of file
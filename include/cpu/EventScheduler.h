@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace cpu {
+// Things a device needs the CPU to stop for. Each is scheduled at most once at
+// a time
+enum class Event : uint8_t {
+    // Start of vblank, where the PPU may raise an NMI
+    VBLANK_NMI,
+    // The PPU has finished a frame
+    FRAME_END,
+    // The APU frame counter's IRQ
+    FRAME_IRQ,
+    // The DMC's next sample fetch, which stalls the CPU and may raise an IRQ
+    DMC_DMA,
+    COUNT
+};
+
+struct EventHandler {
+    virtual ~EventHandler() = default;
+    // Called once the CPU has reached cycle, the event's time, or a little
+    // past it. Handlers catch up to the CPU and must schedule any further
+    // events strictly after the cycle they caught up to
+    virtual void handleEvent(Event event, uint64_t cycle) = 0;
+};
+
+/**
+* Timeline of device events, kept by the CPU. Devices run lazily, catching up
+* only when the CPU touches their registers, so they schedule an event for
+* each point where they have to act on the CPU without being asked (raise an
+* interrupt, take the bus). CPU::run() executes instructions without checking
+* anything until the earliest event is due, fires it and carries on.
+*
+* Events are a min-heap on cycle. Rescheduling or cancelling leaves the old
+* entry in the heap, and it is skipped when it comes to the top, which is
+* cheaper than searching for it: devices reschedule on most register accesses.
+**/
+class EventScheduler {
+public:
+    static constexpr uint64_t never = UINT64_MAX;
+
+    EventScheduler();
+    EventScheduler(const EventScheduler&) = delete;
+    EventScheduler& operator=(const EventScheduler&) = delete;
+
+    // handler must outlive the scheduler, or be replaced first
+    void setHandler(Event event, EventHandler* handler);
+
+    // Schedules event for cycle, replacing any time it was scheduled for
+    void schedule(Event event, uint64_t cycle);
+    void cancel(Event event);
+
+    // Cycle of the earliest event, or never. May be earlier than any event
+    // still scheduled if the earliest was cancelled, which only costs an early
+    // stop
+    inline uint64_t nextCycle() const {
+        return next_cycle;
+    }
+    // For generated code that checks nextCycle() itself
+    inline const uint64_t* nextCycleAddress() const {
+        return &next_cycle;
+    }
+    // Fires every event due by cycle, in order
+    void runDue(uint64_t cycle);
+
+private:
+    struct Entry {
+        uint64_t cycle;
+        Event event;
+        // Orders the heap earliest first
+        inline bool operator<(const Entry& other) const {
+            return cycle > other.cycle;
+        }
+    };
+    static constexpr std::size_t event_count = static_cast<std::size_t>(Event::COUNT);
+
+    // Drops the entries left behind by rescheduling
+    void compact();
+    inline void updateNextCycle() {
+        next_cycle = heap.empty() ? never : heap.front().cycle;
+    }
+
+    std::vector<Entry> heap;
+    // Cycle of the heap's top entry, see nextCycle()
+    uint64_t next_cycle;
+    // When each event is due, or never
+    std::array<uint64_t, event_count> due;
+    std::array<EventHandler*, event_count> handlers;
+};
+} // namespace cpu
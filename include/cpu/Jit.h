@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "CPU.h"
+
+namespace cpu {
+/**
+* Basic-block recompiler for the CPU (x86-64 only).
+* A block is a straight run of instructions starting in one page and ending
+* with the first one that can change the program counter (branches, JMP, JSR,
+* RTS and BRK) or unmask interrupts (CLI and PLP). It is translated into native
+* code that calls the same handlers the interpreter does. Operands that are
+* fixed at compile time are resolved then, so what is left per instruction is
+* a store of the program counter and a direct call. Cycles are added up at the
+* exits of the block, and before any instruction whose operand is only known
+* at run time: that one may reach I/O, and devices catching up to the CPU need
+* the cycle count as the interpreter would have it.
+*
+* The interpreter runs anything the translation doesn't cover: code outside
+* host memory, instructions that address I/O directly, RTI (which polls for
+* interrupts) and illegal opcodes (handlers called from generated code must
+* not throw). Blocks exit early after any write to a page holding cached code
+* or to a mapper that changes the mapping, and the CPU then drops the affected
+* blocks before running anything else. They also exit after an instruction
+* whose operand was only known at run time if it left the CPU on its slow path
+* (an interrupt raised, a stall due) or moved the next event, polling for
+* interrupts on the way out as the interpreter would have.
+**/
+class Jit {
+public:
+    // Returns nullptr if the host can't run generated code
+    static std::unique_ptr<Jit> create(CPU& cpu);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // Runs the block at the program counter, compiling it first if needed.
+    // Returns false, having run nothing, if there is no block there, the
+    // interpreter would stop at cycle_target before the block's last
+    // instruction or the JIT has been disabled
+    bool runBlock(uint64_t cycle_target);
+
+    // Drops blocks from the given state pages, see MemoryMap::takeCodeWrites()
+    void invalidate(uint64_t written_state_pages);
+
+    inline uint64_t blocksCompiled() const {
+        return blocks_compiled;
+    }
+
+private:
+    typedef void (*BlockCode)(CPU*);
+    enum class BlockState : uint8_t {
+        UNCOMPILED,
+        COMPILED,
+        // Starts with something only the interpreter can run
+        INTERPRET
+    };
+    struct Block {
+        BlockCode code;
+        // Most cycles the block can take before its last instruction starts
+        uint32_t cycles_before_last;
+        BlockState state;
+    };
+    typedef std::array<Block, PAGE_SIZE> BlockPage;
+
+    // Blocks never hold more instructions than this
+    static constexpr unsigned max_block_instructions = 64;
+    // No instruction takes more than 7 cycles plus one for a page crossing
+    static constexpr uint64_t max_block_cycles = max_block_instructions * 8;
+    static constexpr std::size_t code_buffer_size = 16 << 20;
+
+    Jit(CPU& cpu, uint8_t* code_buffer);
+
+    Block& compile(uint16_t start);
+    void flush();
+
+    // Called from generated code to resolve operands that depend on registers
+    // or memory, returns the Operand's bytes
+    static uint32_t resolveOperand(CPU* cpu, uint32_t operand_bytes, uint32_t addressing_mode);
+    // Called from generated code after an instruction that may have reached
+    // I/O, takes an interrupt a device raised in time for its poll
+    static void pollInterrupts(CPU* cpu, uint32_t opcode);
+
+    CPU& cpu;
+    std::array<std::unique_ptr<BlockPage>, PAGE_COUNT> pages;
+    // Generated code, mapped executable except while compiling
+    uint8_t* code_buffer;
+    std::size_t code_used;
+    uint64_t blocks_compiled;
+    // Set if the code buffer's protection couldn't be changed, leaving
+    // everything to the interpreter
+    bool disabled;
+};
+} // namespace cpu
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "CPU.h"
+
+namespace cpu {
+/**
+ * The official 6502 instruction set: opcode, operation, mnemonic, addressing
+ * mode, cycles and whether crossing a page boundary adds a cycle. Both the
+ * opcode table in Opcodes.cpp and the specialised handlers in Operations.cpp
+ * are generated from this list, so it's the one place to change an opcode.
+ */
+constexpr CPU::OpcodeList CPU::describeOpcodes() {
+    return {{
+        {0x00, {CPU::BRK, "BRK", AddressingMode::IMPLIED, 7, false}},
+        {0x01, {CPU::ORA, "ORA", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0x05, {CPU::ORA, "ORA", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x06, {CPU::ASL, "ASL", AddressingMode::ZERO_PAGE, 5, false}},
+        {0x08, {CPU::PHP, "PHP", AddressingMode::IMPLIED, 3, false}},
+        {0x09, {CPU::ORA, "ORA", AddressingMode::IMMEDIATE, 2, false}},
+        {0x0a, {CPU::ASL, "ASL", AddressingMode::ACCUMULATOR, 2, false}},
+        {0x0d, {CPU::ORA, "ORA", AddressingMode::ABSOLUTE, 4, false}},
+        {0x0e, {CPU::ASL, "ASL", AddressingMode::ABSOLUTE, 6, false}},
+        // Branches add a cycle when taken and another if that crosses a page
+        {0x10, {CPU::BPL, "BPL", AddressingMode::RELATIVE, 2, false}},
+        {0x11, {CPU::ORA, "ORA", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0x15, {CPU::ORA, "ORA", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0x16, {CPU::ASL, "ASL", AddressingMode::ZERO_PAGE_INDEXED_X, 6, false}},
+        {0x18, {CPU::CLC, "CLC", AddressingMode::IMPLIED, 2, false}},
+        {0x19, {CPU::ORA, "ORA", AddressingMode::INDEXED_Y, 4, true}}, // Indexed with Y
+        {0x1d, {CPU::ORA, "ORA", AddressingMode::INDEXED_X, 4, true}}, // Indexed with X
+        {0x1e, {CPU::ASL, "ASL", AddressingMode::INDEXED_X, 7, false}},
+        {0x20, {CPU::JSR, "JSR", AddressingMode::ABSOLUTE, 6, false}},
+        {0x21, {CPU::AND, "AND", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0x24, {CPU::BIT, "BIT", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x25, {CPU::AND, "AND", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x26, {CPU::ROL, "ROL", AddressingMode::ZERO_PAGE, 5, false}},
+        {0x28, {CPU::PLP, "PLP", AddressingMode::IMPLIED, 4, false}},
+        {0x29, {CPU::AND, "AND", AddressingMode::IMMEDIATE, 2, false}},
+        {0x2a, {CPU::ROL, "ROL", AddressingMode::ACCUMULATOR, 2, false}},
+        {0x2c, {CPU::BIT, "BIT", AddressingMode::ABSOLUTE, 4, false}},
+        {0x2d, {CPU::AND, "AND", AddressingMode::ABSOLUTE, 4, false}},
+        {0x2e, {CPU::ROL, "ROL", AddressingMode::ABSOLUTE, 6, false}},
+        {0x30, {CPU::BMI, "BMI", AddressingMode::RELATIVE, 2, false}},
+        {0x31, {CPU::AND, "AND", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0x35, {CPU::AND, "AND", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0x36, {CPU::ROL, "ROL", AddressingMode::ZERO_PAGE_INDEXED_X, 6, false}},
+        {0x38, {CPU::SEC, "SEC", AddressingMode::IMPLIED, 2, false}},
+        {0x39, {CPU::AND, "AND", AddressingMode::INDEXED_Y, 4, true}}, // Indexed with Y
+        {0x3d, {CPU::AND, "AND", AddressingMode::INDEXED_X, 4, true}}, // Indexed with X
+        {0x3e, {CPU::ROL, "ROL", AddressingMode::INDEXED_X, 7, false}},
+        {0x40, {CPU::RTI, "RTI", AddressingMode::IMPLIED, 6, false}},
+        {0x41, {CPU::EOR, "EOR", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0x45, {CPU::EOR, "EOR", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x46, {CPU::LSR, "LSR", AddressingMode::ZERO_PAGE, 5, false}},
+        {0x48, {CPU::PHA, "PHA", AddressingMode::IMPLIED, 3, false}},
+        {0x49, {CPU::EOR, "EOR", AddressingMode::IMMEDIATE, 2, false}},
+        {0x4a, {CPU::LSR, "LSR", AddressingMode::ACCUMULATOR, 2, false}},
+        {0x4c, {CPU::JMP, "JMP", AddressingMode::ABSOLUTE, 3, false}},
+        {0x4d, {CPU::EOR, "EOR", AddressingMode::ABSOLUTE, 4, false}},
+        {0x4e, {CPU::LSR, "LSR", AddressingMode::ABSOLUTE, 6, false}},
+        {0x50, {CPU::BVC, "BVC", AddressingMode::RELATIVE, 2, false}},
+        {0x51, {CPU::EOR, "EOR", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0x55, {CPU::EOR, "EOR", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0x56, {CPU::LSR, "LSR", AddressingMode::ZERO_PAGE_INDEXED_X, 6, false}},
+        {0x58, {CPU::CLI, "CLI", AddressingMode::IMPLIED, 2, false}},
+        {0x59, {CPU::EOR, "EOR", AddressingMode::INDEXED_Y, 4, true}}, // Indexed with Y
+        {0x5d, {CPU::EOR, "EOR", AddressingMode::INDEXED_X, 4, true}}, // Indexed with X
+        {0x5e, {CPU::LSR, "LSR", AddressingMode::INDEXED_X, 7, false}},
+        {0x60, {CPU::RTS, "RTS", AddressingMode::IMPLIED, 6, false}},
+        {0x61, {CPU::ADC, "ADC", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0x65, {CPU::ADC, "ADC", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x66, {CPU::ROR, "ROR", AddressingMode::ZERO_PAGE, 5, false}},
+        {0x68, {CPU::PLA, "PLA", AddressingMode::IMPLIED, 4, false}},
+        {0x69, {CPU::ADC, "ADC", AddressingMode::IMMEDIATE, 2, false}},
+        {0x6a, {CPU::ROR, "ROR", AddressingMode::ACCUMULATOR, 2, false}},
+        {0x6c, {CPU::JMP, "JMP", AddressingMode::INDIRECT, 5, false}},
+        {0x6d, {CPU::ADC, "ADC", AddressingMode::ABSOLUTE, 4, false}},
+        {0x6e, {CPU::ROR, "ROR", AddressingMode::ABSOLUTE, 6, false}},
+        {0x70, {CPU::BVS, "BVS", AddressingMode::RELATIVE, 2, false}},
+        {0x71, {CPU::ADC, "ADC", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0x75, {CPU::ADC, "ADC", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0x76, {CPU::ROR, "ROR", AddressingMode::ZERO_PAGE_INDEXED_X, 6, false}},
+        {0x78, {CPU::SEI, "SEI", AddressingMode::IMPLIED, 2, false}},
+        {0x79, {CPU::ADC, "ADC", AddressingMode::INDEXED_Y, 4, true}}, // Indexed with Y
+        {0x7d, {CPU::ADC, "ADC", AddressingMode::INDEXED_X, 4, true}}, // Indexed with X
+        {0x7e, {CPU::ROR, "ROR", AddressingMode::INDEXED_X, 7, false}},
+        {0x81, {CPU::STA, "STA", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0x84, {CPU::STY, "STY", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x85, {CPU::STA, "STA", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x86, {CPU::STX, "STX", AddressingMode::ZERO_PAGE, 3, false}},
+        {0x88, {CPU::DEY, "DEY", AddressingMode::IMPLIED, 2, false}},
+        {0x8a, {CPU::TXA, "TXA", AddressingMode::IMPLIED, 2, false}},
+        {0x8c, {CPU::STY, "STY", AddressingMode::ABSOLUTE, 4, false}},
+        {0x8d, {CPU::STA, "STA", AddressingMode::ABSOLUTE, 4, false}},
+        {0x8e, {CPU::STX, "STX", AddressingMode::ABSOLUTE, 4, false}},
+        {0x90, {CPU::BCC, "BCC", AddressingMode::RELATIVE, 2, false}},
+        {0x91, {CPU::STA, "STA", AddressingMode::POST_INDEXED_INDIRECT, 6, false}},
+        {0x94, {CPU::STY, "STY", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0x95, {CPU::STA, "STA", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0x96, {CPU::STX, "STX", AddressingMode::ZERO_PAGE_INDEXED_Y, 4, false}},
+        {0x98, {CPU::TYA, "TYA", AddressingMode::IMPLIED, 2, false}},
+        {0x99, {CPU::STA, "STA", AddressingMode::INDEXED_Y, 5, false}},
+        {0x9a, {CPU::TXS, "TXS", AddressingMode::IMPLIED, 2, false}},
+        {0x9d, {CPU::STA, "STA", AddressingMode::INDEXED_X, 5, false}},
+        {0xa0, {CPU::LDY, "LDY", AddressingMode::IMMEDIATE, 2, false}},
+        {0xa1, {CPU::LDA, "LDA", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0xa2, {CPU::LDX, "LDX", AddressingMode::IMMEDIATE, 2, false}},
+        {0xa4, {CPU::LDY, "LDY", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xa5, {CPU::LDA, "LDA", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xa6, {CPU::LDX, "LDX", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xa8, {CPU::TAY, "TAY", AddressingMode::IMPLIED, 2, false}},
+        {0xa9, {CPU::LDA, "LDA", AddressingMode::IMMEDIATE, 2, false}},
+        {0xaa, {CPU::TAX, "TAX", AddressingMode::IMPLIED, 2, false}},
+        {0xac, {CPU::LDY, "LDY", AddressingMode::ABSOLUTE, 4, false}},
+        {0xad, {CPU::LDA, "LDA", AddressingMode::ABSOLUTE, 4, false}},
+        {0xae, {CPU::LDX, "LDX", AddressingMode::ABSOLUTE, 4, false}},
+        {0xb0, {CPU::BCS, "BCS", AddressingMode::RELATIVE, 2, false}},
+        {0xb1, {CPU::LDA, "LDA", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0xb4, {CPU::LDY, "LDY", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0xb5, {CPU::LDA, "LDA", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0xb6, {CPU::LDX, "LDX", AddressingMode::ZERO_PAGE_INDEXED_Y, 4, false}},
+        {0xb8, {CPU::CLV, "CLV", AddressingMode::IMPLIED, 2, false}},
+        {0xb9, {CPU::LDA, "LDA", AddressingMode::INDEXED_Y, 4, true}},
+        {0xba, {CPU::TSX, "TSX", AddressingMode::IMPLIED, 2, false}},
+        {0xbc, {CPU::LDY, "LDY", AddressingMode::INDEXED_X, 4, true}},
+        {0xbd, {CPU::LDA, "LDA", AddressingMode::INDEXED_X, 4, true}},
+        {0xbe, {CPU::LDX, "LDX", AddressingMode::INDEXED_Y, 4, true}},
+        {0xc0, {CPU::CPY, "CPY", AddressingMode::IMMEDIATE, 2, false}},
+        {0xc1, {CPU::CMP, "CMP", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0xc4, {CPU::CPY, "CPY", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xc5, {CPU::CMP, "CMP", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xc6, {CPU::DEC, "DEC", AddressingMode::ZERO_PAGE, 5, false}},
+        {0xc8, {CPU::INY, "INY", AddressingMode::IMPLIED, 2, false}},
+        {0xc9, {CPU::CMP, "CMP", AddressingMode::IMMEDIATE, 2, false}},
+        {0xca, {CPU::DEX, "DEX", AddressingMode::IMPLIED, 2, false}},
+        {0xcc, {CPU::CPY, "CPY", AddressingMode::ABSOLUTE, 4, false}},
+        {0xcd, {CPU::CMP, "CMP", AddressingMode::ABSOLUTE, 4, false}},
+        {0xce, {CPU::DEC, "DEC", AddressingMode::ABSOLUTE, 6, false}},
+        {0xd0, {CPU::BNE, "BNE", AddressingMode::RELATIVE, 2, false}},
+        {0xd1, {CPU::CMP, "CMP", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0xd5, {CPU::CMP, "CMP", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0xd6, {CPU::DEC, "DEC", AddressingMode::ZERO_PAGE_INDEXED_X, 6, false}},
+        {0xd8, {CPU::CLD, "CLD", AddressingMode::IMPLIED, 2, false}},
+        {0xd9, {CPU::CMP, "CMP", AddressingMode::INDEXED_Y, 4, true}},
+        {0xdd, {CPU::CMP, "CMP", AddressingMode::INDEXED_X, 4, true}},
+        {0xde, {CPU::DEC, "DEC", AddressingMode::INDEXED_X, 7, false}},
+        {0xe0, {CPU::CPX, "CPX", AddressingMode::IMMEDIATE, 2, false}},
+        {0xe1, {CPU::SBC, "SBC", AddressingMode::PRE_INDEXED_INDIRECT, 6, false}},
+        {0xe4, {CPU::CPX, "CPX", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xe5, {CPU::SBC, "SBC", AddressingMode::ZERO_PAGE, 3, false}},
+        {0xe6, {CPU::INC, "INC", AddressingMode::ZERO_PAGE, 5, false}},
+        {0xe8, {CPU::INX, "INX", AddressingMode::IMPLIED, 2, false}},
+        {0xe9, {CPU::SBC, "SBC", AddressingMode::IMMEDIATE, 2, false}},
+        {0xea, {CPU::NOP, "NOP", AddressingMode::IMPLIED, 2, false}},
+        {0xec, {CPU::CPX, "CPX", AddressingMode::ABSOLUTE, 4, false}},
+        {0xed, {CPU::SBC, "SBC", AddressingMode::ABSOLUTE, 4, false}},
+        {0xee, {CPU::INC, "INC", AddressingMode::ABSOLUTE, 6, false}},
+        {0xf0, {CPU::BEQ, "BEQ", AddressingMode::RELATIVE, 2, false}},
+        {0xf1, {CPU::SBC, "SBC", AddressingMode::POST_INDEXED_INDIRECT, 5, true}},
+        {0xf5, {CPU::SBC, "SBC", AddressingMode::ZERO_PAGE_INDEXED_X, 4, false}},
+        {0xf6, {CPU::INC, "INC", AddressingMode::ZERO_PAGE_INDEXED_X, 6, false}},
+        {0xf8, {CPU::SED, "SED", AddressingMode::IMPLIED, 2, false}},
+        {0xf9, {CPU::SBC, "SBC", AddressingMode::INDEXED_Y, 4, true}},
+        {0xfd, {CPU::SBC, "SBC", AddressingMode::INDEXED_X, 4, true}},
+        {0xfe, {CPU::INC, "INC", AddressingMode::INDEXED_X, 7, false}},
+    }};
+}
+} // namespace cpu
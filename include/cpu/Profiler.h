@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiles the CPU's profiling hooks in. Set with the PROFILER CMake option;
+// without it CPU::setProfiler() does nothing and the hooks cost nothing
+#ifndef PROFILER
+#define PROFILER 0
+#endif
+
+namespace cpu {
+/**
+* Where emulated programs, and the emulator running them, spend their time.
+* While attached to the CPU (which then runs every instruction through the
+* interpreter) it collects, per sampled instruction:
+*
+* - the count, cycles and host nanoseconds taken by each opcode's handler;
+* - a histogram of the program counter over the whole 64KiB;
+* - the emulated call stack, for flame graphs.
+*
+* Sampling every Nth instruction keeps the cost of the clock reads down on
+* long runs; counts are then of samples, scale by sampleInterval() for totals.
+* The call stack is tracked on every instruction regardless. Calls are JSR,
+* BRK and interrupts; a frame ends when the stack pointer rises above where it
+* was just after the call, which also copes with code that drops return
+* addresses or resets the stack.
+**/
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+    static constexpr bool compiled_in = PROFILER;
+
+    explicit Profiler(unsigned sample_interval = 1);
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    inline unsigned sampleInterval() const {
+        return sample_interval;
+    }
+
+    // Called by the CPU. True if the instruction about to run is sampled
+    inline bool sampleNext() {
+        if (--countdown) {
+            return false;
+        }
+        countdown = sample_interval;
+        return true;
+    }
+    void recordSample(uint8_t opcode, uint16_t program_counter, uint8_t cycles, Clock::duration host_time);
+    // After every instruction, with the registers it left
+    inline void trackCalls(uint8_t opcode, uint16_t program_counter, uint8_t stack_pointer) {
+        if (opcode == jsr_opcode || opcode == brk_opcode) {
+            enterCall(program_counter, stack_pointer);
+        } else {
+            while (!frames.empty() && stack_pointer > frames.back().stack_pointer) {
+                frames.pop_back();
+            }
+        }
+    }
+    // Also called for interrupts, once the CPU has pushed the return address
+    // and jumped to the handler
+    void enterCall(uint16_t target, uint8_t stack_pointer);
+
+    // Host time a device spent outside the CPU, e.g. audio synthesis, to
+    // report alongside the opcodes. frames is how many batches it covers
+    void setDeviceTime(const std::string& device, uint64_t host_ns, uint64_t frames);
+
+    // Opcode and address statistics. Throws std::runtime_error if path can't
+    // be written
+    void writeJSON(const std::string& path) const;
+    // One line per call stack, "main;$C000;$C123 cycles", as taken by
+    // flamegraph.pl and speedscope. Throws std::runtime_error
+    void writeFoldedStacks(const std::string& path) const;
+
+private:
+    static constexpr uint8_t jsr_opcode = 0x20;
+    static constexpr uint8_t brk_opcode = 0x00;
+    // Calls nested deeper than this are counted against the deepest frame
+    static constexpr std::size_t max_depth = 256;
+
+    struct OpcodeStats {
+        uint64_t count;
+        uint64_t cycles;
+        uint64_t host_ns;
+    };
+    // A distinct call stack, as a node in the tree of them
+    struct CallNode {
+        uint32_t parent;
+        uint16_t entry;
+        uint64_t cycles;
+    };
+    struct Frame {
+        uint32_t node;
+        // Low byte of the stack pointer just after the call
+        uint8_t stack_pointer;
+    };
+    struct DeviceTime {
+        std::string device;
+        uint64_t host_ns;
+        uint64_t frames;
+    };
+
+    inline uint32_t currentNode() const {
+        return frames.empty() ? 0 : frames.back().node;
+    }
+    void writeStack(FILE* file, uint32_t node) const;
+
+    unsigned sample_interval;
+    unsigned countdown;
+    // Smallest time between two clock reads, taken off every sample
+    Clock::duration timer_overhead;
+
+    std::array<OpcodeStats, 256> opcodes;
+    std::vector<uint64_t> address_counts;
+    uint64_t samples;
+
+    // Node 0 is the root, code outside any call seen
+    std::vector<CallNode> call_nodes;
+    // (parent << 16 | entry) to child node
+    std::unordered_map<uint64_t, uint32_t> call_children;
+    std::vector<Frame> frames;
+
+    std::vector<DeviceTime> device_times;
+};
+} // namespace cpu
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "Console.h"
+
+namespace cpu {
+/**
+* Class to manage CPU timing.
+* The console runs freely for a budget of CPU cycles (one NTSC frame by default),
+* counting the cycles each instruction takes. Once the budget is spent, the scheduler sleeps
+* until the absolute wall-clock deadline at which a real 6502 would have finished
+* the same number of cycles. Deadlines are computed from the total cycle count, so
+* rounding errors don't build up from batch to batch.
+*
+* In max speed mode the scheduler never sleeps, which is what headless runs want.
+**/
+class Scheduler {
+public:
+    // Cycles in one NTSC frame
+    static constexpr uint32_t ntsc_cycles_per_frame = 29780;
+    // NTSC 2A03 clock speed
+    static constexpr double cpu_clock_hz = 1789773.0;
+
+    Scheduler(console::Console& console, uint32_t cycles_per_batch = ntsc_cycles_per_frame);
+
+    // Runs one batch of cycles, then waits until that batch is due to finish.
+    // Returns the number of cycles run, which may overshoot the budget by the
+    // length of the last instruction; the overshoot is taken off the next batch.
+    uint64_t runBatch();
+
+    void setMaxSpeed(bool max_speed);
+
+    inline uint64_t totalCycles() const {
+        return total_cycles;
+    }
+
+    inline uint64_t totalInstructions() const {
+        return total_instructions;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void waitForDeadline();
+
+    console::Console& console;
+    uint32_t cycles_per_batch;
+    bool max_speed;
+    uint64_t total_cycles;
+    uint64_t total_instructions;
+    // Cycle count at which the current batch ends
+    uint64_t batch_end;
+    // Wall-clock time and cycle count that deadlines are measured from
+    Clock::time_point epoch;
+    uint64_t epoch_cycles;
+};
+} // namespace cpu
@@ -1,8 +0,0 @@
-#pragma once
-
-#include <thread>
-#include <condition_variable>
-#include <mutex>
-
-static std::condition_variable thread_waker;
-static std::mutex mtx;
\ No newline at end of file
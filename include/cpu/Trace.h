@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+namespace cpu {
+/**
+ * One executed instruction, captured just before it runs. Records are fixed
+ * size so a trace file is a header followed by a flat array of them.
+ */
+struct TraceRecord {
+    // Cycles executed before this instruction
+    uint64_t cycle;
+    uint16_t program_counter;
+    uint8_t opcode;
+    uint8_t operand[2];
+    // Number of valid bytes in opcode + operand
+    uint8_t length;
+    uint8_t accumulator;
+    uint8_t x;
+    uint8_t y;
+    uint8_t processor_status;
+    uint8_t stack_pointer;
+    uint8_t reserved[5];
+};
+static_assert(sizeof(TraceRecord) == 24, "trace records are written to disk as-is");
+
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+constexpr char trace_magic[8] = {'N', 'E', 'S', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t trace_version = 1;
+
+/**
+ * Writes trace records to a file from a background thread.
+ * The CPU pushes records into a single-producer, single-consumer ring; the
+ * writer thread hands whole contiguous runs of the ring to fwrite. Unlike the
+ * logger, a full ring makes the CPU wait rather than drop records, since a
+ * trace with holes in it can't be diffed.
+ */
+class TraceWriter {
+public:
+    // Throws std::runtime_error if path can't be opened
+    TraceWriter(const std::string& path);
+    ~TraceWriter();
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    inline void push(const TraceRecord& record) {
+        while (head - tail.load(std::memory_order_acquire) == ring_size) {
+            std::this_thread::yield();
+        }
+        ring[head & (ring_size - 1)] = record;
+        ++head;
+        published_head.store(head, std::memory_order_release);
+    }
+
+private:
+    // Must be a power of two
+    static constexpr std::size_t ring_size = 1 << 16;
+
+    void run();
+
+    std::array<TraceRecord, ring_size> ring;
+    // Only touched by the CPU thread
+    std::size_t head;
+    alignas(64) std::atomic<std::size_t> published_head;
+    alignas(64) std::atomic<std::size_t> tail;
+    std::atomic<bool> running;
+    FILE* file;
+    std::thread writer;
+};
+} // namespace cpu
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "Cartridge.h"
+#include "CPU.h"
+#include "Memory.h"
+#include "SaveState.h"
+#include "ScanlineKernels.h"
+
+namespace ppu {
+/**
+* The 2C02 picture processing unit, seen by the CPU as eight registers repeated
+* through $2000-$3FFF. It has its own bus: pattern tables (CHR) at $0000-$1FFF,
+* four nametables at $2000-$2FFF backed by 2KiB of console RAM (4KiB for four
+* screen boards) and 32 bytes of palette RAM at $3F00. Sprites live in the 256
+* bytes of OAM, usually filled by OAM DMA through $4014.
+*
+* The PPU draws 3 dots per CPU cycle, 341 to a scanline and 262 scanlines to a
+* frame, but doesn't run alongside the CPU. It catches up when a register is
+* accessed, catchUp() is called or one of its CPU events fires (the start of
+* vblank and the end of each frame), drawing each visible scanline in one go at
+* the dot its pixels end on (256). Register writes therefore take effect at
+* scanline granularity, which is what scroll splits need. Frames are kept as
+* colour indices into the 2C02's 64 colour palette, see rgb().
+*
+* Not emulated: CHR bank switching (only the first 8KiB of CHR-ROM is seen),
+* the sprite overflow flag's evaluation bug, colour emphasis and the exact
+* dot-level timing of $2002 around the start of vblank.
+**/
+class PPU : public memory::IOHandler, public cpu::EventHandler {
+public:
+    static constexpr unsigned screen_width = 256;
+    static constexpr unsigned screen_height = 240;
+    static constexpr unsigned dots_per_scanline = 341;
+    static constexpr unsigned scanlines_per_frame = 262;
+    static constexpr unsigned dots_per_cpu_cycle = 3;
+    static constexpr unsigned vblank_scanline = 241;
+    static constexpr unsigned prerender_scanline = 261;
+
+    PPU(cpu::CPU& cpu, memory::MemoryMap& memory_map);
+    PPU(const PPU&) = delete;
+    PPU& operator=(const PPU&) = delete;
+
+    // Maps the registers into $2000-$3FFF
+    void mapInto(memory::MemoryMap& memory_map);
+    // Takes the pattern tables and nametable mirroring from cartridge, which
+    // must outlive its use here
+    void loadCartridge(const cartridge::Cartridge& cartridge);
+
+    uint8_t read(uint16_t address) override;
+    void write(uint16_t address, uint8_t value) override;
+
+    // Copies CPU page $XX00-$XXFF to OAM, as a write of XX to $4014 does, and
+    // halts the CPU for the 513 or 514 cycles the transfer takes
+    void oamDMA(uint8_t page);
+
+    // Runs the PPU up to the start of the given CPU cycle. Cycles already
+    // passed are ignored
+    void catchUp(uint64_t cpu_cycle);
+    void handleEvent(cpu::Event event, uint64_t cycle) override;
+
+    // screen_width * screen_height colour indices, row by row. Rows are
+    // redrawn as the PPU passes them, so this is only a whole frame between
+    // the end of line 239 and the start of the next frame
+    inline const uint8_t* frameBuffer() const {
+        return frame_buffer.data();
+    }
+    // Frames completed since power on
+    inline uint64_t frameCount() const {
+        return frame_count;
+    }
+    // 0xRRGGBB for one of the 64 colours
+    static uint32_t rgb(uint8_t colour);
+
+    // Picks the scanline kernels, e.g. to compare them. Defaults to the best
+    // the host supports
+    inline void setKernels(ScanlineKernels::InstructionSet instruction_set) {
+        kernels = &ScanlineKernels::get(instruction_set);
+    }
+
+    void saveState(savestate::StateWriter& writer) const;
+    // States without a PPU chunk leave the PPU as it is
+    void loadState(savestate::StateReader& reader);
+
+private:
+    // What happens at next_event_dot
+    enum class Event : uint8_t {
+        // Dot 256 of a visible scanline
+        DRAW_SCANLINE,
+        VBLANK_START,
+        // Dot 1 of the pre-render scanline
+        VBLANK_END,
+        // Dot 280 of the pre-render scanline, where the scroll is reloaded
+        RELOAD_SCROLL,
+        FRAME_END
+    };
+
+    void runEvent();
+    void scheduleEvent(Event next, unsigned line, unsigned dot);
+    // Schedules the CPU events for the next vblank and frame end
+    void scheduleCPUEvents();
+    // Rounded up to a CPU cycle, so that catching up to it passes the dot
+    static inline uint64_t cpuCycle(uint64_t dot) {
+        return (dot + dots_per_cpu_cycle - 1) / dots_per_cpu_cycle;
+    }
+    void drawScanline(unsigned line);
+    // Fetches and decodes the 33 tiles under the scanline into tiles
+    void fetchBackground(uint8_t* tiles);
+    // Decodes the first eight sprites on the scanline into sprites, indexed by x
+    void evaluateSprites(unsigned line, uint8_t* sprites);
+
+    inline bool renderingEnabled() const {
+        return mask & (show_background | show_sprites);
+    }
+
+    // Accesses to the PPU's own bus, through $2007
+    uint8_t busRead(uint16_t address) const;
+    void busWrite(uint16_t address, uint8_t value);
+
+    // Register bits used here
+    static constexpr uint8_t nmi_enable = 0x80;
+    static constexpr uint8_t tall_sprites = 0x20;
+    static constexpr uint8_t background_table = 0x10;
+    static constexpr uint8_t sprite_table = 0x08;
+    static constexpr uint8_t increment_32 = 0x04;
+    static constexpr uint8_t show_sprites = 0x10;
+    static constexpr uint8_t show_background = 0x08;
+    static constexpr uint8_t show_left_sprites = 0x04;
+    static constexpr uint8_t show_left_background = 0x02;
+    static constexpr uint8_t greyscale = 0x01;
+    static constexpr uint8_t vblank_flag = 0x80;
+    static constexpr uint8_t sprite0_hit_flag = 0x40;
+    static constexpr uint8_t sprite_overflow_flag = 0x20;
+
+    cpu::CPU& cpu;
+    memory::MemoryMap& memory_map;
+    const ScanlineKernels* kernels;
+
+    // $2000, $2001, $2002 and $2003
+    uint8_t control;
+    uint8_t mask;
+    uint8_t status;
+    uint8_t oam_address;
+    // Last value written to any register, returned by reads of write-only ones
+    uint8_t io_latch;
+    // $2007 reads below the palette return the previous read's value
+    uint8_t read_buffer;
+    // Scroll and VRAM address registers as the hardware keeps them: v is the
+    // current address, t the one loaded at the start of each scanline and
+    // frame (both yyy NN YYYYY XXXXX), fine_x the pixel within the tile and
+    // second_write the $2005/$2006 write toggle
+    uint16_t v;
+    uint16_t t;
+    uint8_t fine_x;
+    bool second_write;
+
+    // Timing, in dots since power on (CPU cycle * dots_per_cpu_cycle)
+    uint64_t frame_start;
+    uint64_t next_event_dot;
+    Event next_event;
+    unsigned scanline;
+    bool odd_frame;
+    uint64_t frame_count;
+
+    std::array<uint8_t, 0x1000> nametable_ram;
+    // Where each of the four nametables is in nametable_ram
+    std::array<uint8_t*, 4> nametables;
+    // Stored with the sprite backdrop entries ($3F10/14/18/1C) mirrored into
+    // the background ones, so lookups need no special cases
+    std::array<uint8_t, 32> palette;
+    std::array<uint8_t, 256> oam;
+    // Pattern tables: CHR-ROM, or chr_ram if the cartridge has none or has
+    // less than 8KiB, which is copied there
+    const uint8_t* chr;
+    std::array<uint8_t, 0x2000> chr_ram;
+    bool chr_writable;
+
+    std::array<uint8_t, screen_width * screen_height> frame_buffer;
+};
+} // namespace ppu
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ppu {
+/**
+* The per-pixel work of drawing a scanline, with one implementation per
+* instruction set. Pixels are kept as 5-bit palette RAM indices until the last
+* step: bits 0-1 are the pattern value (0 is transparent), bits 2-3 the palette
+* and bit 4 set for sprite palettes. Sprite pixels also carry bit 5 when the
+* sprite is behind the background and bit 6 for sprite 0.
+*
+* Nothing here loops over the bits of a pattern byte: each kernel expands the
+* two bitplanes of several tiles at once, using a byte-spreading table in the
+* scalar version and compares against per-pixel bit masks in the SIMD ones.
+**/
+struct ScanlineKernels {
+    enum class InstructionSet {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    // Decodes count tiles into 8 pixels each, tile i from the bitplanes
+    // low[i] and high[i] with attributes[i] ORed into its opaque pixels.
+    // Kernels work on up to 4 tiles at once, so the inputs are read and out is
+    // written up to count rounded up to a multiple of 4 tiles
+    void (*decode_tiles)(const uint8_t* low, const uint8_t* high, const uint8_t* attributes,
+                         unsigned count, uint8_t* out);
+
+    // Merges 256 background and sprite pixels by sprite priority and writes
+    // each one's colour from palette (32 entries) to out. Returns the first x
+    // at which sprite 0 overlaps the background, or -1
+    int (*compose)(const uint8_t* background, const uint8_t* sprites, const uint8_t* palette, uint8_t* out);
+
+    InstructionSet instruction_set;
+
+    // The kernels for instruction_set, falling back to the best one the host
+    // supports if it doesn't
+    static const ScanlineKernels& get(InstructionSet instruction_set);
+    // The fastest kernels the host supports
+    static const ScanlineKernels& best();
+};
+} // namespace ppu
@@ -0,0 +1,183 @@
+#include "BatchRunner.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include "Console.h"
+#include "Json.h"
+#include "Manifest.h"
+#include "Scheduler.h"
+
+namespace batch {
+namespace {
+std::vector<uint8_t> parseHexBytes(const std::string& hex) {
+    if (hex.empty() || hex.size() % 2 != 0) {
+        throw std::runtime_error("expected an even number of hex digits in " + hex);
+    }
+    std::vector<uint8_t> bytes;
+    for (std::size_t i = 0; i < hex.size(); i += 2) {
+        bytes.push_back(std::stoul(hex.substr(i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+bool signaturesMatch(memory::MemoryMap& memory_map, const BatchEntry& entry) {
+    for (const auto& [address, bytes] : entry.signatures) {
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            if (memory_map.read(address + i) != bytes[i]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+const char* statusName(BatchStatus status) {
+    switch (status) {
+    case BatchStatus::PASS:
+        return "pass";
+    case BatchStatus::FAIL:
+        return "fail";
+    case BatchStatus::ERROR:
+        return "error";
+    }
+    return "unknown";
+}
+} // namespace
+
+std::vector<BatchEntry> parseManifest(const std::string& path) {
+    std::vector<BatchEntry> entries;
+    readManifest(path, [&entries](const std::string& rom_path, std::istream& fields) {
+        std::string limit;
+        if (!(fields >> limit)) {
+            throw std::runtime_error("missing limit");
+        }
+        BatchEntry entry;
+        entry.rom_path = rom_path;
+        if (limit.rfind("cycles=", 0) == 0) {
+            entry.cycle_limit = std::stoull(limit.substr(7));
+        } else if (limit.rfind("frames=", 0) == 0) {
+            entry.cycle_limit = std::stoull(limit.substr(7)) * cpu::Scheduler::ntsc_cycles_per_frame;
+        } else {
+            throw std::runtime_error("limit must be cycles=N or frames=N");
+        }
+
+        std::string signature;
+        while (fields >> signature) {
+            auto equals = signature.find('=');
+            if (equals == std::string::npos) {
+                throw std::runtime_error("signature must be ADDRESS=BYTES");
+            }
+            entry.signatures.emplace_back(std::stoul(signature.substr(0, equals), nullptr, 16),
+                parseHexBytes(signature.substr(equals + 1)));
+        }
+        entries.push_back(std::move(entry));
+    });
+    return entries;
+}
+
+BatchResult runEntry(const BatchEntry& entry, cpu::CPU::ExecutionMode mode, bool log_code_data) {
+    BatchResult result{BatchStatus::FAIL, 0, 0, 0, 0, "", nullptr};
+    auto start = std::chrono::steady_clock::now();
+
+    auto console = loadConsole(entry.rom_path, result.error);
+    if (!console) {
+        result.status = BatchStatus::ERROR;
+        return result;
+    }
+
+    console->processor.setExecutionMode(mode);
+    if (log_code_data) {
+        result.code_data_log = std::make_shared<memory::CodeDataLog>(console->cartridge->prgROM(),
+            console->cartridge->chrROM().size());
+        console->memory_map.setCodeDataLog(result.code_data_log.get());
+    }
+    cpu::Scheduler scheduler(*console);
+    scheduler.setMaxSpeed(true);
+    // Signatures are checked once a frame, which is how often test ROMs get
+    // to update them anyway
+    while (scheduler.totalCycles() < entry.cycle_limit) {
+        try {
+            scheduler.runBatch();
+        } catch (opcodeException&) {
+            result.illegal_opcodes++;
+        }
+        if (signaturesMatch(console->memory_map, entry)) {
+            result.status = BatchStatus::PASS;
+            break;
+        }
+    }
+
+    // The log outlives the console
+    console->memory_map.setCodeDataLog(nullptr);
+    result.cycles = scheduler.totalCycles();
+    result.instructions = scheduler.totalInstructions();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::vector<BatchResult> runAll(const std::vector<BatchEntry>& entries, unsigned jobs, cpu::CPU::ExecutionMode mode,
+    bool log_code_data) {
+    return runInManifestOrder(entries, jobs, [mode, log_code_data](const BatchEntry& entry) {
+        return runEntry(entry, mode, log_code_data);
+    });
+}
+
+void writeCodeDataLogs(const std::vector<BatchEntry>& entries, const std::vector<BatchResult>& results,
+    const std::string& directory) {
+    // Entries can run the same ROM more than once
+    std::map<std::string, std::shared_ptr<memory::CodeDataLog>> logs;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        if (!results[i].code_data_log) {
+            continue;
+        }
+        auto [log, inserted] = logs.try_emplace(entries[i].rom_path, results[i].code_data_log);
+        if (!inserted) {
+            log->second->merge(*results[i].code_data_log);
+        }
+    }
+    for (const auto& [rom_path, log] : logs) {
+        std::filesystem::path path = std::filesystem::path(directory) /
+            std::filesystem::path(rom_path).filename().replace_extension(".cdl");
+        if (std::filesystem::exists(path)) {
+            log->mergeFile(path);
+        }
+        log->writeFile(path);
+    }
+}
+
+void writeReport(FILE* out, const std::vector<BatchEntry>& entries,
+    const std::vector<BatchResult>& results, unsigned jobs, double seconds) {
+    std::size_t passed = 0, failed = 0, errors = 0;
+    uint64_t total_cycles = 0;
+    for (const auto& result : results) {
+        passed += result.status == BatchStatus::PASS;
+        failed += result.status == BatchStatus::FAIL;
+        errors += result.status == BatchStatus::ERROR;
+        total_cycles += result.cycles;
+    }
+
+    fprintf(out, "{\n  \"results\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const BatchResult& result = results[i];
+        fprintf(out, "    {\"rom\": \"%s\", \"status\": \"%s\", \"cycles\": %lu, "
+            "\"instructions\": %lu, \"illegal_opcodes\": %lu, \"seconds\": %.6f",
+            json::escape(entries[i].rom_path).c_str(), statusName(result.status),
+            static_cast<unsigned long>(result.cycles),
+            static_cast<unsigned long>(result.instructions),
+            static_cast<unsigned long>(result.illegal_opcodes), result.seconds);
+        if (!result.error.empty()) {
+            fprintf(out, ", \"error\": \"%s\"", json::escape(result.error).c_str());
+        }
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n"
+        "  \"summary\": {\"roms\": %zu, \"passed\": %zu, \"failed\": %zu, \"errors\": %zu, "
+        "\"jobs\": %u, \"seconds\": %.6f, \"emulated_mhz\": %.3f}\n}\n",
+        results.size(), passed, failed, errors, jobs, seconds, total_cycles / seconds / 1e6);
+}
+} // batch::
@@ -0,0 +1,151 @@
+#include "Cartridge.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Expections.h"
+
+namespace cartridge {
+namespace {
+// Decodes a NES 2.0 ROM size from its LSB byte and 4-bit MSB nibble. An MSB
+// nibble of 0xF means the LSB holds an exponent and multiplier instead.
+// Exponent sizes too big for size_t come back as SIZE_MAX, which no file holds.
+std::size_t nes2ROMSize(uint8_t lsb, uint8_t msb, std::size_t bank_size) {
+    if (msb == 0xF) {
+        std::size_t exponent = lsb >> 2;
+        // The multiplier is up to 7, so it needs 3 bits above the exponent
+        if (exponent > std::numeric_limits<std::size_t>::digits - 3) {
+            return std::numeric_limits<std::size_t>::max();
+        }
+        std::size_t multiplier = (lsb & 0x3) * 2 + 1;
+        return (std::size_t(1) << exponent) * multiplier;
+    }
+    return ((msb << 8) | lsb) * bank_size;
+}
+} // namespace
+
+Cartridge::Cartridge(const std::string& path)
+    : file_data(nullptr), file_size(0), rom_hash(0), mapper_number(0),
+      nametable_mirroring(Mirroring::HORIZONTAL), battery(false), nes2(false) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw romException(path, "can't open file");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) < 0 || file_stat.st_size < static_cast<off_t>(header_size)) {
+        close(fd);
+        throw romException(path, "file too small for an iNES header");
+    }
+    file_size = file_stat.st_size;
+    void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw romException(path, "mmap failed");
+    }
+    file_data = static_cast<const uint8_t*>(mapping);
+
+    try {
+        parseHeader(path);
+    } catch (...) {
+        munmap(const_cast<uint8_t*>(file_data), file_size);
+        throw;
+    }
+}
+
+Cartridge::~Cartridge() {
+    munmap(const_cast<uint8_t*>(file_data), file_size);
+}
+
+void Cartridge::parseHeader(const std::string& path) {
+    const uint8_t* header = file_data;
+    if (header[0] != 'N' || header[1] != 'E' || header[2] != 'S' || header[3] != 0x1A) {
+        throw romException(path, "missing iNES magic number");
+    }
+
+    uint8_t flags6 = header[6];
+    uint8_t flags7 = header[7];
+    // NES 2.0 is flagged by bits 2-3 of byte 7 being 0b10
+    nes2 = (flags7 & 0x0C) == 0x08;
+
+    if (flags6 & 0x08) {
+        nametable_mirroring = Mirroring::FOUR_SCREEN;
+    } else {
+        nametable_mirroring = (flags6 & 0x01) ? Mirroring::VERTICAL : Mirroring::HORIZONTAL;
+    }
+    battery = flags6 & 0x02;
+    mapper_number = (flags7 & 0xF0) | (flags6 >> 4);
+
+    std::size_t prg_size = header[4] * prg_bank_size;
+    std::size_t chr_size = header[5] * chr_bank_size;
+    if (nes2) {
+        mapper_number |= (header[8] & 0x0F) << 8;
+        prg_size = nes2ROMSize(header[4], header[9] & 0x0F, prg_bank_size);
+        chr_size = nes2ROMSize(header[5], header[9] >> 4, chr_bank_size);
+    }
+
+    // Each size is checked against what's left of the file before it's added,
+    // so a huge size in the header can't wrap the offset around
+    std::size_t offset = header_size;
+    if (flags6 & 0x04) {
+        if (trainer_size > file_size - offset) {
+            throw romException(path, "file too small for its trainer");
+        }
+        trainer = {file_data + offset, trainer_size};
+        offset += trainer_size;
+    }
+    if (prg_size == 0 || prg_size > file_size - offset) {
+        throw romException(path, "PRG-ROM size in header doesn't match the file");
+    }
+    if (prg_size % PAGE_SIZE != 0) {
+        throw romException(path, "PRG-ROM isn't a whole number of pages");
+    }
+    // mapInto mirrors small PRG-ROMs to fill each 16KiB half, so they have to divide it
+    if (prg_size < prg_bank_size && (prg_size & (prg_size - 1)) != 0) {
+        throw romException(path, "PRG-ROM smaller than 16KiB isn't a power of two");
+    }
+    prg_rom = {file_data + offset, prg_size};
+    offset += prg_size;
+    if (chr_size > file_size - offset) {
+        throw romException(path, "CHR-ROM size in header doesn't match the file");
+    }
+    chr_rom = {file_data + offset, chr_size};
+
+    rom_hash = 0xcbf29ce484222325;
+    for (uint8_t byte : std::span<const uint8_t>(prg_rom.data(), prg_size + chr_size)) {
+        rom_hash = (rom_hash ^ byte) * 0x100000001b3;
+    }
+}
+
+void Cartridge::mapInto(memory::MemoryMap& memory_map) const {
+    if (!trainer.empty()) {
+        for (std::size_t i = 0; i < trainer.size(); ++i) {
+            memory_map.write(0x7000 + i, trainer[i]);
+        }
+    }
+
+    // NROM: 16KiB of PRG-ROM is mirrored into both halves, 32KiB fills them.
+    // Other mappers start with their first bank at $8000 and last at $C000,
+    // which is enough to reach the reset vector
+    if (mapper_number != 0) {
+        LOG_WARNING("Mapper %d not supported, mapping first and last PRG banks only", mapper_number);
+    }
+    const std::size_t half = (MEMORY_SIZE - ROM_START) / 2;
+    const uint8_t* first_bank = prg_rom.data();
+    const uint8_t* last_bank = prg_rom.data() + prg_rom.size() - std::min(prg_rom.size(), half);
+    if (prg_rom.size() < half) {
+        // Sub-16KiB ROMs (NES 2.0 exponent sizes) repeat to fill each half
+        for (std::size_t offset = 0; offset < 2 * half; offset += prg_rom.size()) {
+            memory_map.mapReadOnly(ROM_START + offset, prg_rom.size(), first_bank);
+        }
+        return;
+    }
+    memory_map.mapReadOnly(ROM_START, half, first_bank);
+    memory_map.mapReadOnly(ROM_START + half, half, last_bank);
+}
+} // cartridge::
@@ -0,0 +1,61 @@
+#include "CodeDataLog.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace memory {
+CodeDataLog::CodeDataLog(std::span<const uint8_t> prg_rom, std::size_t chr_size)
+    : prg_rom(prg_rom), flags(prg_rom.size() + chr_size, 0) {}
+
+void CodeDataLog::merge(const CodeDataLog& other) {
+    if (other.prg_rom.size() != prg_rom.size() || other.flags.size() != flags.size()) {
+        throw std::runtime_error("code/data logs are for ROMs of different sizes");
+    }
+    for (std::size_t i = 0; i < flags.size(); ++i) {
+        flags[i] |= other.flags[i];
+    }
+}
+
+void CodeDataLog::mergeFile(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Can't open " + path);
+    }
+    std::vector<uint8_t> contents(flags.size());
+    std::size_t size = fread(contents.data(), 1, contents.size(), file);
+    // Anything after the expected size means a different ROM too
+    bool longer = fgetc(file) != EOF;
+    fclose(file);
+    if (size != contents.size() || longer) {
+        throw std::runtime_error(path + " is for a ROM of a different size");
+    }
+    for (std::size_t i = 0; i < flags.size(); ++i) {
+        flags[i] |= contents[i];
+    }
+}
+
+void CodeDataLog::writeFile(const std::string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Can't create " + path);
+    }
+    bool written = fwrite(flags.data(), 1, flags.size(), file) == flags.size();
+    written &= fclose(file) == 0;
+    if (!written) {
+        throw std::runtime_error("Can't write " + path);
+    }
+}
+
+CodeDataLog::Coverage CodeDataLog::coverage() const {
+    Coverage coverage{};
+    for (uint8_t flag : prgFlags()) {
+        coverage.code += (flag & CODE) != 0;
+        coverage.data += (flag & DATA) != 0;
+        coverage.indirect_code += (flag & INDIRECT_CODE) != 0;
+        coverage.indirect_data += (flag & INDIRECT_DATA) != 0;
+        coverage.pcm_data += (flag & PCM_DATA) != 0;
+        coverage.unused += (flag & (CODE | DATA | INDIRECT_CODE | INDIRECT_DATA | PCM_DATA)) == 0;
+    }
+    return coverage;
+}
+} // memory::
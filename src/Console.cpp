@@ -0,0 +1,107 @@
+#include "Console.h"
+
+#include <cstdio>
+
+namespace console {
+Console::Console() : processor(memory_map), ppu(processor, memory_map), apu(processor, memory_map), io_registers(*this) {
+    ppu.mapInto(memory_map);
+    memory_map.mapIO(0x4000, PAGE_SIZE, &io_registers);
+}
+
+void Console::loadROM(const std::string& path) {
+    cartridge = std::make_unique<cartridge::Cartridge>(path);
+    cartridge->mapInto(memory_map);
+    ppu.loadCartridge(*cartridge);
+    processor.reset();
+}
+
+uint64_t Console::run(uint64_t cycles) {
+    uint64_t start = processor.cycleCount();
+    // Devices catch up by themselves when they need to, see CPU::events()
+    processor.run(cycles);
+    ppu.catchUp(processor.cycleCount());
+    apu.endFrame(processor.cycleCount());
+    return processor.cycleCount() - start;
+}
+
+uint8_t Console::IORegisters::read(uint16_t address) {
+    if (address == 0x4015) {
+        return console.apu.readStatus();
+    }
+    if (address == 0x4016 || address == 0x4017) {
+        // The upper bits are left on the bus by the high byte of the address
+        return 0x40 | console.controllers[address & 1].read();
+    }
+    // Nothing else readable here yet
+    return 0;
+}
+
+void Console::IORegisters::write(uint16_t address, uint8_t value) {
+    if (address == 0x4014) {
+        console.ppu.oamDMA(value);
+    } else if (address == 0x4016) {
+        for (Controller& controller : console.controllers) {
+            controller.writeStrobe(value);
+        }
+    } else {
+        console.apu.writeRegister(address, value);
+    }
+}
+void Console::saveState(std::vector<uint8_t>& state) const {
+    savestate::StateWriter writer(state);
+    writer.beginChunk(savestate::makeTag("CART"));
+    writer.write(cartridge ? cartridge->romHash() : uint64_t(0));
+    writer.endChunk();
+    processor.saveState(writer);
+    ppu.saveState(writer);
+    apu.saveState(writer);
+    for (unsigned port = 0; port < controllers.size(); ++port) {
+        controllers[port].saveState(writer, port);
+    }
+    memory_map.saveState(writer);
+}
+
+void Console::loadState(const uint8_t* state, std::size_t size) {
+    savestate::StateReader reader(state, size);
+    reader.findChunk(savestate::makeTag("CART"));
+    if (reader.read<uint64_t>() != (cartridge ? cartridge->romHash() : 0)) {
+        throw saveStateException("state was saved with a different ROM");
+    }
+    processor.loadState(reader);
+    ppu.loadState(reader);
+    apu.loadState(reader);
+    for (unsigned port = 0; port < controllers.size(); ++port) {
+        controllers[port].loadState(reader, port);
+    }
+    memory_map.loadState(reader);
+}
+
+void Console::saveState(const std::string& path) const {
+    std::vector<uint8_t> state;
+    saveState(state);
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw saveStateException("can't open " + path);
+    }
+    bool written = fwrite(state.data(), 1, state.size(), file) == state.size();
+    fclose(file);
+    if (!written) {
+        throw saveStateException("can't write " + path);
+    }
+}
+
+void Console::loadState(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        throw saveStateException("can't open " + path);
+    }
+    std::vector<uint8_t> state;
+    uint8_t buffer[4096];
+    std::size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        state.insert(state.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    loadState(state.data(), state.size());
+}
+} // console::
@@ -0,0 +1,29 @@
+#include "Controller.h"
+
+namespace console {
+
+namespace {
+uint32_t chunkTag(unsigned port) {
+    return port == 0 ? savestate::makeTag("PAD1") : savestate::makeTag("PAD2");
+}
+} // namespace
+
+void Controller::saveState(savestate::StateWriter& writer, unsigned port) const {
+    writer.beginChunk(chunkTag(port));
+    writer.write(held);
+    writer.write(shift_register);
+    writer.write(strobe);
+    writer.endChunk();
+}
+
+void Controller::loadState(savestate::StateReader& reader, unsigned port) {
+    // States saved before controllers existed have them idle
+    if (!reader.seekChunk(chunkTag(port))) {
+        *this = Controller();
+        return;
+    }
+    held = reader.read<uint8_t>();
+    shift_register = reader.read<uint8_t>();
+    strobe = reader.read<bool>();
+}
+} // console::
@@ -0,0 +1,182 @@
+#include "Logger.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <thread>
+
+namespace logger {
+namespace {
+constexpr const char* log_path = "debug_log.txt";
+constexpr const char* level_names[] = {"DEBUG", "INFO", "WARNING", "ERROR"};
+// Must be a power of two
+constexpr std::size_t ring_size = 4096;
+constexpr std::size_t message_size = 240;
+
+/**
+ * Bounded multi-producer, single-consumer ring. Each slot carries a sequence
+ * number saying whose turn it is: producers claim a slot by bumping
+ * enqueue_position, fill it in, then publish it by advancing its sequence; the
+ * writer thread consumes slots strictly in order.
+ */
+class AsyncWriter {
+public:
+    AsyncWriter() : enqueue_position(0), dequeue_position(0), dropped(0), running(true) {
+        for (std::size_t i = 0; i < ring_size; ++i) {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        file = fopen(log_path, "a");
+        writer = std::thread(&AsyncWriter::run, this);
+    }
+
+    ~AsyncWriter() {
+        running.store(false, std::memory_order_release);
+        writer.join();
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    void push(int level, const char* format, va_list args) {
+        std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+        Record* record;
+        while (true) {
+            record = &ring[position & (ring_size - 1)];
+            std::size_t sequence = record->sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1,
+                        std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                // Writer hasn't caught up yet, don't wait for it
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        record->level = level;
+        record->time = std::chrono::system_clock::now();
+        vsnprintf(record->message, message_size, format, args);
+        record->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    void flush() {
+        std::size_t target = enqueue_position.load(std::memory_order_acquire);
+        while (flushed_position.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    uint64_t droppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Record {
+        std::atomic<std::size_t> sequence;
+        int level;
+        std::chrono::system_clock::time_point time;
+        char message[message_size];
+    };
+
+    void run() {
+        std::string batch;
+        uint64_t reported_dropped = 0;
+        while (true) {
+            // Read running before draining, so nothing pushed before shutdown is lost
+            bool stopping = !running.load(std::memory_order_acquire);
+            drain(batch);
+
+            uint64_t dropped_now = dropped.load(std::memory_order_relaxed);
+            if (dropped_now != reported_dropped) {
+                char notice[64];
+                snprintf(notice, sizeof(notice), "[%lu log messages dropped]\n",
+                    static_cast<unsigned long>(dropped_now - reported_dropped));
+                batch += notice;
+                reported_dropped = dropped_now;
+            }
+            if (!batch.empty() && file) {
+                fwrite(batch.data(), 1, batch.size(), file);
+                fflush(file);
+            }
+            flushed_position.store(dequeue_position, std::memory_order_release);
+
+            if (stopping) {
+                return;
+            }
+            if (batch.empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            batch.clear();
+        }
+    }
+
+    void drain(std::string& batch) {
+        time_t last_second = 0;
+        char timestamp[24] = "";
+        while (true) {
+            Record& record = ring[dequeue_position & (ring_size - 1)];
+            if (record.sequence.load(std::memory_order_acquire) != dequeue_position + 1) {
+                return;
+            }
+            // Formatting the time is the expensive part, so only redo it when it changes
+            time_t seconds = std::chrono::system_clock::to_time_t(record.time);
+            if (seconds != last_second) {
+                struct tm local;
+                localtime_r(&seconds, &local);
+                strftime(timestamp, sizeof(timestamp), "%F %H:%M:%S", &local);
+                last_second = seconds;
+            }
+            batch += '[';
+            batch += timestamp;
+            batch += "] ";
+            batch += level_names[record.level];
+            batch += ": ";
+            batch += record.message;
+            batch += '\n';
+
+            record.sequence.store(dequeue_position + ring_size, std::memory_order_release);
+            ++dequeue_position;
+        }
+    }
+
+    std::array<Record, ring_size> ring;
+    alignas(64) std::atomic<std::size_t> enqueue_position;
+    alignas(64) std::size_t dequeue_position;
+    std::atomic<std::size_t> flushed_position{0};
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> running;
+    FILE* file;
+    std::thread writer;
+};
+
+AsyncWriter& instance() {
+    // Started on first use and shut down, after draining, at exit
+    static AsyncWriter async_writer;
+    return async_writer;
+}
+} // namespace
+
+void write(int level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    instance().push(level, format, args);
+    va_end(args);
+}
+
+void flush() {
+    instance().flush();
+}
+
+uint64_t droppedCount() {
+    return instance().droppedCount();
+}
+} // logger::
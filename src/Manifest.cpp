@@ -0,0 +1,52 @@
+#include "Manifest.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Console.h"
+
+namespace batch {
+
+void readManifest(const std::string& path,
+    const std::function<void(const std::string& rom_path, std::istream& fields)>& parse_line) {
+    std::ifstream manifest(path);
+    if (!manifest) {
+        throw std::runtime_error("Can't open manifest " + path);
+    }
+    std::string directory;
+    auto slash = path.find_last_of('/');
+    if (slash != std::string::npos) {
+        directory = path.substr(0, slash + 1);
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(manifest, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string rom;
+        if (!(fields >> rom)) {
+            continue;
+        }
+        try {
+            parse_line(rom[0] == '/' ? rom : directory + rom, fields);
+        } catch (std::exception& e) {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) + ": " + e.what());
+        }
+    }
+}
+
+std::unique_ptr<console::Console> loadConsole(const std::string& rom_path, std::string& error) {
+    // Consoles are big, keep them off the worker's stack
+    auto console = std::make_unique<console::Console>();
+    try {
+        console->loadROM(rom_path);
+    } catch (romException& e) {
+        error = e.what();
+        return nullptr;
+    }
+    return console;
+}
+} // batch::
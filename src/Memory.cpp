@@ -1,11 +1,105 @@
 #include "Memory.h"
 
+#include <cassert>
+#include <cstring>
+
 namespace memory {
 
-std::array<uint8_t, MEMORY_SIZE> MemoryMap::memory_map;
+static_assert(STATE_PAGE_COUNT <= 64, "dirty page mask is 64 bits");
+
+MemoryMap::MemoryMap() : dirty_pages(0), code_pages(0), code_written(0), code_data_log(nullptr) {
+    ram.fill(0);
+    prg_ram.fill(0);
+    pending_dirty_pages.fill(0);
+    mapIO(0, MEMORY_SIZE, &open_bus);
+    // Internal RAM repeats every RAM_SIZE bytes up to RAM_MIRROR_END
+    for (uint16_t mirror = 0; mirror < RAM_MIRROR_END; mirror += RAM_SIZE) {
+        mapReadWrite(mirror, RAM_SIZE, ram.data());
+    }
+    mapReadWrite(PRG_RAM_START, PRG_RAM_SIZE, prg_ram.data());
+}
+
+void MemoryMap::saveState(savestate::StateWriter& writer) const {
+    writer.beginChunk(savestate::makeTag("RAM "));
+    writer.writeBytes(ram.data(), ram.size());
+    writer.writeBytes(prg_ram.data(), prg_ram.size());
+    writer.endChunk();
+}
 
-MemoryMap::MemoryMap() {
-    memory_map.fill(0);
+void MemoryMap::loadState(savestate::StateReader& reader) {
+    reader.findChunk(savestate::makeTag("RAM "));
+    reader.readBytes(ram.data(), ram.size());
+    reader.readBytes(prg_ram.data(), prg_ram.size());
+    // Everything changed as far as incremental snapshots are concerned
+    dirty_pages = ~uint64_t(0) >> (64 - STATE_PAGE_COUNT);
+    code_written = ~uint64_t(0);
+}
+
+const uint8_t* MemoryMap::statePage(unsigned index) const {
+    const unsigned ram_pages = RAM_SIZE / PAGE_SIZE;
+    if (index < ram_pages) {
+        return ram.data() + index * PAGE_SIZE;
+    }
+    return prg_ram.data() + (index - ram_pages) * PAGE_SIZE;
+}
+
+void MemoryMap::restoreStatePage(unsigned index, const uint8_t* data) {
+    memcpy(const_cast<uint8_t*>(statePage(index)), data, PAGE_SIZE);
+    dirty_pages |= uint64_t(1) << index;
+    code_written |= (uint64_t(1) << index) & code_pages;
+}
+
+uint64_t MemoryMap::dirtyBitFor(const uint8_t* host) const {
+    if (host >= ram.data() && host < ram.data() + ram.size()) {
+        return uint64_t(1) << ((host - ram.data()) / PAGE_SIZE);
+    }
+    if (host >= prg_ram.data() && host < prg_ram.data() + prg_ram.size()) {
+        return uint64_t(1) << (RAM_SIZE / PAGE_SIZE + (host - prg_ram.data()) / PAGE_SIZE);
+    }
+    return 0;
+}
+
+uint8_t* MemoryMap::logFor(const uint8_t* host) const {
+    if (!code_data_log) {
+        return nullptr;
+    }
+    std::span<const uint8_t> prg_rom = code_data_log->prgROM();
+    if (host < prg_rom.data() || host >= prg_rom.data() + prg_rom.size()) {
+        return nullptr;
+    }
+    return code_data_log->prgFlags() + (host - prg_rom.data());
+}
+
+void MemoryMap::setCodeDataLog(CodeDataLog* log) {
+    code_data_log = log;
+    code_written = ~uint64_t(0);
+    for (Page& page : pages) {
+        page.log = page.write ? nullptr : logFor(page.read);
+    }
+}
+
+void MemoryMap::mapReadOnly(uint16_t start, std::size_t size, const uint8_t* host, IOHandler* write_handler) {
+    assert(start % PAGE_SIZE == 0 && start + size <= MEMORY_SIZE);
+    code_written = ~uint64_t(0);
+    for (std::size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        pages[(start + offset) >> 8] = {host + offset, nullptr, write_handler, 0, logFor(host + offset)};
+    }
+}
+
+void MemoryMap::mapReadWrite(uint16_t start, std::size_t size, uint8_t* host) {
+    assert(start % PAGE_SIZE == 0 && start + size <= MEMORY_SIZE);
+    code_written = ~uint64_t(0);
+    for (std::size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        pages[(start + offset) >> 8] = {host + offset, host + offset, nullptr, dirtyBitFor(host + offset), nullptr};
+    }
+}
+
+void MemoryMap::mapIO(uint16_t start, std::size_t size, IOHandler* handler) {
+    assert(start % PAGE_SIZE == 0 && start + size <= MEMORY_SIZE);
+    code_written = ~uint64_t(0);
+    for (std::size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        pages[(start + offset) >> 8] = {nullptr, nullptr, handler, 0, nullptr};
+    }
 }
 
 // void MemoryMap::absoluteWrite(uint16_t program_counter, uint8_t value) {
@@ -38,63 +132,57 @@ MemoryMap::MemoryMap() {
 //     write(*read(program_counter) + index, value);
 // }
 
-uint8_t* MemoryMap::absoluteRead(uint16_t program_counter) const{
-    return read(*read(program_counter + 1) << 8 | *read(program_counter));
+uint8_t MemoryMap::absoluteRead(uint16_t program_counter) {
+    return read(absoluteReadPointer(program_counter));
 }
 
-uint8_t* MemoryMap::indexedRead(uint16_t program_counter, uint8_t index) const {
-    return read(*read(program_counter + 1) << 8 | (*read(program_counter)  + index));
+uint8_t MemoryMap::indexedRead(uint16_t program_counter, uint8_t index) {
+    return read(absoluteReadPointer(program_counter) + index);
 }
 
-uint8_t* MemoryMap::immediateRead(uint16_t program_counter) const{
+uint8_t MemoryMap::immediateRead(uint16_t program_counter) {
     return read(program_counter);
 }
 
-uint8_t* MemoryMap::zeroPageIndexedRead(uint16_t program_counter, uint8_t index) const{
-    return read((*read(program_counter) + index) % UINT8_MAX);
+uint8_t MemoryMap::zeroPageIndexedRead(uint16_t program_counter, uint8_t index) {
+    // Wraps around within the zero page
+    return read(static_cast<uint8_t>(read(program_counter) + index));
 }
 
-uint8_t* MemoryMap::preIndexedIndirectRead(uint16_t program_counter, uint8_t index) const{
+uint8_t MemoryMap::preIndexedIndirectRead(uint16_t program_counter, uint8_t index) {
     uint16_t address = preIndexGetAddress(program_counter, index);
     return read(address);
 }
 
-uint8_t* MemoryMap::postIndexedIndirectRead(uint16_t program_counter, uint8_t index) const{
+uint8_t MemoryMap::postIndexedIndirectRead(uint16_t program_counter, uint8_t index) {
     uint16_t address = postIndexGetAddress(program_counter, index);
     return read(address);
 }
 
-uint8_t* MemoryMap::zeroPageRead(uint16_t program_counter) const{
-    return read(*read(program_counter));
+uint8_t MemoryMap::zeroPageRead(uint16_t program_counter) {
+    return read(read(program_counter));
 }
 
-uint16_t MemoryMap::absoluteReadPointer(uint16_t program_counter) const{
-    return *read(program_counter + 1) << 8 | *read(program_counter);
-}
-uint16_t MemoryMap::indirectReadPointer(uint16_t program_counter) const{
-    uint16_t address = 
-        *read(program_counter + 1) << 8 | *read(program_counter);
-    return *read(address + 1 ) << 8 | *read(address);
+uint16_t MemoryMap::absoluteReadPointer(uint16_t program_counter) {
+    return read(program_counter + 1) << 8 | read(program_counter);
 }
 
-uint16_t MemoryMap::preIndexGetAddress(uint16_t program_counter, uint8_t index) const {
-    uint8_t address_byte_1 = (*read(program_counter) + index) % UINT8_MAX;
-    uint8_t address_byte_2 = address_byte_1 + 1;
-    return *read(address_byte_1 << 8) | *read(address_byte_2);
+uint16_t MemoryMap::indirectReadPointer(uint16_t program_counter) {
+    uint16_t address = absoluteReadPointer(program_counter);
+    // The high byte of the target is fetched without carrying into the page
+    uint16_t address_high = (address & 0xFF00) | static_cast<uint8_t>(address + 1);
+    return read(address_high) << 8 | read(address);
 }
 
-uint16_t MemoryMap::postIndexGetAddress(uint16_t program_counter, uint8_t index) const {
-    uint8_t address_byte_1 = *read(program_counter);
+uint16_t MemoryMap::preIndexGetAddress(uint16_t program_counter, uint8_t index) {
+    uint8_t address_byte_1 = read(program_counter) + index;
     uint8_t address_byte_2 = address_byte_1 + 1;
-    return (*read(address_byte_1 << 8) | *read(address_byte_2)) + index;
+    return read(address_byte_2) << 8 | read(address_byte_1);
 }
 
-void MemoryMap::write(uint16_t address, uint8_t value){
-    memory_map[address] = value;
-}
-
-// TODO: Maybe read and read_ptr methods?
-uint8_t* MemoryMap::read(uint16_t address) const {
-    return &memory_map[address];
+uint16_t MemoryMap::postIndexGetAddress(uint16_t program_counter, uint8_t index) {
+    uint8_t address_byte_1 = read(program_counter);
+    uint8_t address_byte_2 = address_byte_1 + 1;
+    return (read(address_byte_2) << 8 | read(address_byte_1)) + index;
 }
-} //memory::
\ No newline at end of file
+} //memory::
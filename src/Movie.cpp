@@ -0,0 +1,239 @@
+#include "Movie.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace console {
+
+namespace {
+constexpr char movie_magic[8] = {'N', 'E', 'S', 'M', 'O', 'V', 'I', 'E'};
+constexpr uint32_t movie_version = 1;
+// FM2 order, from bit 7 down to bit 0 of Controller::Button
+constexpr char button_letters[] = "RLDUTSBA";
+
+class MovieFile {
+public:
+    MovieFile(const std::string& path, const char* mode) : path(path), file(fopen(path.c_str(), mode)) {
+        if (!file) {
+            throw std::runtime_error("Can't open " + path);
+        }
+    }
+    ~MovieFile() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    template <typename T>
+    void write(const T& value) {
+        writeBytes(&value, sizeof(T));
+    }
+    void writeBytes(const void* data, std::size_t size) {
+        if (fwrite(data, 1, size, file) != size) {
+            throw std::runtime_error("Can't write " + path);
+        }
+    }
+    template <typename T>
+    T read() {
+        T value;
+        readBytes(&value, sizeof(T));
+        return value;
+    }
+    void readBytes(void* out, std::size_t size) {
+        if (fread(out, 1, size, file) != size) {
+            throw std::runtime_error(path + " is truncated");
+        }
+    }
+    // Bytes between the read position and the end of the file
+    std::size_t remaining() {
+        long position = ftell(file);
+        long end = position < 0 || fseek(file, 0, SEEK_END) != 0 ? -1 : ftell(file);
+        if (end < 0 || fseek(file, position, SEEK_SET) != 0) {
+            throw std::runtime_error("Can't read " + path);
+        }
+        return end - position;
+    }
+    void close() {
+        bool closed = fclose(file) == 0;
+        file = nullptr;
+        if (!closed) {
+            throw std::runtime_error("Can't write " + path);
+        }
+    }
+
+private:
+    std::string path;
+    FILE* file;
+};
+
+uint8_t parseButtons(const std::string& text) {
+    if (text.size() != sizeof(button_letters) - 1) {
+        throw std::runtime_error("buttons must be 8 characters, as in RLDUTSBA");
+    }
+    uint8_t buttons = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == button_letters[i]) {
+            buttons |= 0x80 >> i;
+        }
+    }
+    return buttons;
+}
+} // namespace
+
+Movie::Movie(uint64_t rom_hash, std::vector<uint8_t> start_state)
+    : rom_hash(rom_hash), start_state(std::move(start_state)) {}
+
+Movie::Movie(const std::string& path) {
+    MovieFile file(path, "rb");
+    char magic[sizeof(movie_magic)];
+    file.readBytes(magic, sizeof(magic));
+    if (memcmp(magic, movie_magic, sizeof(magic)) != 0) {
+        throw std::runtime_error(path + " is not a movie");
+    }
+    if (file.read<uint32_t>() != movie_version) {
+        throw std::runtime_error(path + " is a movie of an unsupported version");
+    }
+    rom_hash = file.read<uint64_t>();
+    // Sizes are checked against what is left of the file before anything is
+    // allocated for them
+    uint32_t state_size = file.read<uint32_t>();
+    if (state_size > file.remaining()) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    start_state.resize(state_size);
+    file.readBytes(start_state.data(), start_state.size());
+
+    uint32_t frame_count = file.read<uint32_t>();
+    uint32_t runs = file.read<uint32_t>();
+    const uint64_t run_size = sizeof(uint32_t) + sizeof(std::array<uint8_t, 2>);
+    const uint64_t frame_size = sizeof(uint64_t) + sizeof(uint32_t);
+    if (runs * run_size + frame_count * frame_size > file.remaining()) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    recorded.resize(frame_count);
+    std::size_t frame = 0;
+    for (; runs > 0; --runs) {
+        uint32_t length = file.read<uint32_t>();
+        std::array<uint8_t, 2> buttons = file.read<std::array<uint8_t, 2>>();
+        if (length > recorded.size() - frame) {
+            throw std::runtime_error(path + " has more input than frames");
+        }
+        for (uint32_t i = 0; i < length; ++i) {
+            recorded[frame++].buttons = buttons;
+        }
+    }
+    if (frame != recorded.size()) {
+        throw std::runtime_error(path + " has less input than frames");
+    }
+    for (Frame& recorded_frame : recorded) {
+        recorded_frame.state_hash = file.read<uint64_t>();
+        recorded_frame.instructions = file.read<uint32_t>();
+    }
+}
+
+void Movie::save(const std::string& path) const {
+    // Runs of frames with the same buttons held
+    std::vector<std::pair<uint32_t, std::array<uint8_t, 2>>> runs;
+    for (const Frame& frame : recorded) {
+        if (runs.empty() || runs.back().second != frame.buttons) {
+            runs.emplace_back(0, frame.buttons);
+        }
+        ++runs.back().first;
+    }
+
+    MovieFile file(path, "wb");
+    file.writeBytes(movie_magic, sizeof(movie_magic));
+    file.write(movie_version);
+    file.write(rom_hash);
+    file.write(static_cast<uint32_t>(start_state.size()));
+    file.writeBytes(start_state.data(), start_state.size());
+    file.write(static_cast<uint32_t>(recorded.size()));
+    file.write(static_cast<uint32_t>(runs.size()));
+    for (const auto& [length, buttons] : runs) {
+        file.write(length);
+        file.write(buttons);
+    }
+    for (const Frame& frame : recorded) {
+        file.write(frame.state_hash);
+        file.write(frame.instructions);
+    }
+    file.close();
+}
+
+std::vector<InputChange> parseInputScript(const std::string& path) {
+    std::ifstream script(path);
+    if (!script) {
+        throw std::runtime_error("Can't open input script " + path);
+    }
+    std::vector<InputChange> changes;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(script, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string frame, port1, port2;
+        if (!(fields >> frame)) {
+            continue;
+        }
+        try {
+            if (!(fields >> port1)) {
+                throw std::runtime_error("missing buttons");
+            }
+            InputChange change{std::stoull(frame), {parseButtons(port1), 0}};
+            if (fields >> port2) {
+                change.buttons[1] = parseButtons(port2);
+            }
+            if (!changes.empty() && change.frame < changes.back().frame) {
+                throw std::runtime_error("frames out of order");
+            }
+            changes.push_back(change);
+        } catch (std::exception& e) {
+            throw std::runtime_error(path + ":" + std::to_string(line_number) + ": " + e.what());
+        }
+    }
+    return changes;
+}
+
+MovieRunner::MovieRunner(Console& console)
+    : console(console), scheduler(console), state_hash(console), illegal_opcodes(0) {
+    scheduler.setMaxSpeed(true);
+}
+
+Movie::Frame MovieRunner::runFrame(std::array<uint8_t, 2> buttons) {
+    for (std::size_t port = 0; port < buttons.size(); ++port) {
+        console.controllers[port].setButtons(buttons[port]);
+    }
+    uint64_t start_instructions = scheduler.totalInstructions();
+    // A batch cut short by an exception carries on from there next time
+    for (;;) {
+        try {
+            scheduler.runBatch();
+            break;
+        } catch (opcodeException&) {
+            illegal_opcodes++;
+        }
+    }
+    return {buttons, state_hash.update(), static_cast<uint32_t>(scheduler.totalInstructions() - start_instructions)};
+}
+
+std::optional<MovieRunner::Divergence> MovieRunner::replay(const Movie& movie) {
+    console.loadState(movie.startState().data(), movie.startState().size());
+    std::vector<uint8_t> start_state;
+    uint64_t instructions_before = 0;
+    for (std::size_t frame = 0; frame < movie.frames().size(); ++frame) {
+        const Movie::Frame& expected = movie.frames()[frame];
+        console.saveState(start_state);
+        Movie::Frame actual = runFrame(expected.buttons);
+        if (actual.state_hash != expected.state_hash) {
+            return Divergence{frame, instructions_before, expected, actual,
+                console.processor.registers().program_counter, std::move(start_state)};
+        }
+        instructions_before += actual.instructions;
+    }
+    return std::nullopt;
+}
+} // console::
@@ -0,0 +1,150 @@
+#include "Regression.h"
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+#include "Console.h"
+#include "Json.h"
+#include "Manifest.h"
+#include "Movie.h"
+
+namespace batch {
+namespace {
+uint64_t parseHash(const std::string& hex) {
+    std::size_t used = 0;
+    uint64_t hash = std::stoull(hex, &used, 16);
+    if (hex.size() != 16 || used != hex.size()) {
+        throw std::runtime_error("expected 16 hex digits in " + hex);
+    }
+    return hash;
+}
+
+const char* statusName(RegressionStatus status) {
+    switch (status) {
+    case RegressionStatus::PASS:
+        return "pass";
+    case RegressionStatus::FAIL:
+        return "fail";
+    case RegressionStatus::NEW:
+        return "new";
+    case RegressionStatus::ERROR:
+        return "error";
+    }
+    return "unknown";
+}
+} // namespace
+
+std::vector<RegressionEntry> parseRegressionManifest(const std::string& path) {
+    std::vector<RegressionEntry> entries;
+    readManifest(path, [&entries](const std::string& rom_path, std::istream& fields) {
+        std::string frames;
+        if (!(fields >> frames) || frames.rfind("frames=", 0) != 0) {
+            throw std::runtime_error("missing frames=N");
+        }
+        RegressionEntry entry;
+        entry.rom_path = rom_path;
+        entry.frames = std::stoull(frames.substr(7));
+        if (entry.frames == 0) {
+            throw std::runtime_error("frames must be at least 1");
+        }
+
+        std::string hash;
+        while (fields >> hash) {
+            if (hash.rfind("state=", 0) == 0) {
+                entry.state_hash = parseHash(hash.substr(6));
+            } else if (hash.rfind("frame=", 0) == 0) {
+                entry.frame_hash = parseHash(hash.substr(6));
+            } else {
+                throw std::runtime_error("hashes must be state=HASH or frame=HASH");
+            }
+        }
+        entries.push_back(std::move(entry));
+    });
+    return entries;
+}
+
+RegressionResult runRegression(const RegressionEntry& entry, cpu::CPU::ExecutionMode mode,
+    const std::string& state_directory) {
+    RegressionResult result{RegressionStatus::NEW, 0, 0, 0, 0, 0, "", ""};
+    auto start = std::chrono::steady_clock::now();
+
+    auto console = loadConsole(entry.rom_path, result.error);
+    if (!console) {
+        result.status = RegressionStatus::ERROR;
+        return result;
+    }
+    console->processor.setExecutionMode(mode);
+
+    console::MovieRunner runner(*console);
+    for (uint64_t frame = 0; frame < entry.frames; ++frame) {
+        console::Movie::Frame ran = runner.runFrame({0, 0});
+        result.state_hash = ran.state_hash;
+        result.instructions += ran.instructions;
+    }
+    result.frame_hash = runner.frameHash();
+    result.illegal_opcodes = runner.illegalOpcodes();
+
+    if (entry.state_hash || entry.frame_hash) {
+        bool matched = (!entry.state_hash || *entry.state_hash == result.state_hash) &&
+            (!entry.frame_hash || *entry.frame_hash == result.frame_hash);
+        result.status = matched ? RegressionStatus::PASS : RegressionStatus::FAIL;
+    }
+    if (result.status == RegressionStatus::FAIL) {
+        std::filesystem::path path = std::filesystem::path(state_directory) /
+            (std::filesystem::path(entry.rom_path).stem().string() + "." + std::to_string(entry.frames) + ".state");
+        try {
+            console->saveState(path.string());
+            result.state_path = path.string();
+        } catch (saveStateException& e) {
+            result.error = e.what();
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::vector<RegressionResult> runRegressions(const std::vector<RegressionEntry>& entries, unsigned jobs,
+    cpu::CPU::ExecutionMode mode, const std::string& state_directory) {
+    return runInManifestOrder(entries, jobs, [mode, &state_directory](const RegressionEntry& entry) {
+        return runRegression(entry, mode, state_directory);
+    });
+}
+
+void writeRegressionReport(FILE* out, const std::vector<RegressionEntry>& entries,
+    const std::vector<RegressionResult>& results, unsigned jobs, double seconds) {
+    std::size_t passed = 0, failed = 0, unchecked = 0, errors = 0;
+    for (const auto& result : results) {
+        passed += result.status == RegressionStatus::PASS;
+        failed += result.status == RegressionStatus::FAIL;
+        unchecked += result.status == RegressionStatus::NEW;
+        errors += result.status == RegressionStatus::ERROR;
+    }
+
+    fprintf(out, "{\n  \"results\": [\n");
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const RegressionResult& result = results[i];
+        fprintf(out, "    {\"rom\": \"%s\", \"frames\": %lu, \"status\": \"%s\"",
+            json::escape(entries[i].rom_path).c_str(), static_cast<unsigned long>(entries[i].frames), statusName(result.status));
+        if (result.status != RegressionStatus::ERROR) {
+            fprintf(out, ", \"state\": \"%016lx\", \"frame\": \"%016lx\", \"instructions\": %lu, "
+                "\"illegal_opcodes\": %lu, \"seconds\": %.6f",
+                static_cast<unsigned long>(result.state_hash), static_cast<unsigned long>(result.frame_hash),
+                static_cast<unsigned long>(result.instructions),
+                static_cast<unsigned long>(result.illegal_opcodes), result.seconds);
+        }
+        if (!result.state_path.empty()) {
+            fprintf(out, ", \"state_path\": \"%s\"", json::escape(result.state_path).c_str());
+        }
+        if (!result.error.empty()) {
+            fprintf(out, ", \"error\": \"%s\"", json::escape(result.error).c_str());
+        }
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n"
+        "  \"summary\": {\"roms\": %zu, \"passed\": %zu, \"failed\": %zu, \"new\": %zu, \"errors\": %zu, "
+        "\"jobs\": %u, \"seconds\": %.6f}\n}\n",
+        results.size(), passed, failed, unchecked, errors, jobs, seconds);
+}
+} // batch::
@@ -0,0 +1,109 @@
+#include "Rewind.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace console {
+
+RewindBuffer::RewindBuffer(Console& console, std::size_t capacity_frames, unsigned keyframe_interval)
+    : console(console), capacity_frames(std::max<std::size_t>(capacity_frames, 1)),
+      keyframe_interval(std::max(keyframe_interval, 1u)), frames_since_keyframe(0) {}
+
+void RewindBuffer::capture() {
+    uint64_t page_mask = console.memory_map.takeDirtyPages();
+    if (frames.empty() || frames_since_keyframe + 1 >= keyframe_interval) {
+        page_mask = all_pages;
+    }
+    if (frames.size() == capacity_frames) {
+        evictOldest();
+    }
+
+    Frame frame = std::move(spare);
+    savestate::StateWriter writer(frame.device_state);
+    console.processor.saveState(writer);
+    console.ppu.saveState(writer);
+    console.apu.saveState(writer);
+    for (unsigned port = 0; port < console.controllers.size(); ++port) {
+        console.controllers[port].saveState(writer, port);
+    }
+    storePages(frame, page_mask);
+    frames_since_keyframe = page_mask == all_pages ? 0 : frames_since_keyframe + 1;
+    frames.push_back(std::move(frame));
+}
+
+bool RewindBuffer::seekBack(std::size_t frames_back) {
+    if (frames_back >= frames.size()) {
+        return false;
+    }
+    std::size_t target = frames.size() - 1 - frames_back;
+
+    // Walk back from the target taking each page from the newest frame that
+    // stored it. The oldest frame is always a keyframe, so this terminates
+    uint64_t restored = 0;
+    std::size_t index = target + 1;
+    while (restored != all_pages) {
+        const Frame& frame = frames[--index];
+        const uint8_t* stored = frame.pages.data();
+        for (uint64_t mask = frame.page_mask; mask; mask &= mask - 1) {
+            unsigned page = std::countr_zero(mask);
+            if (!(restored & (uint64_t(1) << page))) {
+                console.memory_map.restoreStatePage(page, stored);
+            }
+            stored += PAGE_SIZE;
+        }
+        restored |= frame.page_mask;
+    }
+
+    savestate::StateReader reader(frames[target].device_state.data(), frames[target].device_state.size());
+    console.processor.loadState(reader);
+    console.ppu.loadState(reader);
+    console.apu.loadState(reader);
+    for (unsigned port = 0; port < console.controllers.size(); ++port) {
+        console.controllers[port].loadState(reader, port);
+    }
+
+    frames.erase(frames.begin() + target + 1, frames.end());
+    frames_since_keyframe = target - index;
+    // Memory now matches the target frame exactly
+    console.memory_map.takeDirtyPages();
+    return true;
+}
+
+std::size_t RewindBuffer::memoryUsage() const {
+    std::size_t total = spare.device_state.capacity() + spare.pages.capacity();
+    for (const Frame& frame : frames) {
+        total += sizeof(Frame) + frame.device_state.capacity() + frame.pages.capacity();
+    }
+    return total;
+}
+
+void RewindBuffer::storePages(Frame& frame, uint64_t page_mask) {
+    frame.page_mask = page_mask;
+    frame.pages.resize(std::popcount(page_mask) * PAGE_SIZE);
+    uint8_t* stored = frame.pages.data();
+    for (uint64_t mask = page_mask; mask; mask &= mask - 1) {
+        memcpy(stored, console.memory_map.statePage(std::countr_zero(mask)), PAGE_SIZE);
+        stored += PAGE_SIZE;
+    }
+}
+
+void RewindBuffer::evictOldest() {
+    Frame oldest = std::move(frames.front());
+    frames.pop_front();
+
+    // The next frame's deltas are relative to the keyframe being dropped, so
+    // merge them into its full copy and let the next frame take that over
+    if (oldest.page_mask == all_pages && !frames.empty() && frames.front().page_mask != all_pages) {
+        Frame& next = frames.front();
+        const uint8_t* stored = next.pages.data();
+        for (uint64_t mask = next.page_mask; mask; mask &= mask - 1) {
+            memcpy(oldest.pages.data() + std::countr_zero(mask) * PAGE_SIZE, stored, PAGE_SIZE);
+            stored += PAGE_SIZE;
+        }
+        std::swap(next.pages, oldest.pages);
+        next.page_mask = all_pages;
+    }
+    spare = std::move(oldest);
+}
+} // console::
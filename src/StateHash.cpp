@@ -0,0 +1,66 @@
+#include "StateHash.h"
+
+#include <bit>
+#include <cstring>
+
+namespace console {
+
+namespace {
+constexpr uint64_t multiplier = 0x9E3779B97F4A7C15;
+
+inline uint64_t mix(uint64_t hash, uint64_t value) {
+    return std::rotl((hash ^ value) * multiplier, 29);
+}
+
+// size must be a multiple of 8
+uint64_t hashWords(const uint8_t* data, std::size_t size) {
+    uint64_t hash = 0;
+    for (std::size_t offset = 0; offset < size; offset += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + offset, sizeof(word));
+        hash = mix(hash, word);
+    }
+    return hash;
+}
+
+uint64_t hashPage(const uint8_t* page) {
+    return hashWords(page, PAGE_SIZE);
+}
+
+// The last mix leaves the top bits depending on little of the input
+uint64_t finalise(uint64_t hash) {
+    hash = (hash ^ hash >> 31) * multiplier;
+    return hash ^ hash >> 29;
+}
+} // namespace
+
+StateHash::StateHash(Console& console) : console(console) {
+    console.memory_map.takeDirtyPages(memory::MemoryMap::DirtyTracker::HASH);
+    for (unsigned page = 0; page < STATE_PAGE_COUNT; ++page) {
+        page_hashes[page] = hashPage(console.memory_map.statePage(page));
+    }
+}
+
+uint64_t StateHash::update() {
+    uint64_t dirty = console.memory_map.takeDirtyPages(memory::MemoryMap::DirtyTracker::HASH);
+    for (; dirty; dirty &= dirty - 1) {
+        unsigned page = std::countr_zero(dirty);
+        page_hashes[page] = hashPage(console.memory_map.statePage(page));
+    }
+
+    cpu::CPU::Registers registers = console.processor.registers();
+    uint64_t hash = mix(0, console.processor.cycleCount());
+    hash = mix(hash, uint64_t(registers.accumulator) | uint64_t(registers.X) << 8 | uint64_t(registers.Y) << 16 |
+        uint64_t(registers.status) << 24 | uint64_t(registers.stack_pointer) << 32 |
+        uint64_t(registers.program_counter) << 40);
+    for (uint64_t page_hash : page_hashes) {
+        hash = mix(hash, page_hash);
+    }
+    return finalise(hash);
+}
+
+uint64_t StateHash::frameHash() const {
+    static_assert(ppu::PPU::screen_width * ppu::PPU::screen_height % sizeof(uint64_t) == 0);
+    return finalise(hashWords(console.ppu.frameBuffer(), ppu::PPU::screen_width * ppu::PPU::screen_height));
+}
+} // console::
@@ -0,0 +1,117 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+namespace threading {
+namespace {
+// Index of the worker running on this thread, or -1 off the pool
+thread_local int current_worker = -1;
+thread_local const WorkStealingPool* current_pool = nullptr;
+} // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+    : next_worker(0), pending(0), stopping(false), queued(0) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    // Start threads only once every deque exists, since they steal from each other
+    for (unsigned i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread(&WorkStealingPool::run, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto& worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void WorkStealingPool::submit(Task task) {
+    unsigned index;
+    if (current_pool == this) {
+        index = current_worker;
+    } else {
+        index = next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    }
+    pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        // Counted before it is queued, so a worker never takes a task that
+        // hasn't been counted yet
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        ++queued;
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    work_available.notify_one();
+}
+
+void WorkStealingPool::wait() {
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    all_done.wait(lock, [this] { return pending.load() == 0; });
+}
+
+bool WorkStealingPool::popLocal(unsigned index, Task& task) {
+    Worker& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(unsigned thief, Task& task) {
+    for (std::size_t offset = 1; offset < workers.size(); ++offset) {
+        Worker& victim = *workers[(thief + offset) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(unsigned index) {
+    current_worker = index;
+    current_pool = this;
+    while (true) {
+        Task task;
+        if (popLocal(index, task) || steal(index, task)) {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                --queued;
+            }
+            task();
+            if (pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        // The count is checked under the same lock submit() changes it under,
+        // so a task submitted since the deques were searched can't be missed.
+        // One counted but not yet pushed, or taken but not yet uncounted,
+        // only costs another search
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        work_available.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+} // threading::
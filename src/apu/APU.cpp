@@ -0,0 +1,601 @@
+#include "APU.h"
+
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+
+namespace apu {
+
+namespace {
+constexpr uint8_t length_table[32] = {
+    10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+    12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30,
+};
+
+constexpr uint8_t duty_table[4][8] = {
+    {0, 1, 0, 0, 0, 0, 0, 0},
+    {0, 1, 1, 0, 0, 0, 0, 0},
+    {0, 1, 1, 1, 1, 0, 0, 0},
+    {1, 0, 0, 1, 1, 1, 1, 1},
+};
+
+constexpr uint8_t triangle_sequence[32] = {
+    15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+};
+
+// NTSC timer periods, in CPU cycles
+constexpr uint16_t noise_periods[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068,
+};
+constexpr uint16_t dmc_periods[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54,
+};
+
+// Output units per step of each channel's level. The 2A03 mixes non-linearly,
+// these are the slopes of its curves near zero scaled so that everything at
+// full volume stays below full scale
+constexpr int32_t pulse_weight = 246;
+constexpr int32_t triangle_weight = 279;
+constexpr int32_t noise_weight = 162;
+constexpr int32_t dmc_weight = 110;
+
+// CPU cycles from the start of the frame counter's sequence to each step, and
+// the length of the whole sequence
+constexpr uint64_t four_step_sequence[4] = {7457, 14913, 22371, 29829};
+constexpr uint64_t four_step_period = 29830;
+constexpr uint64_t five_step_sequence[5] = {7457, 14913, 22371, 29829, 37281};
+constexpr uint64_t five_step_period = 37282;
+} // namespace
+
+APU::APU(cpu::CPU& cpu, memory::MemoryMap& memory_map, unsigned sample_rate)
+    : cpu(cpu), memory_map(memory_map), blip(cpu_clock_hz, sample_rate), output(nullptr), pulses{},
+      triangle{}, noise{}, dmc{}, five_step(false), irq_inhibit(false), frame_irq(false),
+      dmc_irq(false), frame_step(0), next_frame_step(four_step_sequence[0]), time(0), synthesis_ns(0),
+      frames_synthesised(0) {
+    pulses[0].ones_complement = true;
+    noise.shift_register = 1;
+    noise.timer_period = noise_periods[0];
+    dmc.timer_period = dmc_periods[0];
+    dmc.bits_remaining = 8;
+    dmc.silence = true;
+    dmc.sample_address = 0xC000;
+    dmc.sample_length = 1;
+    // The triangle powers up on a step of 15, start from there rather than
+    // with a click
+    triangle.level = triangle.output() * triangle_weight;
+    cpu.events().setHandler(cpu::Event::FRAME_IRQ, this);
+    cpu.events().setHandler(cpu::Event::DMC_DMA, this);
+    scheduleCPUEvents();
+}
+
+uint8_t APU::readStatus() {
+    catchUp(cpu.cycleCount());
+    uint8_t status = (pulses[0].length > 0) | (pulses[1].length > 0) << 1 | (triangle.length > 0) << 2 |
+        (noise.length > 0) << 3 | (dmc.bytes_remaining > 0) << 4 | frame_irq << 6 | dmc_irq << 7;
+    frame_irq = false;
+    updateIRQ(cpu.cycleCount());
+    return status;
+}
+
+void APU::writeRegister(uint16_t address, uint8_t value) {
+    catchUp(cpu.cycleCount());
+    switch (address) {
+    case 0x4000:
+    case 0x4004: {
+        Pulse& pulse = pulses[(address >> 2) & 1];
+        pulse.duty = value >> 6;
+        pulse.envelope.loop = value & 0x20;
+        pulse.envelope.constant = value & 0x10;
+        pulse.envelope.period = value & 0x0F;
+        break;
+    }
+    case 0x4001:
+    case 0x4005: {
+        Pulse& pulse = pulses[(address >> 2) & 1];
+        pulse.sweep_enabled = value & 0x80;
+        pulse.sweep_period = (value >> 4) & 7;
+        pulse.sweep_negate = value & 0x08;
+        pulse.sweep_shift = value & 7;
+        pulse.sweep_reload = true;
+        break;
+    }
+    case 0x4002:
+    case 0x4006: {
+        Pulse& pulse = pulses[(address >> 2) & 1];
+        pulse.timer_period = (pulse.timer_period & 0x700) | value;
+        break;
+    }
+    case 0x4003:
+    case 0x4007: {
+        Pulse& pulse = pulses[(address >> 2) & 1];
+        pulse.timer_period = (pulse.timer_period & 0xFF) | (value & 7) << 8;
+        if (pulse.enabled) {
+            pulse.length = length_table[value >> 3];
+        }
+        pulse.step = 0;
+        pulse.envelope.start = true;
+        break;
+    }
+    case 0x4008:
+        triangle.control = value & 0x80;
+        triangle.linear_period = value & 0x7F;
+        break;
+    case 0x400A:
+        triangle.timer_period = (triangle.timer_period & 0x700) | value;
+        break;
+    case 0x400B:
+        triangle.timer_period = (triangle.timer_period & 0xFF) | (value & 7) << 8;
+        if (triangle.enabled) {
+            triangle.length = length_table[value >> 3];
+        }
+        triangle.linear_reload = true;
+        break;
+    case 0x400C:
+        noise.envelope.loop = value & 0x20;
+        noise.envelope.constant = value & 0x10;
+        noise.envelope.period = value & 0x0F;
+        break;
+    case 0x400E:
+        noise.short_mode = value & 0x80;
+        noise.timer_period = noise_periods[value & 0x0F];
+        break;
+    case 0x400F:
+        if (noise.enabled) {
+            noise.length = length_table[value >> 3];
+        }
+        noise.envelope.start = true;
+        break;
+    case 0x4010:
+        dmc.irq_enabled = value & 0x80;
+        dmc.loop = value & 0x40;
+        dmc.timer_period = dmc_periods[value & 0x0F];
+        if (!dmc.irq_enabled) {
+            dmc_irq = false;
+            updateIRQ(cpu.cycleCount());
+        }
+        break;
+    case 0x4011:
+        dmc.output_level = value & 0x7F;
+        break;
+    case 0x4012:
+        dmc.sample_address = 0xC000 | value << 6;
+        break;
+    case 0x4013:
+        dmc.sample_length = (value << 4) | 1;
+        break;
+    case 0x4015:
+        pulses[0].enabled = value & 0x01;
+        pulses[1].enabled = value & 0x02;
+        triangle.enabled = value & 0x04;
+        noise.enabled = value & 0x08;
+        for (Pulse& pulse : pulses) {
+            if (!pulse.enabled) {
+                pulse.length = 0;
+            }
+        }
+        if (!triangle.enabled) {
+            triangle.length = 0;
+        }
+        if (!noise.enabled) {
+            noise.length = 0;
+        }
+        if (!(value & 0x10)) {
+            dmc.bytes_remaining = 0;
+        } else if (dmc.bytes_remaining == 0) {
+            dmc.address = dmc.sample_address;
+            dmc.bytes_remaining = dmc.sample_length;
+            if (!dmc.buffer_full) {
+                fetchDMCSample(cpu.cycleCount());
+            }
+        }
+        dmc_irq = false;
+        updateIRQ(cpu.cycleCount());
+        break;
+    case 0x4017: {
+        five_step = value & 0x80;
+        irq_inhibit = value & 0x40;
+        if (irq_inhibit) {
+            frame_irq = false;
+            updateIRQ(cpu.cycleCount());
+        }
+        // The sequence restarts on the next APU cycle boundary
+        uint64_t now = cpu.cycleCount();
+        frame_step = 0;
+        next_frame_step = now + 3 + (now & 1) + four_step_sequence[0];
+        if (five_step) {
+            clockQuarterFrame();
+            clockHalfFrame();
+        }
+        break;
+    }
+    default:
+        return;
+    }
+    updateAll(time);
+    scheduleCPUEvents();
+}
+
+void APU::catchUp(uint64_t cpu_cycle) {
+    while (next_frame_step < cpu_cycle) {
+        runChannels(next_frame_step);
+        clockFrameCounter();
+        updateAll(time);
+    }
+    runChannels(cpu_cycle);
+    scheduleCPUEvents();
+}
+
+void APU::handleEvent(cpu::Event, uint64_t) {
+    catchUp(cpu.cycleCount());
+}
+
+void APU::scheduleCPUEvents() {
+    // Things happen at the start of their cycle and catchUp() runs to the
+    // start, so the CPU stops a cycle after each
+    if (!five_step && !irq_inhibit) {
+        uint64_t irq_step = next_frame_step + four_step_sequence[3] - four_step_sequence[frame_step];
+        cpu.events().schedule(cpu::Event::FRAME_IRQ, irq_step + 1);
+    } else {
+        cpu.events().cancel(cpu::Event::FRAME_IRQ);
+    }
+    if (dmc.bytes_remaining > 0) {
+        // The buffer is emptied, and refilled, when the output unit runs out
+        // of bits
+        uint64_t fetch = dmc.next_clock + (dmc.bits_remaining - 1) * uint64_t(dmc.timer_period);
+        cpu.events().schedule(cpu::Event::DMC_DMA, fetch + 1);
+    } else {
+        cpu.events().cancel(cpu::Event::DMC_DMA);
+    }
+}
+
+void APU::endFrame(uint64_t cpu_cycle) {
+    auto start = std::chrono::steady_clock::now();
+    catchUp(cpu_cycle);
+    blip.endFrame(time);
+    samples.resize(blip.samplesAvailable());
+    std::size_t count = blip.readSamples(samples.data(), samples.size());
+    if (output) {
+        output->write(samples.data(), count);
+    }
+    synthesis_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    ++frames_synthesised;
+}
+
+void APU::Envelope::clock() {
+    if (start) {
+        start = false;
+        decay = 15;
+        divider = period;
+    } else if (divider > 0) {
+        --divider;
+    } else {
+        divider = period;
+        if (decay > 0) {
+            --decay;
+        } else if (loop) {
+            decay = 15;
+        }
+    }
+}
+
+uint16_t APU::Pulse::sweepTarget() const {
+    int change = timer_period >> sweep_shift;
+    if (sweep_negate) {
+        change = -change - ones_complement;
+    }
+    return std::max(timer_period + change, 0);
+}
+
+bool APU::Pulse::muted() const {
+    return length == 0 || envelope.volume() == 0 || timer_period < 8 || sweepTarget() > 0x7FF;
+}
+
+int32_t APU::Pulse::output() const {
+    return muted() ? 0 : duty_table[duty][step] * envelope.volume();
+}
+
+void APU::Pulse::clockSweep() {
+    if (sweep_divider == 0 && sweep_enabled && sweep_shift > 0 && !muted()) {
+        timer_period = sweepTarget();
+    }
+    if (sweep_divider == 0 || sweep_reload) {
+        sweep_divider = sweep_period;
+        sweep_reload = false;
+    } else {
+        --sweep_divider;
+    }
+}
+
+int32_t APU::Triangle::output() const {
+    return triangle_sequence[step];
+}
+
+int32_t APU::Noise::output() const {
+    return muted() || (shift_register & 1) ? 0 : envelope.volume();
+}
+
+void APU::runChannels(uint64_t end) {
+    if (end <= time) {
+        return;
+    }
+    runPulse(pulses[0], end);
+    runPulse(pulses[1], end);
+    runTriangle(end);
+    runNoise(end);
+    runDMC(end);
+    time = end;
+}
+
+void APU::runPulse(Pulse& pulse, uint64_t end) {
+    // The timer is clocked every other CPU cycle
+    uint64_t period = (uint64_t(pulse.timer_period) + 1) * 2;
+    if (pulse.next_clock >= end) {
+        return;
+    }
+    if (pulse.muted()) {
+        // Nothing to hear, only the sequencer's position matters
+        uint64_t steps = (end - pulse.next_clock + period - 1) / period;
+        pulse.step = (pulse.step + steps) & 7;
+        pulse.next_clock += steps * period;
+        return;
+    }
+    while (pulse.next_clock < end) {
+        pulse.step = (pulse.step + 1) & 7;
+        update(pulse.level, pulse.output(), pulse_weight, pulse.next_clock);
+        pulse.next_clock += period;
+    }
+}
+
+void APU::runTriangle(uint64_t end) {
+    uint64_t period = uint64_t(triangle.timer_period) + 1;
+    if (triangle.next_clock >= end) {
+        return;
+    }
+    // The sequencer holds its step while either counter is zero. Periods
+    // below 2 are ultrasonic and only make pops, so those hold it too
+    if (triangle.length == 0 || triangle.linear_counter == 0 || triangle.timer_period < 2) {
+        triangle.next_clock += (end - triangle.next_clock + period - 1) / period * period;
+        return;
+    }
+    while (triangle.next_clock < end) {
+        triangle.step = (triangle.step + 1) & 31;
+        update(triangle.level, triangle.output(), triangle_weight, triangle.next_clock);
+        triangle.next_clock += period;
+    }
+}
+
+void APU::runNoise(uint64_t end) {
+    // The shift register runs even while muted, it decides what comes next
+    bool muted = noise.muted();
+    while (noise.next_clock < end) {
+        unsigned tap = noise.short_mode ? 6 : 1;
+        uint16_t feedback = (noise.shift_register ^ (noise.shift_register >> tap)) & 1;
+        noise.shift_register = noise.shift_register >> 1 | feedback << 14;
+        if (!muted) {
+            update(noise.level, noise.output(), noise_weight, noise.next_clock);
+        }
+        noise.next_clock += noise.timer_period;
+    }
+}
+
+void APU::runDMC(uint64_t end) {
+    uint64_t period = dmc.timer_period;
+    if (dmc.next_clock >= end) {
+        return;
+    }
+    if (dmc.silence && !dmc.buffer_full && dmc.bytes_remaining == 0) {
+        // Idle until a sample is started, only the bit counter moves
+        uint64_t steps = (end - dmc.next_clock + period - 1) / period;
+        dmc.bits_remaining = (dmc.bits_remaining - 1 + 8 - steps % 8) % 8 + 1;
+        dmc.next_clock += steps * period;
+        return;
+    }
+    while (dmc.next_clock < end) {
+        if (!dmc.silence) {
+            if (dmc.shift_register & 1) {
+                if (dmc.output_level <= 125) {
+                    dmc.output_level += 2;
+                }
+            } else if (dmc.output_level >= 2) {
+                dmc.output_level -= 2;
+            }
+            update(dmc.level, dmc.output_level, dmc_weight, dmc.next_clock);
+        }
+        dmc.shift_register >>= 1;
+        if (--dmc.bits_remaining == 0) {
+            dmc.bits_remaining = 8;
+            dmc.silence = !dmc.buffer_full;
+            if (dmc.buffer_full) {
+                dmc.shift_register = dmc.buffer;
+                dmc.buffer_full = false;
+                if (dmc.bytes_remaining > 0) {
+                    fetchDMCSample(dmc.next_clock + 1);
+                }
+            }
+        }
+        dmc.next_clock += period;
+    }
+}
+
+void APU::fetchDMCSample(uint64_t at) {
+    dmc.buffer = memory_map.loggedRead(dmc.address, memory::CodeDataLog::PCM_DATA);
+    dmc.buffer_full = true;
+    dmc.address = dmc.address == 0xFFFF ? 0x8000 : dmc.address + 1;
+    if (--dmc.bytes_remaining == 0) {
+        if (dmc.loop) {
+            dmc.address = dmc.sample_address;
+            dmc.bytes_remaining = dmc.sample_length;
+        } else if (dmc.irq_enabled) {
+            dmc_irq = true;
+            updateIRQ(at);
+        }
+    }
+    // The CPU is halted while the DMC has the bus
+    cpu.stall(4);
+}
+
+void APU::update(int32_t& level, int32_t output, int32_t weight, uint64_t time) {
+    int32_t new_level = output * weight;
+    if (new_level != level) {
+        blip.addDelta(time, new_level - level);
+        level = new_level;
+    }
+}
+
+void APU::updateAll(uint64_t time) {
+    update(pulses[0].level, pulses[0].output(), pulse_weight, time);
+    update(pulses[1].level, pulses[1].output(), pulse_weight, time);
+    update(triangle.level, triangle.output(), triangle_weight, time);
+    update(noise.level, noise.output(), noise_weight, time);
+    update(dmc.level, dmc.output_level, dmc_weight, time);
+}
+
+void APU::clockFrameCounter() {
+    const uint64_t* sequence = five_step ? five_step_sequence : four_step_sequence;
+    unsigned steps = five_step ? 5 : 4;
+    uint64_t period = five_step ? five_step_period : four_step_period;
+
+    if (five_step && frame_step == 3) {
+        // The 5-step sequence's gap
+    } else {
+        clockQuarterFrame();
+        if (frame_step & 1 || frame_step == 4) {
+            clockHalfFrame();
+        }
+    }
+    if (!five_step && frame_step == 3 && !irq_inhibit) {
+        frame_irq = true;
+        // The cycle after the step, as the FRAME_IRQ event is scheduled
+        updateIRQ(next_frame_step + 1);
+    }
+
+    if (frame_step + 1u < steps) {
+        next_frame_step += sequence[frame_step + 1] - sequence[frame_step];
+        ++frame_step;
+    } else {
+        next_frame_step += period - sequence[frame_step] + sequence[0];
+        frame_step = 0;
+    }
+}
+
+void APU::clockQuarterFrame() {
+    pulses[0].envelope.clock();
+    pulses[1].envelope.clock();
+    noise.envelope.clock();
+    if (triangle.linear_reload) {
+        triangle.linear_counter = triangle.linear_period;
+    } else if (triangle.linear_counter > 0) {
+        --triangle.linear_counter;
+    }
+    if (!triangle.control) {
+        triangle.linear_reload = false;
+    }
+}
+
+void APU::clockHalfFrame() {
+    for (Pulse& pulse : pulses) {
+        if (pulse.length > 0 && !pulse.envelope.loop) {
+            --pulse.length;
+        }
+        pulse.clockSweep();
+    }
+    if (triangle.length > 0 && !triangle.control) {
+        --triangle.length;
+    }
+    if (noise.length > 0 && !noise.envelope.loop) {
+        --noise.length;
+    }
+}
+
+void APU::updateIRQ(uint64_t at) {
+    cpu.setIRQLine(frame_irq || dmc_irq, at);
+}
+
+template <typename Self, typename Visit>
+void APU::visitState(Self& self, Visit&& visit) {
+    auto visitEnvelope = [&](auto& envelope) {
+        visit(envelope.start);
+        visit(envelope.loop);
+        visit(envelope.constant);
+        visit(envelope.period);
+        visit(envelope.divider);
+        visit(envelope.decay);
+    };
+    for (auto& pulse : self.pulses) {
+        visitEnvelope(pulse.envelope);
+        visit(pulse.duty);
+        visit(pulse.step);
+        visit(pulse.timer_period);
+        visit(pulse.length);
+        visit(pulse.enabled);
+        visit(pulse.sweep_enabled);
+        visit(pulse.sweep_negate);
+        visit(pulse.sweep_reload);
+        visit(pulse.sweep_period);
+        visit(pulse.sweep_shift);
+        visit(pulse.sweep_divider);
+        visit(pulse.next_clock);
+        visit(pulse.level);
+    }
+    visit(self.triangle.timer_period);
+    visit(self.triangle.step);
+    visit(self.triangle.length);
+    visit(self.triangle.enabled);
+    visit(self.triangle.control);
+    visit(self.triangle.linear_reload);
+    visit(self.triangle.linear_period);
+    visit(self.triangle.linear_counter);
+    visit(self.triangle.next_clock);
+    visit(self.triangle.level);
+    visitEnvelope(self.noise.envelope);
+    visit(self.noise.short_mode);
+    visit(self.noise.timer_period);
+    visit(self.noise.shift_register);
+    visit(self.noise.length);
+    visit(self.noise.enabled);
+    visit(self.noise.next_clock);
+    visit(self.noise.level);
+    visit(self.dmc.irq_enabled);
+    visit(self.dmc.loop);
+    visit(self.dmc.timer_period);
+    visit(self.dmc.sample_address);
+    visit(self.dmc.sample_length);
+    visit(self.dmc.address);
+    visit(self.dmc.bytes_remaining);
+    visit(self.dmc.buffer);
+    visit(self.dmc.buffer_full);
+    visit(self.dmc.shift_register);
+    visit(self.dmc.bits_remaining);
+    visit(self.dmc.silence);
+    visit(self.dmc.output_level);
+    visit(self.dmc.next_clock);
+    visit(self.dmc.level);
+    visit(self.five_step);
+    visit(self.irq_inhibit);
+    visit(self.frame_irq);
+    visit(self.dmc_irq);
+    visit(self.frame_step);
+    visit(self.next_frame_step);
+    visit(self.time);
+}
+
+void APU::saveState(savestate::StateWriter& writer) const {
+    writer.beginChunk(savestate::makeTag("APU "));
+    visitState(*this, [&](const auto& field) { writer.write(field); });
+    writer.endChunk();
+}
+
+void APU::loadState(savestate::StateReader& reader) {
+    if (!reader.seekChunk(savestate::makeTag("APU "))) {
+        return;
+    }
+    visitState(*this, [&](auto& field) { field = reader.read<std::remove_reference_t<decltype(field)>>(); });
+    // Samples not yet read belong to the timeline being left. The levels carry
+    // over, so output continues from them without a step
+    blip.reset(time);
+    updateIRQ(cpu.cycleCount());
+    scheduleCPUEvents();
+}
+} // apu::
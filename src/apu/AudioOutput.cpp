@@ -0,0 +1,71 @@
+#include "AudioOutput.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace apu {
+
+namespace {
+void put16(uint8_t* out, uint16_t value) {
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+void put32(uint8_t* out, uint32_t value) {
+    put16(out, value & 0xFFFF);
+    put16(out + 2, value >> 16);
+}
+
+// 44-byte RIFF header for 16-bit mono PCM
+void makeHeader(uint8_t* header, unsigned sample_rate, uint32_t data_bytes) {
+    memcpy(header, "RIFF", 4);
+    put32(header + 4, 36 + data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(header + 16, 16);
+    put16(header + 20, 1);
+    put16(header + 22, 1);
+    put32(header + 24, sample_rate);
+    put32(header + 28, sample_rate * 2);
+    put16(header + 32, 2);
+    put16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put32(header + 40, data_bytes);
+}
+} // namespace
+
+WavWriter::WavWriter(const std::string& path, unsigned sample_rate)
+    : file(fopen(path.c_str(), "wb")), sample_rate(sample_rate), data_bytes(0), failed(false) {
+    if (!file) {
+        throw std::runtime_error("Can't create " + path);
+    }
+    // Sizes are filled in by close()
+    uint8_t header[44];
+    makeHeader(header, sample_rate, 0);
+    failed = fwrite(header, 1, sizeof(header), file) != sizeof(header);
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+void WavWriter::write(const int16_t* samples, std::size_t count) {
+    if (!file) {
+        return;
+    }
+    // WAV is little-endian, like every host we build for
+    failed |= fwrite(samples, sizeof(int16_t), count, file) != count;
+    data_bytes += count * sizeof(int16_t);
+}
+
+bool WavWriter::close() {
+    if (!file) {
+        return !failed;
+    }
+    uint8_t header[44];
+    makeHeader(header, sample_rate, data_bytes);
+    failed |= fseek(file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    failed |= fclose(file) != 0;
+    file = nullptr;
+    return !failed;
+}
+} // apu::
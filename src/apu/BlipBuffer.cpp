@@ -0,0 +1,120 @@
+#include "BlipBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace apu {
+
+namespace {
+// How fast the running sum leaks back to zero, as a shift: the high-pass sits
+// at about sample_rate / (2 pi 2^bass_shift), 14Hz at 44.1kHz
+constexpr unsigned bass_shift = 9;
+// Fraction of the output Nyquist frequency the kernel passes
+constexpr double cutoff = 0.9;
+
+typedef std::array<std::array<int32_t, BlipBuffer::kernel_width>, BlipBuffer::phase_count> Kernel;
+
+// Tap k of phase p is how much a unit step p/phase_count of the way past a
+// sample adds to sample k: the difference between neighbouring samples of an
+// integrated, Blackman-windowed sinc. Every phase sums to exactly 1.0
+Kernel makeKernel() {
+    constexpr int width = BlipBuffer::kernel_width;
+    constexpr int steps_per_sample = 64;
+    auto impulse = [](double x) {
+        if (std::fabs(x) >= width / 2.0) {
+            return 0.0;
+        }
+        double sinc = x == 0 ? 1.0 : std::sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+        double window = 0.42 + 0.5 * std::cos(2 * M_PI * x / width) + 0.08 * std::cos(4 * M_PI * x / width);
+        return cutoff * sinc * window;
+    };
+    Kernel kernel;
+    for (unsigned phase = 0; phase < BlipBuffer::phase_count; ++phase) {
+        double fraction = double(phase) / BlipBuffer::phase_count;
+        std::array<double, width + 1> step{};
+        // Midpoint rule, sample by sample from the left edge of the window
+        double sum = 0;
+        for (int k = 0; k <= width; ++k) {
+            double end = k - width / 2.0 - fraction;
+            double start = end - 1;
+            for (int i = 0; i < steps_per_sample; ++i) {
+                sum += impulse(start + (i + 0.5) / steps_per_sample) / steps_per_sample;
+            }
+            step[k] = sum;
+        }
+        int32_t total = 0;
+        for (int k = 0; k < width; ++k) {
+            kernel[phase][k] = std::lround((step[k + 1] - step[k]) / step[width] * (1 << BlipBuffer::delta_bits));
+            total += kernel[phase][k];
+        }
+        kernel[phase][width / 2] += (1 << BlipBuffer::delta_bits) - total;
+    }
+    return kernel;
+}
+
+const Kernel& kernel() {
+    static const Kernel table = makeKernel();
+    return table;
+}
+} // namespace
+
+BlipBuffer::BlipBuffer(double clock_rate, unsigned sample_rate)
+    : sample_rate(sample_rate), factor(std::llround(sample_rate / clock_rate * std::ldexp(1.0, fraction_bits))) {
+    kernel();
+    reset(0);
+}
+
+void BlipBuffer::reset(uint64_t clock) {
+    frame_clock = clock;
+    offset = 0;
+    samples_available = 0;
+    buffer.assign(sample_rate / 10 + kernel_width, 0);
+    integrator = 0;
+}
+
+void BlipBuffer::addDelta(uint64_t clock, int32_t delta) {
+    // Round to the nearest phase
+    uint64_t fixed = position(clock) + (uint64_t(1) << (fraction_bits - phase_bits - 1));
+    std::size_t index = fixed >> fraction_bits;
+    unsigned phase = (fixed >> (fraction_bits - phase_bits)) & (phase_count - 1);
+    if (index + kernel_width > buffer.size()) {
+        buffer.resize(index + kernel_width + sample_rate / 60, 0);
+    }
+    const int32_t* taps = kernel()[phase].data();
+    int32_t* out = &buffer[index];
+    for (unsigned k = 0; k < kernel_width; ++k) {
+        out[k] += taps[k] * delta;
+    }
+}
+
+void BlipBuffer::endFrame(uint64_t clock) {
+    offset = position(clock);
+    frame_clock = clock;
+    samples_available = offset >> fraction_bits;
+    // A long frame with no late deltas hasn't grown the buffer this far
+    if (samples_available + kernel_width > buffer.size()) {
+        buffer.resize(samples_available + kernel_width, 0);
+    }
+}
+
+std::size_t BlipBuffer::readSamples(int16_t* out, std::size_t count) {
+    count = std::min(count, samples_available);
+    int64_t sum = integrator;
+    for (std::size_t i = 0; i < count; ++i) {
+        sum += buffer[i];
+        int32_t sample = static_cast<int32_t>(sum >> delta_bits);
+        out[i] = static_cast<int16_t>(std::clamp(sample, -32768, 32767));
+        sum -= int64_t(sample) << (delta_bits - bass_shift);
+    }
+    integrator = sum;
+
+    // Keep the tails of kernels that reach past what was read
+    std::size_t kept = buffer.size() - count;
+    memmove(buffer.data(), buffer.data() + count, kept * sizeof(int32_t));
+    std::fill(buffer.begin() + kept, buffer.end(), 0);
+    samples_available -= count;
+    offset -= uint64_t(count) << fraction_bits;
+    return count;
+}
+} // apu::
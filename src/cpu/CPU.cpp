@@ -1,53 +1,433 @@
 #include "CPU.h"
-#include "CPU_Timer.h"
-#include "ThreadUtils.h"
+#include "Jit.h"
+
+#include <algorithm>
 
 namespace cpu {
-CPU::CPU()
-    : X(0), Y(0), accumulator(0), processor_status(0), stack_pointer(STACK_START), program_counter(0){}
+CPU::CPU(memory::MemoryMap& memory_map)
+    : memory_map(memory_map), X(0), Y(0), accumulator(0), processor_status(flagBit(ALWAYS1)),
+      negative_result(0), zero_result(1), carry_result(0), overflow_result(0), stack_pointer(STACK_START), program_counter(0),
+      cycle_count(0), instruction_count(0), trace_writer(nullptr), execution_mode(ExecutionMode::INTERPRETER),
+      cycle_stepped(false), slow_path(false), bus_monitor(nullptr), profiler(nullptr), nmi_pending(false), irq_line(false), nmi_requested_at(0),
+      irq_asserted_at(0), stall_cycles(0), uncached_instruction{}, decode_cache_stats{0, 0}{}
+
+CPU::~CPU() = default;
 
-void CPU::processNextOpcode(){
-    uint8_t opcode = *memory_map.read(program_counter);
+void CPU::reset(){
+    // The reset sequence pushes nothing but still walks the stack pointer down
+    // by three from $00 (wrapping to $FD), and masks interrupts
+    stack_pointer = STACK_END + 0xFD;
+    setProcessorStatus(pFlag::INTERRUPT, true);
+    program_counter = memory_map.absoluteReadPointer(RESET_VECTOR);
+    nmi_pending = false;
+    stall_cycles = 0;
+    updateSlowPath();
+}
 
-    auto op = opcodes_to_operations.find(opcode)->second;
+void CPU::setRegisters(const Registers& registers) {
+    accumulator = registers.accumulator;
+    X = registers.X;
+    Y = registers.Y;
+    setProcessorStatus(registers.status);
+    stack_pointer = STACK_END | registers.stack_pointer;
+    program_counter = registers.program_counter;
+    updateSlowPath();
+}
 
-    // Start the timer
-    CPU_Timer timer(op.cycles);
+void CPU::requestNMI(uint64_t at) {
+    if (!nmi_pending) {
+        nmi_pending = true;
+        nmi_requested_at = at;
+        updateSlowPath();
+    }
+}
+
+void CPU::setIRQLine(bool asserted, uint64_t at) {
+    if (asserted && !irq_line) {
+        irq_asserted_at = at;
+    }
+    irq_line = asserted;
+    updateSlowPath();
+}
+
+void CPU::saveState(savestate::StateWriter& writer) const {
+    writer.beginChunk(savestate::makeTag("CPU "));
+    writer.write(accumulator);
+    writer.write(X);
+    writer.write(Y);
+    writer.write(processorStatus());
+    writer.write(stack_pointer);
+    writer.write(program_counter);
+    writer.write(cycle_count);
+    writer.write(nmi_pending);
+    writer.write(irq_line);
+    writer.write(nmi_requested_at);
+    writer.write(irq_asserted_at);
+    writer.write(stall_cycles);
+    writer.endChunk();
+}
 
-    performOperation(op);
+void CPU::loadState(savestate::StateReader& reader) {
+    reader.findChunk(savestate::makeTag("CPU "));
+    accumulator = reader.read<uint8_t>();
+    X = reader.read<uint8_t>();
+    Y = reader.read<uint8_t>();
+    setProcessorStatus(reader.read<uint8_t>());
+    stack_pointer = reader.read<uint16_t>();
+    program_counter = reader.read<uint16_t>();
+    cycle_count = reader.read<uint64_t>();
+    // States saved before the interrupt inputs existed end here
+    nmi_pending = irq_line = false;
+    if (reader.remaining()) {
+        nmi_pending = reader.read<bool>();
+        irq_line = reader.read<bool>();
+        nmi_requested_at = reader.read<uint64_t>();
+        irq_asserted_at = reader.read<uint64_t>();
+    }
+    stall_cycles = reader.remaining() ? reader.read<uint64_t>() : 0;
+    updateSlowPath();
+}
 
-    if(op.plus_if_crossed_page_boundary /*&&
-        memory_map.pageBoundaryCrossed()*/) {
-        CPU_Timer::extra_cycles++;
+uint8_t CPU::processNextOpcode(){
+    if (__builtin_expect(memory_map.codeWritten(), false)) {
+        invalidateDecodedPages(memory_map.takeCodeWrites());
+    }
+    if (__builtin_expect(slow_path, false)) {
+        return processNextOpcodeSlowly();
     }
 
-    std::unique_lock<std::mutex> lock(mtx);
-    // Wait for timer to wake this thread - stop waiting after 10 6502 cycles:
-    // no instruction should take that long.
-    // TODO - maybe this shouldn't live here?
-    // thread_waker.wait_until(lock, 
-    //     std::chrono::system_clock::now() + 10*CPU_Timer::cpu_cycle_length_useconds);
+    uint64_t start = cycle_count;
+    uint8_t status_before = processor_status;
+    uint8_t opcode = runDecodedInstruction();
+    ++instruction_count;
+    // A device the instruction accessed can raise an interrupt in time for
+    // this instruction's poll, as it would be on the slow path
+    if (__builtin_expect(slow_path, false) && (nmi_pending || irq_line)) {
+        pollInterrupts(opcode, status_before);
+    }
+    return cycle_count - start;
 }
 
-void CPU::performOperation(const OperationTuple& operation_tuple) {
-    auto operand = getOperandFromMemory(operation_tuple.addressing_mode);
-    // TODO: Getting a pointer and then passing a reference might be dumb
-    operation_tuple.op(*this, *operand);
+uint8_t CPU::processNextOpcodeSlowly() {
+    uint64_t start = cycle_count;
+    if (stall_cycles) {
+        cycle_count += stall_cycles;
+        stall_cycles = 0;
+        updateSlowPath();
+    }
+    uint8_t status_before = processor_status;
+    uint8_t opcode;
+    if (PROFILER && profiler) {
+        opcode = runProfiledInstruction();
+    }
+    else {
+        opcode = cycle_stepped ? stepInstruction() : runDecodedInstruction();
+    }
+    ++instruction_count;
+    if (nmi_pending || irq_line) {
+        pollInterrupts(opcode, status_before);
+    }
+    return cycle_count - start;
 }
 
-std::shared_ptr<std::bitset<8>> CPU::getOperandFromMemory(const AddressingMode& addressing_mode) {
-    std::shared_ptr<std::bitset<8>> operand;
+uint8_t CPU::runProfiledInstruction() {
+    uint8_t opcode;
+    if (profiler->sampleNext()) {
+        uint16_t start_pc = program_counter;
+        uint64_t start_cycle = cycle_count;
+        auto start = Profiler::Clock::now();
+        opcode = cycle_stepped ? stepInstruction() : runDecodedInstruction();
+        auto host_time = Profiler::Clock::now() - start;
+        profiler->recordSample(opcode, start_pc, cycle_count - start_cycle, host_time);
+    }
+    else {
+        opcode = cycle_stepped ? stepInstruction() : runDecodedInstruction();
+    }
+    profiler->trackCalls(opcode, program_counter, stack_pointer & 0xFF);
+    return opcode;
+}
+
+uint64_t CPU::run(uint64_t cycles) {
+    uint64_t start = cycle_count;
+    uint64_t target = cycle_count + cycles;
+    while (cycle_count < target) {
+        // Handlers schedule after the cycle they catch up to, so this always
+        // leaves the next event ahead
+        event_scheduler.runDue(cycle_count);
+        runUntil(std::min(target, event_scheduler.nextCycle()));
+    }
+    event_scheduler.runDue(cycle_count);
+    return cycle_count - start;
+}
+
+void CPU::runUntil(uint64_t target) {
+    // An instruction touching a device can schedule an event sooner than
+    // target, so the next event is looked at again after each one
+    uint64_t until;
+    if (execution_mode == ExecutionMode::JIT && trace_writer == nullptr) {
+        while (cycle_count < (until = std::min(target, event_scheduler.nextCycle()))) {
+            if (__builtin_expect(memory_map.codeWritten(), false)) {
+                invalidateDecodedPages(memory_map.takeCodeWrites());
+            }
+            // Blocks don't check for interrupts, so the interpreter runs while
+            // one could be taken
+            if (slow_path || !jit->runBlock(until)) {
+                processNextOpcode();
+            }
+        }
+    }
+    else {
+        while (cycle_count < (until = std::min(target, event_scheduler.nextCycle()))) {
+            processNextOpcode();
+        }
+    }
+}
+
+bool CPU::setExecutionMode(ExecutionMode mode) {
+    if (mode == ExecutionMode::JIT && !jit) {
+        jit = Jit::create(*this);
+        if (!jit) {
+            return false;
+        }
+    }
+    execution_mode = mode;
+    cycle_stepped = mode == ExecutionMode::CYCLE_STEPPED;
+    updateSlowPath();
+    return true;
+}
+
+uint8_t CPU::stepInstruction() {
+    if (trace_writer != nullptr) {
+        uint8_t opcode = memory_map.read(program_counter);
+        traceInstruction(opcode, opcodes_to_operations[opcode]);
+    }
+    uint8_t opcode = stepRead(program_counter);
+    memory_map.logCode(program_counter, instructionLength(opcodes_to_operations[opcode].addressing_mode));
+    stepped_executors[opcode](*this);
+    return opcode;
+}
+
+uint8_t CPU::stepRead(uint16_t address) {
+    uint8_t value = memory_map.read(address);
+    if (bus_monitor) {
+        bus_monitor->access(cycle_count, address, value, false);
+    }
+    ++cycle_count;
+    return value;
+}
+
+void CPU::stepWrite(uint16_t address, uint8_t value) {
+    memory_map.write(address, value);
+    if (bus_monitor) {
+        bus_monitor->access(cycle_count, address, value, true);
+    }
+    ++cycle_count;
+}
+
+void CPU::pollInterrupts(uint8_t opcode, uint8_t status_before) {
+    // Only requests made before the instruction's last cycle are seen
+    uint64_t last_cycle = cycle_count - 1;
+    if (nmi_pending && nmi_requested_at < last_cycle) {
+        serviceInterrupt();
+        return;
+    }
+    // CLI, SEI and PLP change the INTERRUPT flag in their last cycle, after
+    // the check, so their effect on IRQs is delayed by an instruction
+    Operator op = opcodes_to_operations[opcode].op;
+    uint8_t status = op == &CPU::CLI || op == &CPU::SEI || op == &CPU::PLP ? status_before : processor_status;
+    if (irq_line && irq_asserted_at < last_cycle && !(status & flagBit(pFlag::INTERRUPT))) {
+        serviceInterrupt();
+    }
+}
+
+void CPU::serviceInterrupt() {
+    uint16_t vector = IRQ_VECTOR;
+    if (nmi_pending) {
+        nmi_pending = false;
+        updateSlowPath();
+        vector = NMI_VECTOR;
+    }
+    if (cycle_stepped) {
+        // The next opcode is fetched and ignored, as is the byte after it
+        stepRead(program_counter);
+        stepRead(program_counter);
+    }
+    else {
+        cycle_count += 7;
+    }
+    pushAddressToStack(program_counter);
+    // Unlike BRK and PHP, the copy pushed has the break flag clear
+    pushToStack(processorStatus());
+    processor_status |= flagBit(pFlag::INTERRUPT);
+    updateSlowPath();
+    program_counter = readAddress(vector);
+    if (PROFILER && profiler) {
+        profiler->enterCall(program_counter, stack_pointer & 0xFF);
+    }
+}
+
+const CPU::DecodedInstruction& CPU::decodeInstruction() {
+    ++decode_cache_stats.misses;
+    uint8_t opcode = memory_map.read(program_counter);
+    const OperationTuple& operation = opcodes_to_operations[opcode];
+    uint8_t length = instructionLength(operation.addressing_mode);
+    uint16_t operand_bytes = 0;
+    for (uint8_t i = 1; i < length; ++i) {
+        operand_bytes |= memory_map.read(program_counter + i) << (8 * (i - 1));
+    }
+    DecodedInstruction decoded{executors[opcode], operand_bytes, length, opcode};
+    // Instructions are decoded just before they first run, and again after
+    // anything that could change what runs from here, so this is the place
+    // to log code
+    memory_map.logCode(program_counter, length);
+
+    uint8_t first_page = program_counter >> 8;
+    uint8_t last_page = (program_counter + length - 1) >> 8;
+    if (!memory_map.hostPage(first_page) || !memory_map.hostPage(last_page)) {
+        uncached_instruction = decoded;
+        return uncached_instruction;
+    }
+    std::unique_ptr<DecodedPage>& page = decoded_pages[first_page];
+    if (!page) {
+        page = std::make_unique<DecodedPage>();
+        page->fill(DecodedInstruction{});
+    }
+    memory_map.watchCode(first_page);
+    memory_map.watchCode(last_page);
+    DecodedInstruction& entry = (*page)[program_counter & 0xFF];
+    entry = decoded;
+    return entry;
+}
+
+void CPU::invalidateDecodedPages(uint64_t written_state_pages) {
+    if (jit) {
+        jit->invalidate(written_state_pages);
+    }
+    if (written_state_pages == ~uint64_t(0)) {
+        // The mapping changed, so even ROM pages may now hold different code
+        for (std::unique_ptr<DecodedPage>& page : decoded_pages) {
+            page.reset();
+        }
+        return;
+    }
+    for (unsigned page = 0; page < PAGE_COUNT; ++page) {
+        if (!decoded_pages[page] || !(memory_map.statePageBit(page) & written_state_pages)) {
+            continue;
+        }
+        decoded_pages[page]->fill(DecodedInstruction{});
+        // Instructions at the end of the page before may run into this one
+        if (page > 0 && decoded_pages[page - 1]) {
+            decoded_pages[page - 1]->fill(DecodedInstruction{});
+        }
+    }
+}
+
+void CPU::traceInstruction(uint8_t opcode, const OperationTuple& operation) {
+    TraceRecord record{};
+    record.cycle = cycle_count;
+    record.program_counter = program_counter;
+    record.opcode = opcode;
+    record.length = instructionLength(operation.addressing_mode);
+    for (uint8_t i = 1; i < record.length; ++i) {
+        record.operand[i - 1] = memory_map.read(program_counter + i);
+    }
+    record.accumulator = accumulator;
+    record.x = X;
+    record.y = Y;
+    record.processor_status = processorStatus();
+    record.stack_pointer = static_cast<uint8_t>(stack_pointer);
+    trace_writer->push(record);
+}
+
+CPU::Operand CPU::getOperandFromMemory(AddressingMode addressing_mode, uint16_t operand_bytes) {
     switch (addressing_mode)
     {
+    case AddressingMode::IMPLIED:
+        return getOperandFromMemory<AddressingMode::IMPLIED>(operand_bytes);
+    case AddressingMode::ACCUMULATOR:
+        return getOperandFromMemory<AddressingMode::ACCUMULATOR>(operand_bytes);
+    case AddressingMode::IMMEDIATE:
+        return getOperandFromMemory<AddressingMode::IMMEDIATE>(operand_bytes);
+    case AddressingMode::ZERO_PAGE:
+        return getOperandFromMemory<AddressingMode::ZERO_PAGE>(operand_bytes);
+    case AddressingMode::ZERO_PAGE_INDEXED_X:
+        return getOperandFromMemory<AddressingMode::ZERO_PAGE_INDEXED_X>(operand_bytes);
+    case AddressingMode::ZERO_PAGE_INDEXED_Y:
+        return getOperandFromMemory<AddressingMode::ZERO_PAGE_INDEXED_Y>(operand_bytes);
+    case AddressingMode::ABSOLUTE:
+        return getOperandFromMemory<AddressingMode::ABSOLUTE>(operand_bytes);
+    case AddressingMode::INDEXED_X:
+        return getOperandFromMemory<AddressingMode::INDEXED_X>(operand_bytes);
+    case AddressingMode::INDEXED_Y:
+        return getOperandFromMemory<AddressingMode::INDEXED_Y>(operand_bytes);
+    case AddressingMode::PRE_INDEXED_INDIRECT:
+        return getOperandFromMemory<AddressingMode::PRE_INDEXED_INDIRECT>(operand_bytes);
+    case AddressingMode::POST_INDEXED_INDIRECT:
+        return getOperandFromMemory<AddressingMode::POST_INDEXED_INDIRECT>(operand_bytes);
+    case AddressingMode::INDIRECT:
+        return getOperandFromMemory<AddressingMode::INDIRECT>(operand_bytes);
+    case AddressingMode::RELATIVE:
+        return getOperandFromMemory<AddressingMode::RELATIVE>(operand_bytes);
+    }
+    return Operand{0, addressing_mode, false};
+}
+
+uint8_t CPU::instructionLength(uint8_t opcode) {
+    return instructionLength(opcodes_to_operations[opcode].addressing_mode);
+}
+
+std::string CPU::disassemble(const uint8_t* bytes, uint16_t program_counter) {
+    const OperationTuple& operation = opcodes_to_operations[bytes[0]];
+    uint16_t address = bytes[2] << 8 | bytes[1];
+    char operand[16] = "";
+    switch (operation.addressing_mode)
+    {
+    case AddressingMode::IMPLIED:
+        break;
+    case AddressingMode::ACCUMULATOR:
+        snprintf(operand, sizeof(operand), "A");
+        break;
     case AddressingMode::IMMEDIATE:
-        operand = std::make_shared<std::bitset<8>>(
-            memory_map.immediateRead(program_counter));
+        snprintf(operand, sizeof(operand), "#$%02X", bytes[1]);
         break;
-    
-    default:
+    case AddressingMode::ZERO_PAGE:
+        snprintf(operand, sizeof(operand), "$%02X", bytes[1]);
+        break;
+    case AddressingMode::ZERO_PAGE_INDEXED_X:
+        snprintf(operand, sizeof(operand), "$%02X,X", bytes[1]);
+        break;
+    case AddressingMode::ZERO_PAGE_INDEXED_Y:
+        snprintf(operand, sizeof(operand), "$%02X,Y", bytes[1]);
+        break;
+    case AddressingMode::ABSOLUTE:
+        snprintf(operand, sizeof(operand), "$%04X", address);
+        break;
+    case AddressingMode::INDEXED_X:
+        snprintf(operand, sizeof(operand), "$%04X,X", address);
+        break;
+    case AddressingMode::INDEXED_Y:
+        snprintf(operand, sizeof(operand), "$%04X,Y", address);
+        break;
+    case AddressingMode::PRE_INDEXED_INDIRECT:
+        snprintf(operand, sizeof(operand), "($%02X,X)", bytes[1]);
+        break;
+    case AddressingMode::POST_INDEXED_INDIRECT:
+        snprintf(operand, sizeof(operand), "($%02X),Y", bytes[1]);
+        break;
+    case AddressingMode::INDIRECT:
+        snprintf(operand, sizeof(operand), "($%04X)", address);
+        break;
+    case AddressingMode::RELATIVE:
+        snprintf(operand, sizeof(operand), "$%04X",
+            static_cast<uint16_t>(program_counter + 2 + static_cast<int8_t>(bytes[1])));
         break;
     }
 
-    return operand;
+    std::string assembly = operation.mnemonic;
+    if (operand[0]) {
+        assembly += ' ';
+        assembly += operand;
+    }
+    return assembly;
 }
-} // cpu::
\ No newline at end of file
+} // cpu::
@@ -0,0 +1,72 @@
+#include "EventScheduler.h"
+
+#include <algorithm>
+
+namespace cpu {
+
+namespace {
+// Past this many stale entries per event the heap is rebuilt
+constexpr std::size_t stale_entries_per_event = 8;
+} // namespace
+
+EventScheduler::EventScheduler() : next_cycle(never) {
+    due.fill(never);
+    handlers.fill(nullptr);
+    heap.reserve(event_count * stale_entries_per_event);
+}
+
+void EventScheduler::setHandler(Event event, EventHandler* handler) {
+    handlers[static_cast<std::size_t>(event)] = handler;
+}
+
+void EventScheduler::schedule(Event event, uint64_t cycle) {
+    uint64_t& when = due[static_cast<std::size_t>(event)];
+    if (when == cycle) {
+        return;
+    }
+    if (heap.size() >= event_count * stale_entries_per_event) {
+        compact();
+    }
+    when = cycle;
+    if (cycle == never) {
+        return;
+    }
+    heap.push_back({cycle, event});
+    std::push_heap(heap.begin(), heap.end());
+    updateNextCycle();
+}
+
+void EventScheduler::cancel(Event event) {
+    due[static_cast<std::size_t>(event)] = never;
+}
+
+void EventScheduler::runDue(uint64_t cycle) {
+    while (!heap.empty() && heap.front().cycle <= cycle) {
+        Entry entry = heap.front();
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+        updateNextCycle();
+        uint64_t& when = due[static_cast<std::size_t>(entry.event)];
+        if (when != entry.cycle) {
+            // Rescheduled or cancelled since
+            continue;
+        }
+        when = never;
+        EventHandler* handler = handlers[static_cast<std::size_t>(entry.event)];
+        if (handler) {
+            handler->handleEvent(entry.event, entry.cycle);
+        }
+    }
+}
+
+void EventScheduler::compact() {
+    heap.clear();
+    for (std::size_t event = 0; event < event_count; ++event) {
+        if (due[event] != never) {
+            heap.push_back({due[event], static_cast<Event>(event)});
+        }
+    }
+    std::make_heap(heap.begin(), heap.end());
+    updateNextCycle();
+}
+} // cpu::
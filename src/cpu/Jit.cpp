@@ -0,0 +1,494 @@
+#include "Jit.h"
+
+#include <algorithm>
+#include <initializer_list>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace cpu {
+
+namespace {
+#if defined(__x86_64__)
+// Appends x86-64 machine code. Generated blocks keep the CPU in rbx, point r12
+// at an Operand in their stack frame, which is passed to every handler, keep
+// the memory map's code-written flag in r13, the event scheduler's next cycle
+// in r14 and what it was when the block started in r15
+class Emitter {
+public:
+    Emitter(uint8_t* out) : out(out), size(0) {}
+
+    void bytes(std::initializer_list<uint8_t> values) {
+        for (uint8_t value : values) {
+            out[size++] = value;
+        }
+    }
+
+    template <typename T>
+    void value(T value) {
+        memcpy(out + size, &value, sizeof(T));
+        size += sizeof(T);
+    }
+
+    void prologue(const uint64_t* code_written, const uint64_t* next_event) {
+        bytes({0x53});                   // push rbx
+        bytes({0x41, 0x54});             // push r12
+        bytes({0x41, 0x55});             // push r13
+        bytes({0x41, 0x56});             // push r14
+        bytes({0x41, 0x57});             // push r15
+        bytes({0x48, 0x83, 0xEC, 0x10}); // sub rsp, 16 (keeps the stack aligned)
+        bytes({0x48, 0x89, 0xFB});       // mov rbx, rdi
+        bytes({0x49, 0x89, 0xE4});       // mov r12, rsp
+        bytes({0x49, 0xBD});             // mov r13, imm64
+        value(code_written);
+        bytes({0x49, 0xBE});             // mov r14, imm64
+        value(next_event);
+        bytes({0x4D, 0x8B, 0x3E});       // mov r15, [r14]
+    }
+
+    void epilogue() {
+        bytes({0x48, 0x83, 0xC4, 0x10}); // add rsp, 16
+        bytes({0x41, 0x5F});             // pop r15
+        bytes({0x41, 0x5E});             // pop r14
+        bytes({0x41, 0x5D});             // pop r13
+        bytes({0x41, 0x5C});             // pop r12
+        bytes({0x5B});                   // pop rbx
+        bytes({0xC3});                   // ret
+    }
+
+    void addToCounter(int32_t cpu_offset, uint32_t amount) {
+        bytes({0x48, 0x81, 0x83});       // add qword [rbx + offset], imm32
+        value(cpu_offset);
+        value(amount);
+    }
+
+    void storeWord(int32_t cpu_offset, uint16_t word) {
+        bytes({0x66, 0xC7, 0x83});       // mov word [rbx + offset], imm16
+        value(cpu_offset);
+        value(word);
+    }
+
+    void storeOperand(uint32_t operand) {
+        bytes({0x41, 0xC7, 0x04, 0x24}); // mov dword [r12], imm32
+        value(operand);
+    }
+
+    // Calls function(cpu, first, second) and stores the result as the operand
+    void resolveOperand(const void* function, uint32_t first, uint32_t second) {
+        bytes({0x48, 0x89, 0xDF});       // mov rdi, rbx
+        bytes({0xBE});                   // mov esi, imm32
+        value(first);
+        bytes({0xBA});                   // mov edx, imm32
+        value(second);
+        call(function);
+        bytes({0x41, 0x89, 0x04, 0x24}); // mov [r12], eax
+    }
+
+    // Calls function(cpu, argument)
+    void callWith(const void* function, uint32_t argument) {
+        bytes({0x48, 0x89, 0xDF});       // mov rdi, rbx
+        bytes({0xBE});                   // mov esi, imm32
+        value(argument);
+        call(function);
+    }
+
+    // Calls handler(cpu, operand)
+    void callHandler(const void* handler) {
+        bytes({0x48, 0x89, 0xDF});       // mov rdi, rbx
+        bytes({0x4C, 0x89, 0xE6});       // mov rsi, r12
+        call(handler);
+    }
+
+    // Adds the operand's byte at operand_offset (a bool) to a CPU counter
+    void addOperandFlag(uint8_t operand_offset, int32_t cpu_offset) {
+        bytes({0x41, 0x0F, 0xB6, 0x44, 0x24, operand_offset}); // movzx eax, byte [r12 + offset]
+        bytes({0x48, 0x01, 0x83});       // add [rbx + offset], rax
+        value(cpu_offset);
+    }
+
+    // Jumps somewhere not yet emitted if code has been written. Returns the
+    // position to pass to patchJump() once the target is known
+    std::size_t jumpIfCodeWritten() {
+        bytes({0x49, 0x83, 0x7D, 0x00, 0x00}); // cmp qword [r13], 0
+        bytes({0x0F, 0x85});             // jne rel32
+        value(int32_t(0));
+        return size - sizeof(int32_t);
+    }
+
+    // As jumpIfCodeWritten(), if the CPU's bool at cpu_offset is set
+    std::size_t jumpIfSet(int32_t cpu_offset) {
+        bytes({0x80, 0xBB});             // cmp byte [rbx + offset], 0
+        value(cpu_offset);
+        bytes({0x00});
+        bytes({0x0F, 0x85});             // jne rel32
+        value(int32_t(0));
+        return size - sizeof(int32_t);
+    }
+
+    // As jumpIfCodeWritten(), if the next event has moved since the block
+    // started
+    std::size_t jumpIfNextEventMoved() {
+        bytes({0x4D, 0x3B, 0x3E});       // cmp r15, [r14]
+        bytes({0x0F, 0x85});             // jne rel32
+        value(int32_t(0));
+        return size - sizeof(int32_t);
+    }
+
+    void patchJump(std::size_t position) {
+        int32_t offset = size - (position + sizeof(int32_t));
+        memcpy(out + position, &offset, sizeof(offset));
+    }
+
+    std::size_t codeSize() const {
+        return size;
+    }
+
+private:
+    void call(const void* function) {
+        // Direct calls when the target is in reach, which it is when the code
+        // buffer was mapped near the program
+        int64_t offset = reinterpret_cast<intptr_t>(function) - reinterpret_cast<intptr_t>(out + size + 5);
+        if (offset == static_cast<int32_t>(offset)) {
+            bytes({0xE8});               // call rel32
+            value(static_cast<int32_t>(offset));
+            return;
+        }
+        bytes({0x48, 0xB8});             // mov rax, imm64
+        value(function);
+        bytes({0xFF, 0xD0});             // call rax
+    }
+
+    uint8_t* out;
+    std::size_t size;
+};
+
+// Upper bound on the code for one instruction, including its early exit
+constexpr std::size_t max_instruction_code = 192;
+// Upper bound on the prologue and the exit at the end of the block
+constexpr std::size_t max_block_overhead_code = 128;
+#endif
+
+bool isOneOf(const char* mnemonic, std::initializer_list<const char*> names) {
+    for (const char* name : names) {
+        if (strcmp(mnemonic, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Instructions that can change the program counter end a block. They are
+// also the only handlers that read the program counter
+bool endsBlock(const char* mnemonic) {
+    return isOneOf(mnemonic, {"BRK", "JMP", "JSR", "RTS", "RTI", "BPL", "BMI", "BVC", "BVS", "BCC", "BCS", "BNE", "BEQ"});
+}
+
+// Whether an instruction can write to memory, and so to cached code
+bool writesMemory(const char* mnemonic, bool memory_operand) {
+    if (isOneOf(mnemonic, {"PHA", "PHP"})) {
+        return true;
+    }
+    return memory_operand && isOneOf(mnemonic, {"STA", "STX", "STY", "ASL", "LSR", "ROL", "ROR", "INC", "DEC"});
+}
+} // namespace
+
+std::unique_ptr<Jit> Jit::create(CPU& cpu) {
+#if defined(__x86_64__)
+    // Ask for memory just below the program, so calls to handlers fit in rel32
+    uintptr_t program = reinterpret_cast<uintptr_t>(&Jit::resolveOperand) & ~uintptr_t(0xFFFFF);
+    void* hint = reinterpret_cast<void*>(program > (uintptr_t(1) << 30) ? program - (uintptr_t(1) << 30) : 0);
+    void* code_buffer = mmap(hint, code_buffer_size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code_buffer == MAP_FAILED) {
+        LOG_WARNING("Can't map memory for the JIT");
+        return nullptr;
+    }
+    return std::unique_ptr<Jit>(new Jit(cpu, static_cast<uint8_t*>(code_buffer)));
+#else
+    (void)cpu;
+    return nullptr;
+#endif
+}
+
+Jit::Jit(CPU& cpu, uint8_t* code_buffer)
+    : cpu(cpu), code_buffer(code_buffer), code_used(0), blocks_compiled(0), disabled(false) {}
+
+Jit::~Jit() {
+    munmap(code_buffer, code_buffer_size);
+}
+
+bool Jit::runBlock(uint64_t cycle_target) {
+    if (disabled) {
+        return false;
+    }
+    uint16_t start = cpu.program_counter;
+    const std::unique_ptr<BlockPage>& page = pages[start >> 8];
+    Block* block = page ? &(*page)[start & 0xFF] : nullptr;
+    if (!block || block->state == BlockState::UNCOMPILED) {
+        // Close to the target the interpreter steps into the middle of blocks,
+        // don't compile a new block from every one of those
+        if (cycle_target - cpu.cycle_count <= max_block_cycles) {
+            return false;
+        }
+        block = &compile(start);
+    }
+    if (block->state != BlockState::COMPILED || cpu.cycle_count + block->cycles_before_last >= cycle_target) {
+        return false;
+    }
+    block->code(&cpu);
+    return true;
+}
+
+void Jit::invalidate(uint64_t written_state_pages) {
+    if (written_state_pages == ~uint64_t(0)) {
+        flush();
+        return;
+    }
+    for (unsigned page = 0; page < PAGE_COUNT; ++page) {
+        if (!(cpu.memory_map.statePageBit(page) & written_state_pages)) {
+            continue;
+        }
+        pages[page].reset();
+        // Blocks from the page before may end in this one
+        if (page > 0) {
+            pages[page - 1].reset();
+        }
+    }
+}
+
+void Jit::flush() {
+    for (std::unique_ptr<BlockPage>& page : pages) {
+        page.reset();
+    }
+    code_used = 0;
+}
+
+uint32_t Jit::resolveOperand(CPU* cpu, uint32_t operand_bytes, uint32_t addressing_mode) {
+    CPU::Operand operand = cpu->getOperandFromMemory(static_cast<CPU::AddressingMode>(addressing_mode), operand_bytes);
+    uint32_t packed;
+    memcpy(&packed, &operand, sizeof(packed));
+    return packed;
+}
+
+void Jit::pollInterrupts(CPU* cpu, uint32_t opcode) {
+    // As processNextOpcode()
+    if (cpu->slow_path && (cpu->nmi_pending || cpu->irq_line)) {
+        cpu->pollInterrupts(opcode, cpu->processor_status);
+    }
+}
+
+Jit::Block& Jit::compile(uint16_t start) {
+#if defined(__x86_64__)
+    const std::size_t max_block_code = max_block_instructions * max_instruction_code + max_block_overhead_code;
+    if (code_buffer_size - code_used < max_block_code) {
+        flush();
+    }
+#endif
+    std::unique_ptr<BlockPage>& page = pages[start >> 8];
+    if (!page) {
+        page = std::make_unique<BlockPage>();
+        page->fill(Block{nullptr, 0, BlockState::UNCOMPILED});
+    }
+    Block& block = (*page)[start & 0xFF];
+    block.state = BlockState::INTERPRET;
+
+#if defined(__x86_64__)
+    static_assert(sizeof(CPU::Operand) == sizeof(uint32_t), "operands are passed around as 32-bit values");
+    auto cpuOffset = [this](const void* member) -> int32_t {
+        return static_cast<const uint8_t*>(member) - reinterpret_cast<const uint8_t*>(&cpu);
+    };
+    const int32_t program_counter_offset = cpuOffset(&cpu.program_counter);
+    const int32_t cycles_offset = cpuOffset(&cpu.cycle_count);
+    const int32_t instructions_offset = cpuOffset(&cpu.instruction_count);
+    const int32_t slow_path_offset = cpuOffset(&cpu.slow_path);
+    memory::MemoryMap& memory_map = cpu.memory_map;
+
+    // Only the pages being written are made writable, and only while compiling
+    const std::size_t host_page = sysconf(_SC_PAGESIZE);
+    uint8_t* protect_start = code_buffer + code_used / host_page * host_page;
+    std::size_t protect_size = (code_used + max_block_code + host_page - 1) / host_page * host_page -
+        (protect_start - code_buffer);
+    protect_size = std::min(protect_size, code_buffer_size - (protect_start - code_buffer));
+    if (mprotect(protect_start, protect_size, PROT_READ | PROT_WRITE) != 0) {
+        LOG_WARNING("Can't make JIT code writable, running the interpreter");
+        disabled = true;
+        return block;
+    }
+
+    // Early exits, emitted after the block: for writes to code, and after
+    // instructions that may have reached I/O for devices raising an
+    // interrupt, stalling the CPU or scheduling an event sooner
+    struct Exit {
+        std::size_t jumps[3];
+        unsigned jump_count;
+        uint16_t program_counter;
+        // Still to add, see cycles_added
+        uint32_t cycles;
+        uint32_t instructions;
+        // Polls for interrupts after the instruction, as the interpreter does
+        bool polls;
+        uint8_t opcode;
+    };
+    Exit exits[max_block_instructions];
+    unsigned exit_count = 0;
+
+    Emitter emitter(code_buffer + code_used);
+    emitter.prologue(memory_map.codeWrittenFlag(), cpu.event_scheduler.nextCycleAddress());
+    uint16_t program_counter = start;
+    uint32_t instructions = 0;
+    // Base cycles of the instructions so far; cycles for page crossings are
+    // added by the generated code as they happen
+    uint32_t cycles = 0;
+    // How many of those the generated code has added to the count so far
+    uint32_t cycles_added = 0;
+    uint32_t worst_case_cycles = 0;
+    uint32_t cycles_before_last = 0;
+    // Whether the last instruction compiled may have reached I/O
+    bool last_reaches_io = false;
+    uint8_t last_opcode = 0;
+    bool ended = !memory_map.hostPage(start >> 8);
+    while (!ended && instructions < max_block_instructions && (program_counter >> 8) == (start >> 8)) {
+        uint8_t opcode = memory_map.read(program_counter);
+        const CPU::OperationTuple& operation = CPU::opcodes_to_operations[opcode];
+        uint8_t length = CPU::instructionLength(operation.addressing_mode);
+        uint16_t next = program_counter + length;
+        // RTI is left to the interpreter, which polls for interrupts after it
+        if (operation.op == &CPU::ILLEGAL || operation.op == &CPU::RTI || !memory_map.hostPage((next - 1) >> 8)) {
+            break;
+        }
+        uint16_t operand_bytes = 0;
+        for (uint8_t i = 1; i < length; ++i) {
+            operand_bytes |= memory_map.read(program_counter + i) << (8 * (i - 1));
+        }
+
+        bool fixed_operand = true;
+        CPU::Operand operand{0, operation.addressing_mode, false};
+        switch (operation.addressing_mode)
+        {
+        case CPU::AddressingMode::IMPLIED:
+        case CPU::AddressingMode::ACCUMULATOR:
+            break;
+        case CPU::AddressingMode::IMMEDIATE:
+            operand.address = program_counter + 1;
+            break;
+        case CPU::AddressingMode::ZERO_PAGE:
+            operand.address = operand_bytes & 0xFF;
+            break;
+        case CPU::AddressingMode::ABSOLUTE:
+            operand.address = operand_bytes;
+            break;
+        case CPU::AddressingMode::RELATIVE:
+            operand.address = next + static_cast<int8_t>(operand_bytes);
+            operand.crossed_page_boundary = (next ^ operand.address) & 0xFF00;
+            break;
+        default:
+            fixed_operand = false;
+            break;
+        }
+        // Leave I/O accesses to the interpreter
+        if (fixed_operand && operation.addressing_mode != CPU::AddressingMode::RELATIVE &&
+            !memory_map.hostPage(operand.address >> 8)) {
+            break;
+        }
+        // Blocks don't poll for interrupts, so they also end where one could
+        // become unmasked
+        ended = endsBlock(operation.mnemonic) || isOneOf(operation.mnemonic, {"CLI", "PLP"});
+
+        if (ended) {
+            // Handlers see the program counter already past the instruction,
+            // as in CPU::exec(). Only these ones look at it, the rest
+            // of the block leaves it to the exits
+            emitter.storeWord(program_counter_offset, next);
+        }
+        if (!fixed_operand) {
+            emitter.resolveOperand(reinterpret_cast<const void*>(&Jit::resolveOperand), operand_bytes,
+                static_cast<uint32_t>(operation.addressing_mode));
+            if (operation.plus_if_crossed_page_boundary) {
+                emitter.addOperandFlag(offsetof(CPU::Operand, crossed_page_boundary), cycles_offset);
+            }
+            // The operand may turn out to be I/O, whose device catches up to
+            // the cycle count. Bring it to the instruction's last cycle, where
+            // CPU::exec() has it while the operation runs
+            uint32_t last_cycle = cycles + operation.cycles - 1;
+            emitter.addToCounter(cycles_offset, last_cycle - cycles_added);
+            cycles_added = last_cycle;
+        }
+        else if (operation.addressing_mode != CPU::AddressingMode::IMPLIED) {
+            uint32_t packed;
+            memcpy(&packed, &operand, sizeof(packed));
+            emitter.storeOperand(packed);
+        }
+        emitter.callHandler(reinterpret_cast<const void*>(operation.op));
+
+        cycles_before_last = worst_case_cycles;
+        cycles += operation.cycles;
+        worst_case_cycles += operation.cycles;
+        if (operation.plus_if_crossed_page_boundary && !fixed_operand) {
+            ++worst_case_cycles;
+        }
+        memory_map.watchCode(program_counter >> 8);
+        memory_map.watchCode((next - 1) >> 8);
+        // As when decoding for the interpreter. Only an early exit keeps the
+        // rest of the block from running
+        memory_map.logCode(program_counter, length);
+        ++instructions;
+        program_counter = next;
+
+        last_reaches_io = !fixed_operand;
+        last_opcode = opcode;
+        if (ended) {
+            continue;
+        }
+        bool memory_operand = operation.addressing_mode != CPU::AddressingMode::ACCUMULATOR &&
+            operation.addressing_mode != CPU::AddressingMode::IMPLIED;
+        Exit exit{{}, 0, program_counter, cycles - cycles_added, instructions, !fixed_operand, opcode};
+        if (writesMemory(operation.mnemonic, memory_operand)) {
+            exit.jumps[exit.jump_count++] = emitter.jumpIfCodeWritten();
+        }
+        if (!fixed_operand) {
+            exit.jumps[exit.jump_count++] = emitter.jumpIfSet(slow_path_offset);
+            exit.jumps[exit.jump_count++] = emitter.jumpIfNextEventMoved();
+        }
+        if (exit.jump_count) {
+            exits[exit_count++] = exit;
+        }
+    }
+    if (!ended) {
+        emitter.storeWord(program_counter_offset, program_counter);
+    }
+    emitter.addToCounter(cycles_offset, cycles - cycles_added);
+    emitter.addToCounter(instructions_offset, instructions);
+    if (last_reaches_io) {
+        emitter.callWith(reinterpret_cast<const void*>(&Jit::pollInterrupts), last_opcode);
+    }
+    emitter.epilogue();
+    for (unsigned i = 0; i < exit_count; ++i) {
+        for (unsigned jump = 0; jump < exits[i].jump_count; ++jump) {
+            emitter.patchJump(exits[i].jumps[jump]);
+        }
+        emitter.storeWord(program_counter_offset, exits[i].program_counter);
+        emitter.addToCounter(cycles_offset, exits[i].cycles);
+        emitter.addToCounter(instructions_offset, exits[i].instructions);
+        if (exits[i].polls) {
+            emitter.callWith(reinterpret_cast<const void*>(&Jit::pollInterrupts), exits[i].opcode);
+        }
+        emitter.epilogue();
+    }
+    std::size_t code_size = emitter.codeSize();
+    if (mprotect(protect_start, protect_size, PROT_READ | PROT_EXEC) != 0) {
+        // Blocks already compiled on these pages can't run either
+        LOG_WARNING("Can't make JIT code executable, running the interpreter");
+        disabled = true;
+        return block;
+    }
+
+    if (instructions > 0) {
+        block.code = reinterpret_cast<BlockCode>(code_buffer + code_used);
+        block.cycles_before_last = cycles_before_last;
+        block.state = BlockState::COMPILED;
+        code_used += code_size;
+        ++blocks_compiled;
+    }
+#endif
+    return block;
+}
+} // cpu::
@@ -1,25 +1,204 @@
-#include "CPU.h"
+#include <utility>
+
+#include "Opcodes.h"
 
 // File to hold CPU operations, because CPU.cpp is too big as it is
 
 namespace cpu {
+// The handlers are shared with step(), and with twice the call sites GCC
+// stops inlining the bigger ones here unless told to
+template <CPU::Operator OP, CPU::AddressingMode MODE, uint8_t CYCLES, bool PLUS_IF_CROSSED_PAGE_BOUNDARY>
+[[gnu::flatten]] void CPU::exec(CPU& cpu_, const DecodedInstruction& instruction) {
+    Operand operand = cpu_.getOperandFromMemory<MODE>(instruction.operand_bytes);
+    // Step over the instruction before running it, so operations that jump can
+    // simply overwrite the program counter
+    cpu_.program_counter += instructionLength(MODE);
+    uint8_t cycles = CYCLES;
+    if constexpr (PLUS_IF_CROSSED_PAGE_BOUNDARY) {
+        cycles += operand.crossed_page_boundary;
+    }
+    // The operation's own bus accesses happen in the instruction's last cycle,
+    // where the 6502 mostly makes them. Storing the end rather than adding the
+    // last cycle keeps the count out of a read-modify-write chain
+    uint64_t end = cpu_.cycle_count + cycles;
+    cpu_.cycle_count = end - 1;
+    OP(cpu_, operand);
+    if constexpr (MODE == AddressingMode::RELATIVE) {
+        // Taken branches add their extra cycles themselves
+        ++cpu_.cycle_count;
+    }
+    else {
+        cpu_.cycle_count = end;
+    }
+    if constexpr (OP == &CPU::RTI) {
+        // Taking an interrupt twice is harmless: the first sets INTERRUPT
+        if (cpu_.slow_path) {
+            cpu_.pollInterrupts(0x40, cpu_.processor_status);
+        }
+    }
+}
+
+template <CPU::AddressingMode MODE, bool WRITES>
+CPU::Operand CPU::fetchOperand() {
+    Operand operand{0, MODE, false};
+
+    auto fetchAddress = [this]() -> uint16_t {
+        uint8_t low_byte = stepRead(program_counter + 1);
+        return stepRead(program_counter + 2) << 8 | low_byte;
+    };
+    auto readZeroPageAddress = [this](uint8_t zero_page_address) -> uint16_t {
+        uint8_t low_byte = stepRead(zero_page_address);
+        return stepRead(static_cast<uint8_t>(zero_page_address + 1)) << 8 | low_byte;
+    };
+    // Indexing adds to the low byte first and reads from that address before
+    // carrying into the high byte. A read that needed no carry is done there
+    // and then (by the operation); anything else reads again
+    auto index = [this, &operand](uint16_t base, uint8_t offset) {
+        operand.address = base + offset;
+        operand.crossed_page_boundary = (base ^ operand.address) & 0xFF00;
+        if (WRITES || operand.crossed_page_boundary) {
+            stepRead((base & 0xFF00) | (operand.address & 0xFF));
+        }
+    };
+
+    if constexpr (MODE == AddressingMode::IMPLIED || MODE == AddressingMode::ACCUMULATOR) {
+        // The byte after the opcode is read and ignored
+        stepRead(program_counter + 1);
+    }
+    else if constexpr (MODE == AddressingMode::IMMEDIATE) {
+        // Read by the operation
+        operand.address = program_counter + 1;
+    }
+    else if constexpr (MODE == AddressingMode::ZERO_PAGE) {
+        operand.address = stepRead(program_counter + 1);
+    }
+    else if constexpr (MODE == AddressingMode::ZERO_PAGE_INDEXED_X || MODE == AddressingMode::ZERO_PAGE_INDEXED_Y) {
+        // The unindexed address is read while the index is added
+        uint8_t base = stepRead(program_counter + 1);
+        stepRead(base);
+        operand.address = static_cast<uint8_t>(base + (MODE == AddressingMode::ZERO_PAGE_INDEXED_X ? X : Y));
+    }
+    else if constexpr (MODE == AddressingMode::ABSOLUTE) {
+        operand.address = fetchAddress();
+    }
+    else if constexpr (MODE == AddressingMode::INDEXED_X) {
+        index(fetchAddress(), X);
+    }
+    else if constexpr (MODE == AddressingMode::INDEXED_Y) {
+        index(fetchAddress(), Y);
+    }
+    else if constexpr (MODE == AddressingMode::PRE_INDEXED_INDIRECT) {
+        uint8_t pointer = stepRead(program_counter + 1);
+        stepRead(pointer);
+        operand.address = readZeroPageAddress(pointer + X);
+    }
+    else if constexpr (MODE == AddressingMode::POST_INDEXED_INDIRECT) {
+        uint8_t pointer = stepRead(program_counter + 1);
+        index(readZeroPageAddress(pointer), Y);
+    }
+    else if constexpr (MODE == AddressingMode::INDIRECT) {
+        uint16_t pointer = fetchAddress();
+        uint8_t low_byte = read(pointer);
+        operand.address = read((pointer & 0xFF00) | static_cast<uint8_t>(pointer + 1)) << 8 | low_byte;
+        memory_map.logAccess(operand.address, memory::CodeDataLog::INDIRECT_CODE);
+    }
+    else if constexpr (MODE == AddressingMode::RELATIVE) {
+        uint8_t offset = stepRead(program_counter + 1);
+        uint16_t next_instruction = program_counter + 2;
+        operand.address = next_instruction + static_cast<int8_t>(offset);
+        operand.crossed_page_boundary = (next_instruction ^ operand.address) & 0xFF00;
+    }
+    return operand;
+}
+
+template <CPU::Operator OP, CPU::AddressingMode MODE, uint8_t, bool>
+void CPU::step(CPU& cpu_) {
+    constexpr bool READ_MODIFY_WRITE = MODE != AddressingMode::ACCUMULATOR &&
+        (OP == &CPU::ASL || OP == &CPU::LSR || OP == &CPU::ROL || OP == &CPU::ROR || OP == &CPU::INC || OP == &CPU::DEC);
+    constexpr bool WRITES = READ_MODIFY_WRITE || OP == &CPU::STA || OP == &CPU::STX || OP == &CPU::STY;
+
+    if constexpr (OP == &CPU::ILLEGAL) {
+        // Only the opcode fetch has happened, as in exec()
+        Operand operand{0, MODE, false};
+        cpu_.program_counter += instructionLength(MODE);
+        OP(cpu_, operand);
+    }
+    else if constexpr (OP == &CPU::JSR) {
+        // JSR fetches the high byte of the target last, after pushing the
+        // return address
+        uint16_t high_byte_address = cpu_.program_counter + 2;
+        Operand operand{cpu_.stepRead(cpu_.program_counter + 1), MODE, false};
+        cpu_.stepRead(cpu_.stack_pointer);
+        cpu_.program_counter += instructionLength(MODE);
+        OP(cpu_, operand);
+        cpu_.program_counter |= cpu_.stepRead(high_byte_address) << 8;
+    }
+    else {
+        Operand operand = cpu_.fetchOperand<MODE, WRITES>();
+        if constexpr (OP == &CPU::PLA || OP == &CPU::PLP || OP == &CPU::RTS || OP == &CPU::RTI) {
+            // The top of the stack is read while the stack pointer is incremented
+            cpu_.stepRead(cpu_.stack_pointer);
+        }
+        cpu_.program_counter += instructionLength(MODE);
+        OP(cpu_, operand);
+        if constexpr (OP == &CPU::RTS) {
+            // The return address is read again while it is incremented
+            cpu_.stepRead(cpu_.program_counter - 1);
+        }
+    }
+}
+
+constexpr CPU::ExecutorTable CPU::buildExecutorTable() {
+    ExecutorTable table{};
+    table.fill(&exec<CPU::ILLEGAL, AddressingMode::IMPLIED, 2, false>);
+    [&table]<std::size_t... I>(std::index_sequence<I...>) {
+        constexpr OpcodeList opcodes = describeOpcodes();
+        ((table[opcodes[I].first] = &exec<opcodes[I].second.op, opcodes[I].second.addressing_mode,
+            opcodes[I].second.cycles, opcodes[I].second.plus_if_crossed_page_boundary>), ...);
+    }(std::make_index_sequence<std::tuple_size_v<OpcodeList>>());
+    return table;
+}
+
+constinit const CPU::ExecutorTable CPU::executors = CPU::buildExecutorTable();
+
+constexpr CPU::SteppedExecutorTable CPU::buildSteppedExecutorTable() {
+    SteppedExecutorTable table{};
+    table.fill(&step<CPU::ILLEGAL, AddressingMode::IMPLIED, 2, false>);
+    [&table]<std::size_t... I>(std::index_sequence<I...>) {
+        constexpr OpcodeList opcodes = describeOpcodes();
+        ((table[opcodes[I].first] = &step<opcodes[I].second.op, opcodes[I].second.addressing_mode,
+            opcodes[I].second.cycles, opcodes[I].second.plus_if_crossed_page_boundary>), ...);
+    }(std::make_index_sequence<std::tuple_size_v<OpcodeList>>());
+    return table;
+}
+
+constinit const CPU::SteppedExecutorTable CPU::stepped_executors = CPU::buildSteppedExecutorTable();
+
 /**
- * @brief Causes a non-maskable interrupt and increments the program counter by one
+ * @brief Slot for opcodes with no operation defined, reports the offending opcode
  * 
  * @param cpu_
  */
-void CPU::BRK(CPU& cpu_, Operand&) {
-    // Increment program counter and push to stack
-    cpu_.pushToStack(cpu_.program_counter + 2);
+void CPU::ILLEGAL(CPU& cpu_, Operand&) {
+    // The program counter has already stepped over the opcode
+    throw opcodeException(cpu_.memory_map.read(cpu_.program_counter - 1));
+}
 
-    // Set interrupt flag, push status reg to stack
-    cpu_.processor_status.set(pFlag::INTERRUPT);
+/**
+ * @brief Software interrupt, jumps through the IRQ vector
+ * 
+ * @param cpu_
+ */
+void CPU::BRK(CPU& cpu_, Operand&) {
+    // Skip the padding byte after BRK and push program counter to stack
+    cpu_.pushAddressToStack(cpu_.program_counter + 1);
 
-    cpu_.pushToStack(static_cast<uint8_t>(cpu_.processor_status.to_ulong()));
+    // Push status reg to stack with the break flag set, then mask interrupts
+    cpu_.pushToStack(cpu_.processorStatus() | flagBit(pFlag::BREAK) | flagBit(pFlag::ALWAYS1));
+    cpu_.processor_status |= flagBit(pFlag::INTERRUPT);
 
     //Reload program counter
-    cpu_.program_counter = 
-        *cpu_.memory_map.immediateRead(0xFFFF) << 8 | *cpu_.memory_map.immediateRead(0xFFFE);
+    cpu_.program_counter = cpu_.readAddress(IRQ_VECTOR);
 }
 
 /**
@@ -29,9 +208,8 @@ void CPU::BRK(CPU& cpu_, Operand&) {
  * @param operand
  */
 void CPU::ORA(CPU& cpu_, Operand& operand) {
-    cpu_.accumulator |= operand;
-    cpu_.processor_status.set(pFlag::NEGATIVE, cpu_.accumulator.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
+    cpu_.accumulator |= cpu_.readOperand(operand);
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator;
 }
 
 /**
@@ -41,11 +219,12 @@ void CPU::ORA(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::ASL(CPU& cpu_, Operand& operand) {
-    // Set carry flag to value of bit 7
-    cpu_.processor_status.set(pFlag::CARRY, operand.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
-    operand <<= 1;
-    cpu_.processor_status.set(pFlag::NEGATIVE, operand.test(7));
+    uint8_t original = cpu_.readOperand(operand);
+    // Bit 7 shifts out into the carry flag
+    cpu_.carry_result = original << 1;
+    uint8_t value = original << 1;
+    cpu_.writeModifiedOperand(operand, original, value);
+    cpu_.negative_result = cpu_.zero_result = value;
 }
 
 /**
@@ -55,8 +234,8 @@ void CPU::ASL(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::PHP(CPU& cpu_, Operand&) {
-    cpu_.pushToStack(static_cast<uint8_t>(cpu_.processor_status.to_ulong()));
-    cpu_.program_counter++;
+    // The copy pushed always has the break flag set
+    cpu_.pushToStack(cpu_.processorStatus() | flagBit(pFlag::BREAK) | flagBit(pFlag::ALWAYS1));
 }
 
 /**
@@ -66,10 +245,8 @@ void CPU::PHP(CPU& cpu_, Operand&) {
  * @param operand
  */
 void CPU::AND(CPU& cpu_, Operand& operand) {
-    cpu_.accumulator &= operand;
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
-    // Store bit 7 in negative flag
-    cpu_.processor_status.set(pFlag::NEGATIVE, operand.test(7));
+    cpu_.accumulator &= cpu_.readOperand(operand);
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator;
 }
 
 
@@ -80,11 +257,11 @@ void CPU::AND(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::BIT(CPU& cpu_, Operand& operand) {
-    std::bitset<8> result = operand & cpu_.accumulator;
-    cpu_.processor_status.set(pFlag::ZERO, result == 0);
+    uint8_t value = cpu_.readOperand(operand);
+    cpu_.zero_result = value & cpu_.accumulator;
     // Store bits 6 and 7 in overflow and negative flags resp.
-    cpu_.processor_status.set(pFlag::OVERFLOW, operand.test(6));
-    cpu_.processor_status.set(pFlag::NEGATIVE, operand.test(7));
+    cpu_.overflow_result = value << 1;
+    cpu_.negative_result = value;
 }
 
 /**
@@ -94,16 +271,15 @@ void CPU::BIT(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::ROL(CPU& cpu_, Operand& operand) {
+    uint8_t original = cpu_.readOperand(operand);
     // Store value of carry flag
-    bool old_carry_flag = cpu_.processor_status.test(pFlag::CARRY);
+    uint8_t old_carry_flag = cpu_.carry_result >> 8 & 1;
     // Store bit 7 of the operand in the carry flag
-    cpu_.processor_status.set(pFlag::CARRY, operand.test(7));
-    // Shift operand left
-    operand <<= 1;
-    // Set bit 0 of the operand to the old value of the carry flag
-    operand.set(0, old_carry_flag);
-    cpu_.processor_status.set(pFlag::NEGATIVE, operand.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
+    cpu_.carry_result = original << 1;
+    // Shift operand left, setting bit 0 to the old value of the carry flag
+    uint8_t value = original << 1 | old_carry_flag;
+    cpu_.writeModifiedOperand(operand, original, value);
+    cpu_.negative_result = cpu_.zero_result = value;
 }
 
 /**
@@ -113,9 +289,8 @@ void CPU::ROL(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::EOR(CPU& cpu_, Operand& operand) {
-    cpu_.accumulator ^= operand;
-    cpu_.processor_status.set(pFlag::NEGATIVE, cpu_.accumulator.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
+    cpu_.accumulator ^= cpu_.readOperand(operand);
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator;
 }
 
 /**
@@ -125,10 +300,11 @@ void CPU::EOR(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::LSR(CPU& cpu_, Operand& operand) {
-    cpu_.processor_status.set(pFlag::CARRY, operand.test(0));
-    operand >>= 1;
-    cpu_.processor_status.set(pFlag::NEGATIVE, operand.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, operand == 0);
+    uint8_t original = cpu_.readOperand(operand);
+    cpu_.carry_result = (original & 1) << 8;
+    uint8_t value = original >> 1;
+    cpu_.writeModifiedOperand(operand, original, value);
+    cpu_.negative_result = cpu_.zero_result = value;
 }
 
 /**
@@ -138,31 +314,475 @@ void CPU::LSR(CPU& cpu_, Operand& operand) {
  * @param operand
  */
 void CPU::ADC(CPU& cpu_, Operand& operand) {
-    // Check if addition results in a signed int outside of the bounds of an 8 bit signed int
-    int16_t result_signed_int = static_cast<int8_t>(operand.to_ulong()) +
-                    static_cast<int8_t>(cpu_.accumulator.to_ulong()) +
-                    cpu_.processor_status.test(pFlag::CARRY);
+    uint8_t value = cpu_.readOperand(operand);
+    uint16_t sum = cpu_.accumulator + value + (cpu_.carry_result >> 8 & 1);
+    // Overflow when both inputs have the same sign and the result doesn't
+    cpu_.overflow_result = (cpu_.accumulator ^ sum) & (value ^ sum);
+    // Bit 8 of the sum is the carry out of bit 7
+    cpu_.carry_result = sum;
+    cpu_.accumulator = sum;
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator;
+}
 
-    cpu_.processor_status.set(pFlag::OVERFLOW, 
-                            result_signed_int < INT8_MIN || result_signed_int > INT8_MAX);
+void CPU::ROR(CPU& cpu_, Operand& operand) {
+    uint8_t original = cpu_.readOperand(operand);
+    uint8_t old_carry_flag = cpu_.carry_result >> 8 & 1;
+    cpu_.carry_result = (original & 1) << 8;
+    // Shift right, setting bit 7 of the operand to the old value of the carry flag
+    uint8_t value = original >> 1 | old_carry_flag << 7;
+    cpu_.writeModifiedOperand(operand, original, value);
+    cpu_.negative_result = cpu_.zero_result = value;
+}
 
-    // Now check if bit 7 has overflowed, i.e any of bits 8 or higher are set
-    auto result_unsigned_int = static_cast<uint16_t>(result_signed_int);
-    cpu_.processor_status.set(pFlag::CARRY, result_unsigned_int > UINT8_MAX);
+/**
+ * @brief Branch if result plus, i.e. negative flag clear
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BPL(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, !(cpu_.negative_result & 0x80));
+}
 
-    // Now set accumulator to this value, overflowed as an 8 bit unsigned int
-    cpu_.accumulator = result_unsigned_int % UINT8_MAX;
-    cpu_.processor_status.set(pFlag::NEGATIVE, cpu_.accumulator.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
+/**
+ * @brief Clear carry flag
+ * 
+ * @param cpu_
+ */
+void CPU::CLC(CPU& cpu_, Operand&) {
+    cpu_.carry_result = 0;
 }
 
-void CPU::ROR(CPU& cpu_, Operand& operand) {
-    bool old_carry_flag = cpu_.processor_status.test(pFlag::CARRY);
-    cpu_.processor_status.set(pFlag::CARRY, operand.test(0));
-    operand >>=1;
-    // Set bit 7 of the operand to the old value of the carry flag
-    operand.set(7, old_carry_flag);
-    cpu_.processor_status.set(pFlag::NEGATIVE, operand.test(7));
-    cpu_.processor_status.set(pFlag::ZERO, cpu_.accumulator == 0);
-}
-}
\ No newline at end of file
+/**
+ * @brief Jump to subroutine
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::JSR(CPU& cpu_, Operand& operand) {
+    // The address pushed is that of the last byte of the JSR, RTS adds one
+    uint16_t last_byte = cpu_.program_counter - 1;
+    cpu_.pushAddressToStack(last_byte);
+    if (!cpu_.cycle_stepped) {
+        // The 6502 fetches the high byte of the target after the push, which
+        // can overwrite it when the JSR runs from the stack page. step()
+        // fetches it itself
+        operand.address = cpu_.memory_map.read(last_byte) << 8 | (operand.address & 0xFF);
+    }
+    cpu_.program_counter = operand.address;
+}
+
+/**
+ * @brief Branch if result minus, i.e. negative flag set
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BMI(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, cpu_.negative_result & 0x80);
+}
+
+/**
+ * @brief Set carry flag
+ * 
+ * @param cpu_
+ */
+void CPU::SEC(CPU& cpu_, Operand&) {
+    cpu_.carry_result = 0x100;
+}
+
+/**
+ * @brief Return from interrupt, restoring the status register and program counter
+ * 
+ * @param cpu_
+ */
+void CPU::RTI(CPU& cpu_, Operand&) {
+    cpu_.setProcessorStatus(cpu_.pullFromStack());
+    cpu_.program_counter = cpu_.pullAddressFromStack();
+    cpu_.updateSlowPath();
+}
+
+/**
+ * @brief Jump to the operand's address
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::JMP(CPU& cpu_, Operand& operand) {
+    cpu_.program_counter = operand.address;
+}
+
+/**
+ * @brief Branch if overflow clear
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BVC(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, !(cpu_.overflow_result & 0x80));
+}
+
+/**
+ * @brief Clear interrupt disable flag
+ * 
+ * @param cpu_
+ */
+void CPU::CLI(CPU& cpu_, Operand&) {
+    cpu_.processor_status &= ~flagBit(pFlag::INTERRUPT);
+    cpu_.updateSlowPath();
+}
+
+/**
+ * @brief Return from subroutine
+ * 
+ * @param cpu_
+ */
+void CPU::RTS(CPU& cpu_, Operand&) {
+    cpu_.program_counter = cpu_.pullAddressFromStack() + 1;
+}
+
+/**
+ * @brief Pull accumulator from stack
+ * 
+ * @param cpu_
+ */
+void CPU::PLA(CPU& cpu_, Operand&) {
+    cpu_.accumulator = cpu_.pullFromStack();
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator;
+}
+
+/**
+ * @brief Branch if overflow set
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BVS(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, cpu_.overflow_result & 0x80);
+}
+
+/**
+ * @brief Set interrupt disable flag
+ * 
+ * @param cpu_
+ */
+void CPU::SEI(CPU& cpu_, Operand&) {
+    cpu_.processor_status |= flagBit(pFlag::INTERRUPT);
+    cpu_.updateSlowPath();
+}
+
+/**
+ * @brief Store accumulator
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::STA(CPU& cpu_, Operand& operand) {
+    cpu_.writeOperand(operand, cpu_.accumulator);
+}
+
+/**
+ * @brief Store Y register
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::STY(CPU& cpu_, Operand& operand) {
+    cpu_.writeOperand(operand, cpu_.Y);
+}
+
+/**
+ * @brief Store X register
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::STX(CPU& cpu_, Operand& operand) {
+    cpu_.writeOperand(operand, cpu_.X);
+}
+
+/**
+ * @brief Decrement Y register
+ * 
+ * @param cpu_
+ */
+void CPU::DEY(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = --cpu_.Y;
+}
+
+/**
+ * @brief Transfer X register to accumulator
+ * 
+ * @param cpu_
+ */
+void CPU::TXA(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator = cpu_.X;
+}
+
+/**
+ * @brief Branch if carry clear
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BCC(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, !(cpu_.carry_result & 0x100));
+}
+
+/**
+ * @brief Transfer Y register to accumulator
+ * 
+ * @param cpu_
+ */
+void CPU::TYA(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator = cpu_.Y;
+}
+
+/**
+ * @brief Transfer X register to stack pointer, leaves the flags alone
+ * 
+ * @param cpu_
+ */
+void CPU::TXS(CPU& cpu_, Operand&) {
+    cpu_.stack_pointer = STACK_END | cpu_.X;
+}
+
+/**
+ * @brief Load Y register
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::LDY(CPU& cpu_, Operand& operand) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.Y = cpu_.readOperand(operand);
+}
+
+/**
+ * @brief Load accumulator
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::LDA(CPU& cpu_, Operand& operand) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator = cpu_.readOperand(operand);
+}
+
+/**
+ * @brief Load X register
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::LDX(CPU& cpu_, Operand& operand) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.X = cpu_.readOperand(operand);
+}
+
+/**
+ * @brief Transfer accumulator to Y register
+ * 
+ * @param cpu_
+ */
+void CPU::TAY(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.Y = cpu_.accumulator;
+}
+
+/**
+ * @brief Branch if carry set
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BCS(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, cpu_.carry_result & 0x100);
+}
+
+/**
+ * @brief Clear overflow flag
+ * 
+ * @param cpu_
+ */
+void CPU::CLV(CPU& cpu_, Operand&) {
+    cpu_.overflow_result = 0;
+}
+
+/**
+ * @brief Transfer accumulator to X register
+ * 
+ * @param cpu_
+ */
+void CPU::TAX(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.X = cpu_.accumulator;
+}
+
+/**
+ * @brief Transfer stack pointer to X register
+ * 
+ * @param cpu_
+ */
+void CPU::TSX(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = cpu_.X = static_cast<uint8_t>(cpu_.stack_pointer);
+}
+
+/**
+ * @brief Compare with Y register
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::CPY(CPU& cpu_, Operand& operand) {
+    cpu_.compare(cpu_.Y, operand);
+}
+
+/**
+ * @brief Compare with accumulator
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::CMP(CPU& cpu_, Operand& operand) {
+    cpu_.compare(cpu_.accumulator, operand);
+}
+
+/**
+ * @brief Decrement memory
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::DEC(CPU& cpu_, Operand& operand) {
+    uint8_t original = cpu_.readOperand(operand);
+    uint8_t value = original - 1;
+    cpu_.writeModifiedOperand(operand, original, value);
+    cpu_.negative_result = cpu_.zero_result = value;
+}
+
+/**
+ * @brief Increment Y register
+ * 
+ * @param cpu_
+ */
+void CPU::INY(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = ++cpu_.Y;
+}
+
+/**
+ * @brief Pull processor status from stack
+ * 
+ * @param cpu_
+ */
+void CPU::PLP(CPU& cpu_, Operand&) {
+    cpu_.setProcessorStatus(cpu_.pullFromStack());
+    cpu_.updateSlowPath();
+}
+
+/**
+ * @brief Push accumulator to stack
+ * 
+ * @param cpu_
+ */
+void CPU::PHA(CPU& cpu_, Operand&) {
+    cpu_.pushToStack(cpu_.accumulator);
+}
+
+/**
+ * @brief Decrement X register
+ * 
+ * @param cpu_
+ */
+void CPU::DEX(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = --cpu_.X;
+}
+
+/**
+ * @brief Branch if not equal, i.e. zero flag clear
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BNE(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, cpu_.zero_result != 0);
+}
+
+/**
+ * @brief Clear decimal flag. The NES CPU has no decimal mode, but the flag
+ * can still be set and read
+ * 
+ * @param cpu_
+ */
+void CPU::CLD(CPU& cpu_, Operand&) {
+    cpu_.processor_status &= ~flagBit(pFlag::DECIMAL);
+}
+
+/**
+ * @brief Compare with X register
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::CPX(CPU& cpu_, Operand& operand) {
+    cpu_.compare(cpu_.X, operand);
+}
+
+/**
+ * @brief Subtract from the accumulator, with borrow (the inverse of carry)
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::SBC(CPU& cpu_, Operand& operand) {
+    // A - M - !C is A + ~M + C
+    uint8_t value = ~cpu_.readOperand(operand);
+    uint16_t sum = cpu_.accumulator + value + (cpu_.carry_result >> 8 & 1);
+    // Overflow when both inputs have the same sign and the result doesn't
+    cpu_.overflow_result = (cpu_.accumulator ^ sum) & (value ^ sum);
+    cpu_.carry_result = sum;
+    cpu_.accumulator = sum;
+    cpu_.negative_result = cpu_.zero_result = cpu_.accumulator;
+}
+
+/**
+ * @brief Increment memory
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::INC(CPU& cpu_, Operand& operand) {
+    uint8_t original = cpu_.readOperand(operand);
+    uint8_t value = original + 1;
+    cpu_.writeModifiedOperand(operand, original, value);
+    cpu_.negative_result = cpu_.zero_result = value;
+}
+
+/**
+ * @brief Increment X register
+ * 
+ * @param cpu_
+ */
+void CPU::INX(CPU& cpu_, Operand&) {
+    cpu_.negative_result = cpu_.zero_result = ++cpu_.X;
+}
+
+/**
+ * @brief No operation
+ */
+void CPU::NOP(CPU&, Operand&) {}
+
+/**
+ * @brief Branch if equal, i.e. zero flag set
+ * 
+ * @param cpu_
+ * @param operand
+ */
+void CPU::BEQ(CPU& cpu_, Operand& operand) {
+    cpu_.branch(operand, cpu_.zero_result == 0);
+}
+
+/**
+ * @brief Set decimal flag
+ * 
+ * @param cpu_
+ */
+void CPU::SED(CPU& cpu_, Operand&) {
+    cpu_.processor_status |= flagBit(pFlag::DECIMAL);
+}
+} // cpu::
@@ -0,0 +1,164 @@
+#include "Profiler.h"
+#include "CPU.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cpu {
+
+namespace {
+// Opens path for writing or throws
+FILE* create(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Can't create " + path);
+    }
+    return file;
+}
+
+void finish(FILE* file, const std::string& path) {
+    bool failed = ferror(file);
+    failed |= fclose(file) != 0;
+    if (failed) {
+        throw std::runtime_error("Can't write " + path);
+    }
+}
+
+Profiler::Clock::duration measureTimerOverhead() {
+    Profiler::Clock::duration overhead = Profiler::Clock::duration::max();
+    for (int i = 0; i < 1000; ++i) {
+        auto start = Profiler::Clock::now();
+        overhead = std::min(overhead, Profiler::Clock::now() - start);
+    }
+    return overhead;
+}
+} // namespace
+
+Profiler::Profiler(unsigned sample_interval)
+    : sample_interval(std::max(sample_interval, 1u)), countdown(this->sample_interval),
+      timer_overhead(measureTimerOverhead()), opcodes{}, address_counts(0x10000, 0), samples(0) {
+    call_nodes.push_back({0, 0, 0});
+    frames.reserve(max_depth);
+}
+
+void Profiler::recordSample(uint8_t opcode, uint16_t program_counter, uint8_t cycles, Clock::duration host_time) {
+    host_time = std::max(host_time - timer_overhead, Clock::duration::zero());
+    OpcodeStats& stats = opcodes[opcode];
+    ++stats.count;
+    stats.cycles += cycles;
+    stats.host_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(host_time).count();
+    ++address_counts[program_counter];
+    call_nodes[currentNode()].cycles += cycles;
+    ++samples;
+}
+
+void Profiler::enterCall(uint16_t target, uint8_t stack_pointer) {
+    if (frames.size() == max_depth) {
+        return;
+    }
+    uint32_t parent = currentNode();
+    auto [child, inserted] = call_children.try_emplace(uint64_t(parent) << 16 | target, call_nodes.size());
+    if (inserted) {
+        call_nodes.push_back({parent, target, 0});
+    }
+    frames.push_back({child->second, stack_pointer});
+}
+
+void Profiler::setDeviceTime(const std::string& device, uint64_t host_ns, uint64_t frames) {
+    for (DeviceTime& time : device_times) {
+        if (time.device == device) {
+            time = {device, host_ns, frames};
+            return;
+        }
+    }
+    device_times.push_back({device, host_ns, frames});
+}
+
+void Profiler::writeJSON(const std::string& path) const {
+    FILE* file = create(path);
+    uint64_t total_cycles = 0;
+    uint64_t total_ns = 0;
+    for (const OpcodeStats& stats : opcodes) {
+        total_cycles += stats.cycles;
+        total_ns += stats.host_ns;
+    }
+    fprintf(file, "{\n"
+                  "  \"sample_interval\": %u,\n"
+                  "  \"samples\": %lu,\n"
+                  "  \"sampled_cycles\": %lu,\n"
+                  "  \"sampled_host_ns\": %lu,\n"
+                  "  \"timer_overhead_ns\": %ld,\n",
+            sample_interval, static_cast<unsigned long>(samples), static_cast<unsigned long>(total_cycles),
+            static_cast<unsigned long>(total_ns),
+            static_cast<long>(std::chrono::duration_cast<std::chrono::nanoseconds>(timer_overhead).count()));
+
+    // Most host time first
+    std::vector<unsigned> order;
+    for (unsigned opcode = 0; opcode < 256; ++opcode) {
+        if (opcodes[opcode].count) {
+            order.push_back(opcode);
+        }
+    }
+    std::sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+        return opcodes[a].host_ns > opcodes[b].host_ns;
+    });
+    fprintf(file, "  \"opcodes\": [");
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const OpcodeStats& stats = opcodes[order[i]];
+        uint8_t bytes[3] = {uint8_t(order[i]), 0, 0};
+        fprintf(file, "%s\n    {\"opcode\": \"%02X\", \"instruction\": \"%s\", \"count\": %lu, \"cycles\": %lu, "
+                      "\"host_ns\": %lu, \"ns_per_instruction\": %.2f}",
+                i ? "," : "", order[i], CPU::disassemble(bytes, 0).c_str(),
+                static_cast<unsigned long>(stats.count), static_cast<unsigned long>(stats.cycles),
+                static_cast<unsigned long>(stats.host_ns), double(stats.host_ns) / stats.count);
+    }
+    fprintf(file, "\n  ],\n");
+
+    std::vector<unsigned> addresses;
+    for (unsigned address = 0; address < address_counts.size(); ++address) {
+        if (address_counts[address]) {
+            addresses.push_back(address);
+        }
+    }
+    std::sort(addresses.begin(), addresses.end(), [this](unsigned a, unsigned b) {
+        return address_counts[a] > address_counts[b] || (address_counts[a] == address_counts[b] && a < b);
+    });
+    fprintf(file, "  \"addresses\": [");
+    for (std::size_t i = 0; i < addresses.size(); ++i) {
+        fprintf(file, "%s\n    {\"pc\": \"%04X\", \"count\": %lu}", i ? "," : "", addresses[i],
+                static_cast<unsigned long>(address_counts[addresses[i]]));
+    }
+    fprintf(file, "\n  ],\n");
+
+    fprintf(file, "  \"devices\": [");
+    for (std::size_t i = 0; i < device_times.size(); ++i) {
+        const DeviceTime& time = device_times[i];
+        fprintf(file, "%s\n    {\"device\": \"%s\", \"host_ns\": %lu, \"frames\": %lu, \"us_per_frame\": %.3f}",
+                i ? "," : "", time.device.c_str(), static_cast<unsigned long>(time.host_ns),
+                static_cast<unsigned long>(time.frames), time.frames ? time.host_ns / 1e3 / time.frames : 0.0);
+    }
+    fprintf(file, "\n  ]\n}\n");
+    finish(file, path);
+}
+
+void Profiler::writeStack(FILE* file, uint32_t node) const {
+    if (node == 0) {
+        fputs("main", file);
+        return;
+    }
+    writeStack(file, call_nodes[node].parent);
+    fprintf(file, ";$%04X", call_nodes[node].entry);
+}
+
+void Profiler::writeFoldedStacks(const std::string& path) const {
+    FILE* file = create(path);
+    for (uint32_t node = 0; node < call_nodes.size(); ++node) {
+        if (call_nodes[node].cycles == 0) {
+            continue;
+        }
+        writeStack(file, node);
+        fprintf(file, " %lu\n", static_cast<unsigned long>(call_nodes[node].cycles));
+    }
+    finish(file, path);
+}
+} // cpu::
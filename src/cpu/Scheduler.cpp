@@ -0,0 +1,63 @@
+#include "Scheduler.h"
+
+#include <thread>
+
+namespace cpu {
+Scheduler::Scheduler(console::Console& console, uint32_t cycles_per_batch)
+    : console(console), cycles_per_batch(cycles_per_batch), max_speed(false), total_cycles(0),
+      total_instructions(0), batch_end(cycles_per_batch), epoch(Clock::now()), epoch_cycles(0) {}
+
+uint64_t Scheduler::runBatch() {
+    uint64_t start = total_cycles;
+    const CPU& cpu = console.processor;
+    uint64_t cpu_cycles = cpu.cycleCount();
+    uint64_t cpu_instructions = cpu.instructionCount();
+    auto count = [&]() {
+        total_cycles += cpu.cycleCount() - cpu_cycles;
+        total_instructions += cpu.instructionCount() - cpu_instructions;
+    };
+    try {
+        if (total_cycles < batch_end) {
+            console.run(batch_end - total_cycles);
+        }
+    }
+    catch (...) {
+        // Keep what ran before the exception
+        count();
+        throw;
+    }
+    count();
+    // Only move on once the whole batch has run, so a batch interrupted by an
+    // exception picks up where it left off
+    batch_end += cycles_per_batch;
+
+    if (!max_speed) {
+        waitForDeadline();
+    }
+    return total_cycles - start;
+}
+
+void Scheduler::setMaxSpeed(bool max_speed_) {
+    max_speed = max_speed_;
+    // Measure deadlines from now, so switching back from max speed doesn't
+    // leave us with a huge negative sleep debt
+    epoch = Clock::now();
+    epoch_cycles = total_cycles;
+}
+
+void Scheduler::waitForDeadline() {
+    std::chrono::duration<double> emulated_time((total_cycles - epoch_cycles) / cpu_clock_hz);
+    auto deadline = epoch + std::chrono::duration_cast<Clock::duration>(emulated_time);
+    auto now = Clock::now();
+
+    // If we have fallen more than a batch behind (e.g. the host was suspended),
+    // don't try to catch up by running flat out, just resync to now
+    std::chrono::duration<double> batch_time(cycles_per_batch / cpu_clock_hz);
+    if (now > deadline + batch_time) {
+        epoch = now;
+        epoch_cycles = total_cycles;
+        return;
+    }
+    std::this_thread::sleep_until(deadline);
+}
+} // cpu::
@@ -0,0 +1,52 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+namespace cpu {
+TraceWriter::TraceWriter(const std::string& path)
+    : head(0), published_head(0), tail(0), running(true) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Can't open trace file " + path);
+    }
+    TraceFileHeader header;
+    memcpy(header.magic, trace_magic, sizeof(header.magic));
+    header.version = trace_version;
+    header.record_size = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, file);
+
+    writer = std::thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter() {
+    running.store(false, std::memory_order_release);
+    writer.join();
+    fclose(file);
+}
+
+void TraceWriter::run() {
+    std::size_t consumed = 0;
+    while (true) {
+        // Read running before the head, so records pushed before shutdown are kept
+        bool stopping = !running.load(std::memory_order_acquire);
+        std::size_t available = published_head.load(std::memory_order_acquire);
+
+        while (consumed != available) {
+            // Write up to the end of the ring in one go, then wrap around
+            std::size_t start = consumed & (ring_size - 1);
+            std::size_t count = std::min(available - consumed, ring_size - start);
+            fwrite(&ring[start], sizeof(TraceRecord), count, file);
+            consumed += count;
+            tail.store(consumed, std::memory_order_release);
+        }
+
+        if (stopping) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+} // cpu::
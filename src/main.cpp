@@ -1,38 +1,523 @@
 #include <iostream>
-#include <fstream>
-#include "CPU.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include "BatchRunner.h"
+#include "Console.h"
+#include "Json.h"
+#include "Movie.h"
+#include "Regression.h"
+#include "Scheduler.h"
+#include "Trace.h"
 
+namespace {
+// Cleared by SIGINT/SIGTERM so the trace and log get flushed on the way out
+volatile std::sig_atomic_t running = 1;
 
-void loadROM(std::string& path) {
-	memory::MemoryMap memory_map;
+void stop(int) {
+    running = 0;
+}
+
+void usage() {
+    std::cerr << "Usage: nes.exe [options] path/to/rom" << std::endl
+              << "       nes.exe --batch manifest.txt [--jobs N] [--jit | --cycle-stepped]" << std::endl
+              << "       nes.exe --regress manifest.txt [--jobs N] [--jit | --cycle-stepped] [--state-dir dir]" << std::endl
+              << "  --max-speed         run without syncing to wall-clock time" << std::endl
+              << "  --jit               run the CPU on the basic-block recompiler" << std::endl
+              << "  --cycle-stepped     run the CPU one bus access per cycle" << std::endl
+              << "  --trace trace.bin   record every instruction executed, see trace2nestest" << std::endl
+              << "  --bench CYCLES      run headless and uncapped for CYCLES cycles, print JSON stats" << std::endl
+              << "  --frames N          as --bench, but for N frames" << std::endl
+              << "  --load-state file   start from a save state instead of from reset" << std::endl
+              << "  --save-state file   save state to file when the run ends" << std::endl
+              << "  --screenshot file   write the last frame drawn to file as a PPM image" << std::endl
+              << "  --wav file          write the audio to file as a WAV" << std::endl
+              << "  --profile prefix    profile the CPU, write prefix.json and prefix.folded" << std::endl
+              << "  --profile-every N   with --profile, time only every Nth instruction" << std::endl
+              << "  --cdl file          log the PRG-ROM bytes used as code and data, adding to file" << std::endl
+              << "  --record file       record a movie of the run, for --frames N frames or until stopped" << std::endl
+              << "  --input script      with --record, hold the buttons script gives for each frame" << std::endl
+              << "  --replay file       replay a movie uncapped, checking the state every frame" << std::endl
+              << "  --batch manifest    run every ROM in manifest in parallel, print a JSON report" << std::endl
+              << "  --jobs N            threads for --batch, defaults to one per core" << std::endl
+              << "  --cdl-dir dir       with --batch, add each ROM's code/data log to dir/ROM.cdl" << std::endl
+              << "  --regress manifest  check every ROM in manifest ends on its golden hashes, in parallel" << std::endl
+              << "  --state-dir dir     with --regress, save failing ROMs' states to dir, defaults to ." << std::endl;
+    exit(1);
+}
+
+const char* executionModeName(cpu::CPU::ExecutionMode mode) {
+    switch (mode) {
+    case cpu::CPU::ExecutionMode::JIT:
+        return "jit";
+    case cpu::CPU::ExecutionMode::CYCLE_STEPPED:
+        return "cycle_stepped";
+    default:
+        return "interpreter";
+    }
+}
+
+// Runs uncapped until the PPU has finished frame_limit frames, or if that's 0
+// until at least cycle_limit cycles have run, then reports throughput as JSON
+// on stdout. A frame is 29780 2/3 cycles, so batches of 29780 drift against
+// frames: the last frame is run a scanline at a time to stop right after it
+void runBenchmark(console::Console& console, cpu::Scheduler& scheduler, const std::string& gamepath,
+    uint64_t cycle_limit, uint64_t frame_limit) {
+    constexpr uint64_t scanline_cycles = ppu::PPU::dots_per_scanline / ppu::PPU::dots_per_cpu_cycle + 1;
+    cpu::CPU& processor = console.processor;
+    uint64_t start_cycles = processor.cycleCount();
+    uint64_t start_instructions = processor.instructionCount();
+    uint64_t start_frame = console.ppu.frameCount();
+    uint64_t start_audio_ns = console.apu.synthesisNanoseconds();
+    scheduler.setMaxSpeed(true);
+    uint64_t illegal_opcodes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (running) {
+        uint64_t frames_run = console.ppu.frameCount() - start_frame;
+        if (frame_limit ? frames_run >= frame_limit : processor.cycleCount() - start_cycles >= cycle_limit) {
+            break;
+        }
+        try{
+            if (frame_limit && frames_run + 1 == frame_limit) {
+                console.run(scanline_cycles);
+            } else {
+                scheduler.runBatch();
+            }
+        }
+        catch(opcodeException&){
+            illegal_opcodes++;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double seconds = elapsed.count();
+    double cycles = processor.cycleCount() - start_cycles;
+    double instructions = processor.instructionCount() - start_instructions;
+    double frames = console.ppu.frameCount() - start_frame;
+    double audio_ns = console.apu.synthesisNanoseconds() - start_audio_ns;
+    cpu::CPU::DecodeCacheStats decode_cache = processor.decodeCacheStats();
+    printf("{\n"
+           "  \"rom\": \"%s\",\n"
+           "  \"cpu\": \"%s\",\n"
+           "  \"cycles\": %lu,\n"
+           "  \"instructions\": %lu,\n"
+           "  \"illegal_opcodes\": %lu,\n"
+           "  \"seconds\": %.6f,\n"
+           "  \"emulated_mhz\": %.3f,\n"
+           "  \"realtime_factor\": %.3f,\n"
+           "  \"instructions_per_second\": %.0f,\n"
+           "  \"ns_per_instruction\": %.3f,\n"
+           "  \"frames\": %.0f,\n"
+           "  \"frames_per_second\": %.1f,\n"
+           "  \"audio_us_per_frame\": %.3f,\n"
+           "  \"decode_cache_hits\": %lu,\n"
+           "  \"decode_cache_misses\": %lu,\n"
+           "  \"decode_cache_hit_rate\": %.6f\n"
+           "}\n",
+           json::escape(gamepath).c_str(),
+           executionModeName(processor.executionMode()),
+           static_cast<unsigned long>(cycles),
+           static_cast<unsigned long>(instructions),
+           static_cast<unsigned long>(illegal_opcodes),
+           seconds,
+           cycles / seconds / 1e6,
+           cycles / seconds / cpu::Scheduler::cpu_clock_hz,
+           instructions / seconds,
+           seconds * 1e9 / instructions,
+           frames,
+           frames / seconds,
+           frames > 0 ? audio_ns / frames / 1e3 : 0.0,
+           static_cast<unsigned long>(decode_cache.hits),
+           static_cast<unsigned long>(decode_cache.misses),
+           decode_cache.hitRate());
+}
+
+// Writes the PPU's frame buffer as a binary PPM. Returns false on failure
+bool writeScreenshot(const ppu::PPU& ppu, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "P6\n%u %u\n255\n", ppu::PPU::screen_width, ppu::PPU::screen_height);
+    const uint8_t* pixels = ppu.frameBuffer();
+    for (unsigned i = 0; i < ppu::PPU::screen_width * ppu::PPU::screen_height; ++i) {
+        uint32_t rgb = ppu::PPU::rgb(pixels[i]);
+        uint8_t bytes[3] = {uint8_t(rgb >> 16), uint8_t(rgb >> 8), uint8_t(rgb)};
+        fwrite(bytes, 1, sizeof(bytes), file);
+    }
+    return fclose(file) == 0;
+}
+
+// Records a movie from the console's state now, holding the buttons in the
+// input script if there is one. Runs frame_limit frames, or until stopped if
+// that's 0
+int recordMovie(console::Console& console, const char* movie_path, const char* input_path, uint64_t frame_limit) {
+    std::vector<console::InputChange> changes;
+    std::vector<uint8_t> start_state;
+    try {
+        if (input_path) {
+            changes = console::parseInputScript(input_path);
+        }
+        console.saveState(start_state);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    console::Movie movie(console.cartridge->romHash(), std::move(start_state));
+    console::MovieRunner runner(console);
+    std::array<uint8_t, 2> buttons = {0, 0};
+    std::size_t next_change = 0;
+    for (uint64_t frame = 0; running && (frame_limit == 0 || frame < frame_limit); ++frame) {
+        while (next_change < changes.size() && changes[next_change].frame <= frame) {
+            buttons = changes[next_change++].buttons;
+        }
+        movie.append(runner.runFrame(buttons));
+    }
+    try {
+        movie.save(movie_path);
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 
-    std::ifstream gamefile;
-    gamefile.open(path.c_str());
-    uint8_t ch = gamefile.get();
-    int i = ROM_START;
-    // Rest of memory is rom data
-    while (gamefile.good() && i < MEMORY_SIZE){
-        memory_map.write(i, ch);
-        ch = gamefile.get();
+    uint64_t final_hash = movie.frames().empty() ? 0 : movie.frames().back().state_hash;
+    printf("{\n"
+           "  \"movie\": \"%s\",\n"
+           "  \"frames\": %zu,\n"
+           "  \"illegal_opcodes\": %lu,\n"
+           "  \"state_hash\": \"%016lx\"\n"
+           "}\n",
+           json::escape(movie_path).c_str(),
+           movie.frames().size(),
+           static_cast<unsigned long>(runner.illegalOpcodes()),
+           static_cast<unsigned long>(final_hash));
+    return 0;
+}
+
+// Replays a movie and prints where it first diverges, if it does, as JSON.
+// The console state at the start of the diverging frame goes to
+// movie_path.diverged. Returns non-zero on divergence
+int replayMovie(console::Console& console, const char* movie_path) {
+    try {
+        console::Movie movie(movie_path);
+        if (movie.romHash() != console.cartridge->romHash()) {
+            std::cerr << movie_path << " was recorded with a different ROM" << std::endl;
+            return 1;
+        }
+        console::MovieRunner runner(console);
+        auto divergence = runner.replay(movie);
+        printf("{\n"
+               "  \"movie\": \"%s\",\n"
+               "  \"cpu\": \"%s\",\n"
+               "  \"frames\": %zu,\n"
+               "  \"matched\": %s",
+               json::escape(movie_path).c_str(),
+               executionModeName(console.processor.executionMode()),
+               movie.frames().size(),
+               divergence ? "false" : "true");
+        if (!divergence) {
+            printf("\n}\n");
+            return 0;
+        }
+
+        std::string state_path = std::string(movie_path) + ".diverged";
+        FILE* file = fopen(state_path.c_str(), "wb");
+        bool saved = file && fwrite(divergence->start_state.data(), 1, divergence->start_state.size(), file)
+            == divergence->start_state.size();
+        saved = file && fclose(file) == 0 && saved;
+        printf(",\n"
+               "  \"frame\": %lu,\n"
+               "  \"instructions_before\": %lu,\n"
+               "  \"expected_hash\": \"%016lx\",\n"
+               "  \"actual_hash\": \"%016lx\",\n"
+               "  \"expected_instructions\": %u,\n"
+               "  \"actual_instructions\": %u,\n"
+               "  \"pc\": \"$%04X\",\n"
+               "  \"start_state\": \"%s\"\n"
+               "}\n",
+               static_cast<unsigned long>(divergence->frame),
+               static_cast<unsigned long>(divergence->instructions_before),
+               static_cast<unsigned long>(divergence->expected.state_hash),
+               static_cast<unsigned long>(divergence->actual.state_hash),
+               divergence->expected.instructions,
+               divergence->actual.instructions,
+               divergence->program_counter,
+               saved ? json::escape(state_path).c_str() : "");
+        if (!saved) {
+            std::cerr << "Can't write " << state_path << std::endl;
+        }
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
-    gamefile.close();
 }
 
+// Runs every ROM in the manifest with run_all and prints the report. Returns
+// non-zero if the manifest can't be read, run_all throws or any ROM didn't pass
+template <typename Entry, typename RunAll, typename WriteReport, typename Passed>
+int runManifest(const char* manifest_path, unsigned jobs, std::vector<Entry> (*parse)(const std::string&),
+    const RunAll& run_all, const WriteReport& write_report, const Passed& passed) {
+    std::vector<Entry> entries;
+    try {
+        entries = parse(manifest_path);
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    decltype(run_all(entries, jobs)) results;
+    try {
+        results = run_all(entries, jobs);
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    write_report(stdout, entries, results, jobs, elapsed.count());
+    return std::all_of(results.begin(), results.end(), passed) ? 0 : 1;
+}
+} // namespace
+
 int main(int argc, char** argv) {
-	if(argc == 1){
-		std::cerr << "Usage: nes.exe path/to/rom" << std::endl;
-		exit(1);
-	}
-	std::string gamepath(argv[1]);
-    cpu::CPU cpu;
-    loadROM(gamepath);
+    bool max_speed = false;
+    bool use_jit = false;
+    bool cycle_stepped = false;
+    const char* trace_path = nullptr;
+    uint64_t bench_cycles = 0;
+    uint64_t frame_limit = 0;
+    const char* manifest_path = nullptr;
+    const char* load_state_path = nullptr;
+    const char* save_state_path = nullptr;
+    const char* screenshot_path = nullptr;
+    const char* wav_path = nullptr;
+    const char* profile_prefix = nullptr;
+    const char* cdl_path = nullptr;
+    const char* cdl_directory = nullptr;
+    const char* record_path = nullptr;
+    const char* replay_path = nullptr;
+    const char* input_path = nullptr;
+    const char* regress_path = nullptr;
+    const char* state_directory = ".";
+    unsigned profile_interval = 1;
+    unsigned jobs = 0;
+    std::string gamepath;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--max-speed") == 0) {
+            max_speed = true;
+        } else if (strcmp(argv[i], "--jit") == 0) {
+            use_jit = true;
+        } else if (strcmp(argv[i], "--cycle-stepped") == 0) {
+            cycle_stepped = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_cycles = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_limit = strtoull(argv[++i], nullptr, 10);
+            bench_cycles = frame_limit * cpu::Scheduler::ntsc_cycles_per_frame;
+        } else if (strcmp(argv[i], "--load-state") == 0 && i + 1 < argc) {
+            load_state_path = argv[++i];
+        } else if (strcmp(argv[i], "--save-state") == 0 && i + 1 < argc) {
+            save_state_path = argv[++i];
+        } else if (strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) {
+            screenshot_path = argv[++i];
+        } else if (strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+            wav_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--profile-every") == 0 && i + 1 < argc) {
+            profile_interval = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--cdl") == 0 && i + 1 < argc) {
+            cdl_path = argv[++i];
+        } else if (strcmp(argv[i], "--cdl-dir") == 0 && i + 1 < argc) {
+            cdl_directory = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_path = argv[++i];
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            manifest_path = argv[++i];
+        } else if (strcmp(argv[i], "--regress") == 0 && i + 1 < argc) {
+            regress_path = argv[++i];
+        } else if (strcmp(argv[i], "--state-dir") == 0 && i + 1 < argc) {
+            state_directory = argv[++i];
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = strtoul(argv[++i], nullptr, 10);
+        } else if (argv[i][0] != '-' && gamepath.empty()) {
+            gamepath = argv[i];
+        } else {
+            usage();
+        }
+    }
+    if (use_jit && cycle_stepped) {
+        std::cerr << "--jit and --cycle-stepped can't be used together" << std::endl;
+        usage();
+    }
+    cpu::CPU::ExecutionMode mode = cpu::CPU::ExecutionMode::INTERPRETER;
+    if (use_jit) {
+        mode = cpu::CPU::ExecutionMode::JIT;
+    } else if (cycle_stepped) {
+        mode = cpu::CPU::ExecutionMode::CYCLE_STEPPED;
+    }
+
+    if (manifest_path) {
+        return runManifest(manifest_path, jobs, batch::parseManifest,
+            [mode, cdl_directory](const std::vector<batch::BatchEntry>& entries, unsigned jobs) {
+                auto results = batch::runAll(entries, jobs, mode, cdl_directory != nullptr);
+                if (cdl_directory) {
+                    batch::writeCodeDataLogs(entries, results, cdl_directory);
+                }
+                return results;
+            },
+            batch::writeReport,
+            [](const batch::BatchResult& result) { return result.status == batch::BatchStatus::PASS; });
+    }
+    if (regress_path) {
+        return runManifest(regress_path, jobs, batch::parseRegressionManifest,
+            [mode, state_directory](const std::vector<batch::RegressionEntry>& entries, unsigned jobs) {
+                return batch::runRegressions(entries, jobs, mode, state_directory);
+            },
+            batch::writeRegressionReport,
+            // New ROMs have nothing to fail against yet
+            [](const batch::RegressionResult& result) {
+                return result.status == batch::RegressionStatus::PASS || result.status == batch::RegressionStatus::NEW;
+            });
+    }
+    if (gamepath.empty()) {
+        usage();
+    }
+
+    console::Console console;
+    try{
+        console.loadROM(gamepath);
+        if (load_state_path) {
+            console.loadState(load_state_path);
+        }
+    }
+    catch(std::exception& e){
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+
+    std::unique_ptr<apu::WavWriter> wav_writer;
+    if (wav_path) {
+        try {
+            wav_writer = std::make_unique<apu::WavWriter>(wav_path, console.apu.sampleRate());
+        }
+        catch(std::runtime_error& e){
+            std::cerr << e.what() << std::endl;
+            exit(1);
+        }
+        console.apu.setOutput(wav_writer.get());
+    }
+
+    std::unique_ptr<memory::CodeDataLog> code_data_log;
+    if (cdl_path) {
+        code_data_log = std::make_unique<memory::CodeDataLog>(console.cartridge->prgROM(),
+            console.cartridge->chrROM().size());
+        try {
+            if (std::filesystem::exists(cdl_path)) {
+                code_data_log->mergeFile(cdl_path);
+            }
+        }
+        catch(std::runtime_error& e){
+            std::cerr << e.what() << std::endl;
+            exit(1);
+        }
+        console.memory_map.setCodeDataLog(code_data_log.get());
+    }
+
+    std::unique_ptr<cpu::TraceWriter> trace_writer;
+    if (trace_path) {
+        trace_writer = std::make_unique<cpu::TraceWriter>(trace_path);
+        console.processor.setTraceWriter(trace_writer.get());
+    }
+
+    std::unique_ptr<cpu::Profiler> profiler;
+    if (profile_prefix) {
+        if (!cpu::Profiler::compiled_in) {
+            std::cerr << "--profile needs a build configured with -DPROFILER=ON" << std::endl;
+            exit(1);
+        }
+        profiler = std::make_unique<cpu::Profiler>(profile_interval);
+        console.processor.setProfiler(profiler.get());
+    }
+
+    if (!console.processor.setExecutionMode(mode)) {
+        std::cerr << "JIT not supported on this host, using the interpreter" << std::endl;
+    }
+
+    cpu::Scheduler scheduler(console);
+    scheduler.setMaxSpeed(max_speed);
+
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+    int exit_code = 0;
+    if (record_path) {
+        exit_code = recordMovie(console, record_path, input_path, frame_limit);
+    } else if (replay_path) {
+        exit_code = replayMovie(console, replay_path);
+    } else if (bench_cycles) {
+        runBenchmark(console, scheduler, gamepath, bench_cycles, frame_limit);
+    }
 
-	while (true){
+	while (running && !bench_cycles && !record_path && !replay_path){
 		try{
-			cpu.processNextOpcode();
+			scheduler.runBatch();
 		}
 		catch(opcodeException& e){
-			LOG(e.what());
+			LOG_WARNING("%s", e.what());
 		}
 	}
-}
\ No newline at end of file
+
+    if (screenshot_path && !writeScreenshot(console.ppu, screenshot_path)) {
+        std::cerr << "Can't write " << screenshot_path << std::endl;
+    }
+    if (wav_writer && !wav_writer->close()) {
+        std::cerr << "Can't write " << wav_path << std::endl;
+    }
+    if (code_data_log) {
+        try {
+            code_data_log->writeFile(cdl_path);
+        }
+        catch(std::runtime_error& e){
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (profiler) {
+        profiler->setDeviceTime("apu", console.apu.synthesisNanoseconds(), console.apu.framesSynthesised());
+        try {
+            profiler->writeJSON(std::string(profile_prefix) + ".json");
+            profiler->writeFoldedStacks(std::string(profile_prefix) + ".folded");
+        }
+        catch(std::runtime_error& e){
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    if (save_state_path) {
+        try {
+            console.saveState(save_state_path);
+        }
+        catch(saveStateException& e){
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    return exit_code;
+}
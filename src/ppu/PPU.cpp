@@ -0,0 +1,473 @@
+#include "PPU.h"
+
+#include <cstring>
+
+namespace ppu {
+
+namespace {
+constexpr uint32_t colours[64] = {
+    0x666666, 0x002A88, 0x1412A7, 0x3B00A4, 0x5C007E, 0x6E0040, 0x6C0600, 0x561D00,
+    0x333500, 0x0B4800, 0x005200, 0x004F08, 0x00404D, 0x000000, 0x000000, 0x000000,
+    0xADADAD, 0x155FD9, 0x4240FF, 0x7527FE, 0xA01ACC, 0xB71E7B, 0xB53120, 0x994E00,
+    0x6B6D00, 0x388700, 0x0C9300, 0x008F32, 0x007C8D, 0x000000, 0x000000, 0x000000,
+    0xFFFEFF, 0x64B0FF, 0x9290FF, 0xC676FF, 0xF36AFF, 0xFE6ECC, 0xFE8170, 0xEA9E22,
+    0xBCBE00, 0x88D800, 0x5CE430, 0x45E082, 0x48CDDE, 0x4F4F4F, 0x000000, 0x000000,
+    0xFFFEFF, 0xC0DFFF, 0xD3D2FF, 0xE8C8FF, 0xFBC2FF, 0xFEC4EA, 0xFECCC5, 0xF7D8A5,
+    0xE4E594, 0xCFEF96, 0xBDF4AB, 0xB3F3CC, 0xB5EBF2, 0xB8B8B8, 0x000000, 0x000000,
+};
+
+// For horizontally flipped sprites
+constexpr std::array<uint8_t, 256> makeReverseTable() {
+    std::array<uint8_t, 256> table{};
+    for (unsigned byte = 0; byte < 256; ++byte) {
+        for (unsigned bit = 0; bit < 8; ++bit) {
+            table[byte] |= ((byte >> bit) & 1) << (7 - bit);
+        }
+    }
+    return table;
+}
+constexpr std::array<uint8_t, 256> reversed_bits = makeReverseTable();
+
+// Tiles drawn per scanline: 32 plus one for the fine X scroll to slide into,
+// rounded up for the kernels
+constexpr unsigned scanline_tiles = 33;
+constexpr unsigned padded_tiles = 36;
+} // namespace
+
+PPU::PPU(cpu::CPU& cpu, memory::MemoryMap& memory_map)
+    : cpu(cpu), memory_map(memory_map), kernels(&ScanlineKernels::best()), control(0), mask(0),
+      status(0), oam_address(0), io_latch(0), read_buffer(0), v(0), t(0), fine_x(0),
+      second_write(false), frame_start(0), next_event_dot(0), next_event(Event::DRAW_SCANLINE),
+      scanline(0), odd_frame(false), frame_count(0), nametable_ram{}, palette{}, oam{},
+      chr(chr_ram.data()), chr_ram{}, chr_writable(true), frame_buffer{} {
+    nametables = {&nametable_ram[0], &nametable_ram[0], &nametable_ram[0x400], &nametable_ram[0x400]};
+    scheduleEvent(Event::DRAW_SCANLINE, 0, screen_width);
+    cpu.events().setHandler(cpu::Event::VBLANK_NMI, this);
+    cpu.events().setHandler(cpu::Event::FRAME_END, this);
+    scheduleCPUEvents();
+}
+
+void PPU::mapInto(memory::MemoryMap& memory_map) {
+    memory_map.mapIO(0x2000, 0x2000, this);
+}
+
+void PPU::loadCartridge(const cartridge::Cartridge& cartridge) {
+    std::span<const uint8_t> chr_rom = cartridge.chrROM();
+    chr_writable = chr_rom.empty();
+    chr = chr_writable ? chr_ram.data() : chr_rom.data();
+    if (!chr_writable && chr_rom.size() < chr_ram.size()) {
+        // NES 2.0 allows CHR-ROM under 8KiB, which is mirrored to fill the
+        // pattern tables so reads never run off the end of it
+        for (std::size_t i = 0; i < chr_ram.size(); ++i) {
+            chr_ram[i] = chr_rom[i % chr_rom.size()];
+        }
+        chr = chr_ram.data();
+    }
+
+    uint8_t* first = &nametable_ram[0];
+    uint8_t* second = &nametable_ram[0x400];
+    switch (cartridge.mirroring()) {
+    case cartridge::Mirroring::HORIZONTAL:
+        nametables = {first, first, second, second};
+        break;
+    case cartridge::Mirroring::VERTICAL:
+        nametables = {first, second, first, second};
+        break;
+    case cartridge::Mirroring::FOUR_SCREEN:
+        nametables = {first, second, &nametable_ram[0x800], &nametable_ram[0xC00]};
+        break;
+    }
+}
+
+uint8_t PPU::read(uint16_t address) {
+    catchUp(cpu.cycleCount());
+    switch (address & 7) {
+    case 2: {
+        uint8_t value = (status & 0xE0) | (io_latch & 0x1F);
+        status &= ~vblank_flag;
+        second_write = false;
+        io_latch = value;
+        break;
+    }
+    case 4:
+        io_latch = oam[oam_address];
+        break;
+    case 7: {
+        uint16_t vram_address = v & 0x3FFF;
+        if (vram_address >= 0x3F00) {
+            // Palette reads are immediate, while the buffer picks up the
+            // nametable byte underneath
+            io_latch = (io_latch & 0xC0) | busRead(vram_address);
+            read_buffer = busRead(vram_address - 0x1000);
+        } else {
+            io_latch = read_buffer;
+            read_buffer = busRead(vram_address);
+        }
+        v += control & increment_32 ? 32 : 1;
+        break;
+    }
+    default:
+        // Write-only
+        break;
+    }
+    return io_latch;
+}
+
+void PPU::write(uint16_t address, uint8_t value) {
+    catchUp(cpu.cycleCount());
+    io_latch = value;
+    switch (address & 7) {
+    case 0:
+        // Enabling NMI during vblank raises one straight away
+        if (!(control & nmi_enable) && (value & nmi_enable) && (status & vblank_flag)) {
+            cpu.requestNMI(cpu.cycleCount());
+        }
+        control = value;
+        t = (t & 0xF3FF) | (value & 3) << 10;
+        break;
+    case 1:
+        mask = value;
+        break;
+    case 3:
+        oam_address = value;
+        break;
+    case 4:
+        oam[oam_address++] = value;
+        break;
+    case 5:
+        if (!second_write) {
+            t = (t & ~0x001F) | value >> 3;
+            fine_x = value & 7;
+        } else {
+            t = (t & 0x0C1F) | (value & 7) << 12 | (value & 0xF8) << 2;
+        }
+        second_write = !second_write;
+        break;
+    case 6:
+        if (!second_write) {
+            t = (t & 0x00FF) | (value & 0x3F) << 8;
+        } else {
+            t = (t & 0xFF00) | value;
+            v = t;
+        }
+        second_write = !second_write;
+        break;
+    case 7:
+        busWrite(v & 0x3FFF, value);
+        v += control & increment_32 ? 32 : 1;
+        break;
+    default:
+        // $2002 is read-only
+        break;
+    }
+}
+
+void PPU::oamDMA(uint8_t page) {
+    catchUp(cpu.cycleCount());
+    for (unsigned i = 0; i < 256; ++i) {
+        oam[(oam_address + i) & 0xFF] = memory_map.read(page << 8 | i);
+    }
+    // One cycle to halt, another to line up with a read cycle if the write
+    // landed on an odd one, then a read and a write per byte
+    cpu.stall(513 + (cpu.cycleCount() & 1));
+}
+
+void PPU::catchUp(uint64_t cpu_cycle) {
+    uint64_t dot = cpu_cycle * dots_per_cpu_cycle;
+    if (next_event_dot > dot) {
+        return;
+    }
+    while (next_event_dot <= dot) {
+        runEvent();
+    }
+    scheduleCPUEvents();
+}
+
+void PPU::handleEvent(cpu::Event, uint64_t) {
+    catchUp(cpu.cycleCount());
+    // Firing unscheduled it, even if there was nothing left to run
+    scheduleCPUEvents();
+}
+
+void PPU::scheduleCPUEvents() {
+    uint64_t vblank_dot = frame_start + vblank_scanline * dots_per_scanline + 1;
+    uint64_t frame_end_dot = frame_start + scanlines_per_frame * dots_per_scanline;
+    if (next_event == Event::FRAME_END) {
+        frame_end_dot = next_event_dot;
+    }
+    if (next_event != Event::DRAW_SCANLINE && next_event != Event::VBLANK_START) {
+        // Passed already, so it is next frame's. An odd frame can be a dot
+        // shorter, which only makes the CPU stop a cycle late
+        vblank_dot += scanlines_per_frame * dots_per_scanline;
+    }
+    cpu.events().schedule(cpu::Event::VBLANK_NMI, cpuCycle(vblank_dot));
+    // Until the skipped dot is decided, the frame's full length
+    cpu.events().schedule(cpu::Event::FRAME_END, cpuCycle(frame_end_dot));
+}
+
+uint32_t PPU::rgb(uint8_t colour) {
+    return colours[colour & 0x3F];
+}
+
+void PPU::saveState(savestate::StateWriter& writer) const {
+    writer.beginChunk(savestate::makeTag("PPU "));
+    writer.write(control);
+    writer.write(mask);
+    writer.write(status);
+    writer.write(oam_address);
+    writer.write(io_latch);
+    writer.write(read_buffer);
+    writer.write(v);
+    writer.write(t);
+    writer.write(fine_x);
+    writer.write(second_write);
+    writer.write(frame_start);
+    writer.write(next_event_dot);
+    writer.write(next_event);
+    writer.write(scanline);
+    writer.write(odd_frame);
+    writer.write(frame_count);
+    writer.writeBytes(nametable_ram.data(), nametable_ram.size());
+    writer.writeBytes(palette.data(), palette.size());
+    writer.writeBytes(oam.data(), oam.size());
+    if (chr_writable) {
+        writer.writeBytes(chr_ram.data(), chr_ram.size());
+    }
+    writer.endChunk();
+}
+
+void PPU::loadState(savestate::StateReader& reader) {
+    if (!reader.seekChunk(savestate::makeTag("PPU "))) {
+        return;
+    }
+    control = reader.read<uint8_t>();
+    mask = reader.read<uint8_t>();
+    status = reader.read<uint8_t>();
+    oam_address = reader.read<uint8_t>();
+    io_latch = reader.read<uint8_t>();
+    read_buffer = reader.read<uint8_t>();
+    v = reader.read<uint16_t>();
+    t = reader.read<uint16_t>();
+    fine_x = reader.read<uint8_t>();
+    second_write = reader.read<bool>();
+    frame_start = reader.read<uint64_t>();
+    next_event_dot = reader.read<uint64_t>();
+    next_event = reader.read<Event>();
+    scanline = reader.read<unsigned>();
+    odd_frame = reader.read<bool>();
+    frame_count = reader.read<uint64_t>();
+    reader.readBytes(nametable_ram.data(), nametable_ram.size());
+    reader.readBytes(palette.data(), palette.size());
+    reader.readBytes(oam.data(), oam.size());
+    if (chr_writable) {
+        reader.readBytes(chr_ram.data(), chr_ram.size());
+    }
+    scheduleCPUEvents();
+}
+
+void PPU::runEvent() {
+    switch (next_event) {
+    case Event::DRAW_SCANLINE:
+        drawScanline(scanline);
+        if (renderingEnabled()) {
+            // Down a row (dot 256), then back to the left edge (dot 257)
+            if ((v & 0x7000) != 0x7000) {
+                v += 0x1000;
+            } else {
+                v &= ~0x7000;
+                unsigned coarse_y = (v >> 5) & 0x1F;
+                if (coarse_y == 29) {
+                    coarse_y = 0;
+                    v ^= 0x0800;
+                } else {
+                    // Rows 30 and 31 are the attribute table, which wraps
+                    // around without switching nametables
+                    coarse_y = (coarse_y + 1) & 0x1F;
+                }
+                v = (v & ~0x03E0) | coarse_y << 5;
+            }
+            v = (v & ~0x041F) | (t & 0x041F);
+        }
+        if (++scanline < screen_height) {
+            scheduleEvent(Event::DRAW_SCANLINE, scanline, screen_width);
+        } else {
+            scheduleEvent(Event::VBLANK_START, vblank_scanline, 1);
+        }
+        break;
+    case Event::VBLANK_START:
+        status |= vblank_flag;
+        if (control & nmi_enable) {
+            // At the cycle the VBLANK_NMI event is scheduled for, however
+            // late the catch-up that got here
+            cpu.requestNMI(cpuCycle(next_event_dot));
+        }
+        scheduleEvent(Event::VBLANK_END, prerender_scanline, 1);
+        break;
+    case Event::VBLANK_END:
+        status &= ~(vblank_flag | sprite0_hit_flag | sprite_overflow_flag);
+        scheduleEvent(Event::RELOAD_SCROLL, prerender_scanline, 280);
+        break;
+    case Event::RELOAD_SCROLL:
+        // The pre-render line's own row increment and horizontal copy get
+        // overwritten here, so all of v comes from t
+        if (renderingEnabled()) {
+            v = t;
+        }
+        // Odd frames skip the last dot while rendering
+        scheduleEvent(Event::FRAME_END, prerender_scanline,
+                      odd_frame && renderingEnabled() ? dots_per_scanline - 1 : dots_per_scanline);
+        break;
+    case Event::FRAME_END:
+        frame_start = next_event_dot;
+        odd_frame = !odd_frame;
+        ++frame_count;
+        scanline = 0;
+        scheduleEvent(Event::DRAW_SCANLINE, 0, screen_width);
+        break;
+    }
+}
+
+void PPU::scheduleEvent(Event next, unsigned line, unsigned dot) {
+    next_event = next;
+    next_event_dot = frame_start + line * dots_per_scanline + dot;
+}
+
+void PPU::drawScanline(unsigned line) {
+    uint8_t* out = &frame_buffer[line * screen_width];
+    uint8_t colour_mask = mask & greyscale ? 0x30 : 0x3F;
+    if (!renderingEnabled()) {
+        memset(out, palette[0] & colour_mask, screen_width);
+        return;
+    }
+
+    alignas(32) uint8_t tiles[padded_tiles * 8];
+    alignas(32) uint8_t sprites[screen_width];
+    const uint8_t* background = tiles + fine_x;
+    if (mask & show_background) {
+        fetchBackground(tiles);
+        if (!(mask & show_left_background)) {
+            memset(tiles + fine_x, 0, 8);
+        }
+    } else {
+        memset(tiles, 0, sizeof(tiles));
+    }
+    memset(sprites, 0, sizeof(sprites));
+    if (mask & show_sprites) {
+        evaluateSprites(line, sprites);
+        if (!(mask & show_left_sprites)) {
+            memset(sprites, 0, 8);
+        }
+    }
+
+    const uint8_t* colours = palette.data();
+    alignas(32) uint8_t grey_palette[32];
+    if (mask & greyscale) {
+        for (unsigned i = 0; i < 32; ++i) {
+            grey_palette[i] = palette[i] & colour_mask;
+        }
+        colours = grey_palette;
+    }
+    if (kernels->compose(background, sprites, colours, out) >= 0) {
+        status |= sprite0_hit_flag;
+    }
+}
+
+void PPU::fetchBackground(uint8_t* tiles) {
+    alignas(32) uint8_t low[padded_tiles] = {};
+    alignas(32) uint8_t high[padded_tiles] = {};
+    alignas(32) uint8_t attributes[padded_tiles] = {};
+    const uint8_t* patterns = chr + (control & background_table ? 0x1000 : 0) + (v >> 12);
+    uint16_t address = v;
+    for (unsigned i = 0; i < scanline_tiles; ++i) {
+        const uint8_t* nametable = nametables[(address >> 10) & 3];
+        unsigned coarse_x = address & 0x1F;
+        unsigned coarse_y = (address >> 5) & 0x1F;
+        const uint8_t* pattern = patterns + nametable[address & 0x3FF] * 16;
+        low[i] = pattern[0];
+        high[i] = pattern[8];
+        // Each attribute byte covers 4x4 tiles, two bits per 2x2 quadrant
+        uint8_t attribute = nametable[0x3C0 | (coarse_y >> 2) << 3 | coarse_x >> 2];
+        attributes[i] = ((attribute >> ((coarse_y & 2) << 1 | (coarse_x & 2))) & 3) << 2;
+        // Along a tile, into the next nametable across after the last one
+        address = coarse_x == 31 ? (address & ~0x001F) ^ 0x0400 : address + 1;
+    }
+    kernels->decode_tiles(low, high, attributes, scanline_tiles, tiles);
+}
+
+void PPU::evaluateSprites(unsigned line, uint8_t* sprites) {
+    alignas(32) uint8_t low[8] = {};
+    alignas(32) uint8_t high[8] = {};
+    alignas(32) uint8_t attributes[8] = {};
+    alignas(32) uint8_t pixels[8 * 8];
+    uint8_t x[8];
+    unsigned height = control & tall_sprites ? 16 : 8;
+    unsigned found = 0;
+    for (unsigned n = 0; n < 64; ++n) {
+        const uint8_t* sprite = &oam[n * 4];
+        // Sprites show one line below their Y, which also keeps them off line 0
+        unsigned row = line - 1 - sprite[0];
+        if (row >= height) {
+            continue;
+        }
+        if (found == 8) {
+            status |= sprite_overflow_flag;
+            break;
+        }
+        uint8_t tile = sprite[1];
+        uint8_t flags = sprite[2];
+        if (flags & 0x80) {
+            row = height - 1 - row;
+        }
+        uint16_t address;
+        if (height == 16) {
+            // Bit 0 of the tile picks the table, the bottom half is the next tile
+            address = (tile & 1) << 12 | (tile & 0xFE) << 4 | (row & 8) << 1 | (row & 7);
+        } else {
+            address = (control & sprite_table ? 0x1000 : 0) | tile << 4 | row;
+        }
+        low[found] = flags & 0x40 ? reversed_bits[chr[address]] : chr[address];
+        high[found] = flags & 0x40 ? reversed_bits[chr[address + 8]] : chr[address + 8];
+        attributes[found] = 0x10 | (flags & 3) << 2 | (flags & 0x20) | (n == 0 ? 0x40 : 0);
+        x[found] = sprite[3];
+        ++found;
+    }
+    kernels->decode_tiles(low, high, attributes, found, pixels);
+
+    // Earlier sprites win where they overlap, even behind the background
+    for (unsigned i = 0; i < found; ++i) {
+        for (unsigned dx = 0; dx < 8 && x[i] + dx < screen_width; ++dx) {
+            uint8_t pixel = pixels[i * 8 + dx];
+            if (pixel && !(sprites[x[i] + dx] & 3)) {
+                sprites[x[i] + dx] = pixel;
+            }
+        }
+    }
+}
+
+uint8_t PPU::busRead(uint16_t address) const {
+    if (address < 0x2000) {
+        return chr[address];
+    }
+    if (address < 0x3F00) {
+        return nametables[(address >> 10) & 3][address & 0x3FF];
+    }
+    return palette[address & 0x1F];
+}
+
+void PPU::busWrite(uint16_t address, uint8_t value) {
+    if (address < 0x2000) {
+        if (chr_writable) {
+            chr_ram[address] = value;
+        }
+    } else if (address < 0x3F00) {
+        nametables[(address >> 10) & 3][address & 0x3FF] = value;
+    } else {
+        value &= 0x3F;
+        palette[address & 0x1F] = value;
+        // Backdrop entries are shared between background and sprites
+        if ((address & 3) == 0) {
+            palette[(address & 0x1F) ^ 0x10] = value;
+        }
+    }
+}
+} // ppu::
@@ -0,0 +1,195 @@
+#include "ScanlineKernels.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace ppu {
+
+namespace {
+// Repeats a byte across all 8 bytes of a word
+constexpr uint64_t bytes_of(uint8_t byte) {
+    return byte * 0x0101010101010101ull;
+}
+
+// Entry b holds the 8 pixels of bitplane byte b, 0 or 1 each, leftmost
+// (bit 7) first in memory
+constexpr std::array<uint64_t, 256> makeSpreadTable() {
+    std::array<uint64_t, 256> table{};
+    for (unsigned byte = 0; byte < 256; ++byte) {
+        std::array<uint8_t, 8> pixels{};
+        for (unsigned i = 0; i < 8; ++i) {
+            pixels[i] = (byte >> (7 - i)) & 1;
+        }
+        table[byte] = std::bit_cast<uint64_t>(pixels);
+    }
+    return table;
+}
+constexpr std::array<uint64_t, 256> spread_table = makeSpreadTable();
+
+void decodeTilesScalar(const uint8_t* low, const uint8_t* high, const uint8_t* attributes,
+                       unsigned count, uint8_t* out) {
+    for (unsigned i = 0; i < count; ++i) {
+        // Every step works on whole bytes, so this holds whatever the byte order
+        uint64_t pattern = spread_table[low[i]] | spread_table[high[i]] << 1;
+        uint64_t opaque = (pattern | pattern >> 1) & bytes_of(1);
+        uint64_t pixels = (pattern | bytes_of(attributes[i])) & opaque * 0xFF;
+        memcpy(out + i * 8, &pixels, sizeof(pixels));
+    }
+}
+
+int composeScalar(const uint8_t* background, const uint8_t* sprites, const uint8_t* palette, uint8_t* out) {
+    int sprite0_hit = -1;
+    for (unsigned x = 0; x < 256; ++x) {
+        uint8_t tile = background[x];
+        uint8_t sprite = sprites[x];
+        bool sprite_opaque = sprite & 3;
+        bool tile_opaque = tile & 3;
+        if (sprite_opaque && tile_opaque && (sprite & 0x40) && sprite0_hit < 0) {
+            sprite0_hit = x;
+        }
+        bool sprite_shown = sprite_opaque && (!tile_opaque || !(sprite & 0x20));
+        out[x] = palette[sprite_shown ? sprite & 0x1F : tile];
+    }
+    // The hardware never reports a hit at x = 255
+    return sprite0_hit == 255 ? -1 : sprite0_hit;
+}
+
+#if defined(__x86_64__)
+// x86-64 always has SSE2, so this needs no target attribute
+void decodeTilesSSE2(const uint8_t* low, const uint8_t* high, const uint8_t* attributes,
+                     unsigned count, uint8_t* out) {
+    // Byte i of each tile tests bit 7 - i of the bitplane
+    const __m128i bits = _mm_set1_epi64x(0x0102040810204080);
+    const __m128i zero = _mm_setzero_si128();
+    for (unsigned i = 0; i < count; i += 2) {
+        __m128i low_plane = _mm_set_epi64x(bytes_of(low[i + 1]), bytes_of(low[i]));
+        __m128i high_plane = _mm_set_epi64x(bytes_of(high[i + 1]), bytes_of(high[i]));
+        __m128i attribute = _mm_set_epi64x(bytes_of(attributes[i + 1]), bytes_of(attributes[i]));
+        __m128i pattern = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(low_plane, bits), bits), _mm_set1_epi8(1)),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(high_plane, bits), bits), _mm_set1_epi8(2)));
+        __m128i transparent = _mm_cmpeq_epi8(pattern, zero);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8),
+                         _mm_andnot_si128(transparent, _mm_or_si128(pattern, attribute)));
+    }
+}
+
+int composeSSE2(const uint8_t* background, const uint8_t* sprites, const uint8_t* palette, uint8_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pattern_bits = _mm_set1_epi8(3);
+    int sprite0_hit = -1;
+    for (unsigned x = 0; x < 256; x += 16) {
+        __m128i tile = _mm_loadu_si128(reinterpret_cast<const __m128i*>(background + x));
+        __m128i sprite = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sprites + x));
+        __m128i tile_transparent = _mm_cmpeq_epi8(_mm_and_si128(tile, pattern_bits), zero);
+        __m128i sprite_transparent = _mm_cmpeq_epi8(_mm_and_si128(sprite, pattern_bits), zero);
+        __m128i sprite_in_front = _mm_cmpeq_epi8(_mm_and_si128(sprite, _mm_set1_epi8(0x20)), zero);
+        __m128i sprite_shown = _mm_andnot_si128(sprite_transparent, _mm_or_si128(tile_transparent, sprite_in_front));
+        __m128i index = _mm_or_si128(_mm_and_si128(sprite_shown, _mm_and_si128(sprite, _mm_set1_epi8(0x1F))),
+                                     _mm_andnot_si128(sprite_shown, tile));
+        if (sprite0_hit < 0) {
+            __m128i not_sprite0 = _mm_cmpeq_epi8(_mm_and_si128(sprite, _mm_set1_epi8(0x40)), zero);
+            unsigned misses = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(tile_transparent, sprite_transparent), not_sprite0));
+            if (misses != 0xFFFF) {
+                sprite0_hit = x + std::countr_one(misses);
+            }
+        }
+        // No byte shuffle before SSSE3, so the palette lookup stays scalar
+        alignas(16) uint8_t indices[16];
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), index);
+        for (unsigned i = 0; i < 16; ++i) {
+            out[x + i] = palette[indices[i]];
+        }
+    }
+    return sprite0_hit == 255 ? -1 : sprite0_hit;
+}
+
+__attribute__((target("avx2")))
+void decodeTilesAVX2(const uint8_t* low, const uint8_t* high, const uint8_t* attributes,
+                     unsigned count, uint8_t* out) {
+    const __m256i bits = _mm256_set1_epi64x(0x0102040810204080);
+    const __m256i zero = _mm256_setzero_si256();
+    for (unsigned i = 0; i < count; i += 4) {
+        __m256i low_plane = _mm256_set_epi64x(bytes_of(low[i + 3]), bytes_of(low[i + 2]),
+                                              bytes_of(low[i + 1]), bytes_of(low[i]));
+        __m256i high_plane = _mm256_set_epi64x(bytes_of(high[i + 3]), bytes_of(high[i + 2]),
+                                               bytes_of(high[i + 1]), bytes_of(high[i]));
+        __m256i attribute = _mm256_set_epi64x(bytes_of(attributes[i + 3]), bytes_of(attributes[i + 2]),
+                                              bytes_of(attributes[i + 1]), bytes_of(attributes[i]));
+        __m256i pattern = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(low_plane, bits), bits), _mm256_set1_epi8(1)),
+            _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(high_plane, bits), bits), _mm256_set1_epi8(2)));
+        __m256i transparent = _mm256_cmpeq_epi8(pattern, zero);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 8),
+                            _mm256_andnot_si256(transparent, _mm256_or_si256(pattern, attribute)));
+    }
+}
+
+__attribute__((target("avx2")))
+int composeAVX2(const uint8_t* background, const uint8_t* sprites, const uint8_t* palette, uint8_t* out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i pattern_bits = _mm256_set1_epi8(3);
+    // Byte shuffles look up 16 entries at a time, one for each half of palette
+    const __m256i palette_low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(palette)));
+    const __m256i palette_high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(palette + 16)));
+    int sprite0_hit = -1;
+    for (unsigned x = 0; x < 256; x += 32) {
+        __m256i tile = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(background + x));
+        __m256i sprite = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sprites + x));
+        __m256i tile_transparent = _mm256_cmpeq_epi8(_mm256_and_si256(tile, pattern_bits), zero);
+        __m256i sprite_transparent = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, pattern_bits), zero);
+        __m256i sprite_in_front = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, _mm256_set1_epi8(0x20)), zero);
+        __m256i sprite_shown = _mm256_andnot_si256(sprite_transparent, _mm256_or_si256(tile_transparent, sprite_in_front));
+        __m256i index = _mm256_or_si256(_mm256_and_si256(sprite_shown, _mm256_and_si256(sprite, _mm256_set1_epi8(0x1F))),
+                                        _mm256_andnot_si256(sprite_shown, tile));
+        if (sprite0_hit < 0) {
+            __m256i not_sprite0 = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, _mm256_set1_epi8(0x40)), zero);
+            uint32_t misses = _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_or_si256(tile_transparent, sprite_transparent), not_sprite0));
+            if (misses != 0xFFFFFFFF) {
+                sprite0_hit = x + std::countr_one(misses);
+            }
+        }
+        // Bit 4 of the index picks the half, shifted up to the byte's sign bit
+        // for the blend. 16-bit shifts only carry bits 5-7 into the next byte,
+        // which the blend ignores
+        __m256i colour = _mm256_blendv_epi8(_mm256_shuffle_epi8(palette_low, index),
+                                            _mm256_shuffle_epi8(palette_high, index),
+                                            _mm256_slli_epi16(index, 3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), colour);
+    }
+    return sprite0_hit == 255 ? -1 : sprite0_hit;
+}
+#endif
+
+const ScanlineKernels scalar_kernels = {decodeTilesScalar, composeScalar, ScanlineKernels::InstructionSet::SCALAR};
+#if defined(__x86_64__)
+const ScanlineKernels sse2_kernels = {decodeTilesSSE2, composeSSE2, ScanlineKernels::InstructionSet::SSE2};
+const ScanlineKernels avx2_kernels = {decodeTilesAVX2, composeAVX2, ScanlineKernels::InstructionSet::AVX2};
+#endif
+} // namespace
+
+const ScanlineKernels& ScanlineKernels::get(InstructionSet instruction_set) {
+#if defined(__x86_64__)
+    if (instruction_set == InstructionSet::AVX2 && __builtin_cpu_supports("avx2")) {
+        return avx2_kernels;
+    }
+    if (instruction_set != InstructionSet::SCALAR) {
+        return sse2_kernels;
+    }
+    return scalar_kernels;
+#else
+    (void)instruction_set;
+    return scalar_kernels;
+#endif
+}
+
+const ScanlineKernels& ScanlineKernels::best() {
+    return get(InstructionSet::AVX2);
+}
+} // ppu::
@@ -0,0 +1,33 @@
+#include <memory>
+
+#include "Console.h"
+#include "TestROM.h"
+
+// Two consoles running different ROMs side by side must not see each other's
+// memory or registers
+
+int main() {
+    // LDA #$10, STA $0200, then ASL or LSR $0200, then spin
+    auto program = [](uint8_t shift_opcode) {
+        return std::vector<uint8_t>{0xA9, 0x10, 0x8D, 0x00, 0x02, shift_opcode, 0x00, 0x02, 0x4C, 0x08, 0x80};
+    };
+    auto asl_console = std::make_unique<console::Console>();
+    auto lsr_console = std::make_unique<console::Console>();
+    asl_console->loadROM(test::writeNROM("console_isolation_asl", program(0x0E)));
+    lsr_console->loadROM(test::writeNROM("console_isolation_lsr", program(0x4E)));
+
+    // Interleaved an instruction at a time
+    for (int i = 0; i < 10; ++i) {
+        asl_console->processor.processNextOpcode();
+        lsr_console->processor.processNextOpcode();
+    }
+
+    int failures = 0;
+    test::check(asl_console->memory_map.read(0x0200) == 0x20, "ASL console has $20 at $0200", failures);
+    test::check(lsr_console->memory_map.read(0x0200) == 0x08, "LSR console has $08 at $0200", failures);
+    test::check(asl_console->memory_map.read(0x8005) == 0x0E, "ASL console runs its own ROM", failures);
+    test::check(lsr_console->memory_map.read(0x8005) == 0x4E, "LSR console runs its own ROM", failures);
+    test::check(asl_console->processor.registers().program_counter == 0x8008 &&
+        lsr_console->processor.registers().program_counter == 0x8008, "both consoles end on the loop", failures);
+    return failures ? 1 : 0;
+}
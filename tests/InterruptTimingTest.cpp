@@ -0,0 +1,120 @@
+#include <memory>
+#include <string>
+
+#include "Console.h"
+#include "Scheduler.h"
+#include "TestROM.h"
+
+// Vblank NMIs must be taken on the same instruction whichever way the CPU
+// runs. The interpreter and JIT only see the PPU when an instruction touches
+// it or between instructions, so they have to time a request to the cycle
+// the cycle-stepped CPU would have seen it on, and poll for it straight after
+// the instruction that found it
+
+namespace {
+// Runs the ROM for 20 frames in each mode and checks the states all match
+void checkModesAgree(const std::string& rom, const std::string& what, int& failures) {
+    const cpu::CPU::ExecutionMode modes[] = {
+        cpu::CPU::ExecutionMode::INTERPRETER,
+        cpu::CPU::ExecutionMode::JIT,
+        cpu::CPU::ExecutionMode::CYCLE_STEPPED,
+    };
+    std::vector<uint8_t> states[3];
+    for (int i = 0; i < 3; ++i) {
+        auto console = std::make_unique<console::Console>();
+        console->loadROM(rom);
+        console->processor.setExecutionMode(modes[i]);
+        for (int frame = 0; frame < 20; ++frame) {
+            console->run(cpu::Scheduler::ntsc_cycles_per_frame);
+        }
+        console->saveState(states[i]);
+    }
+    test::check(states[0] == states[2], ("interpreter matches cycle-stepped, " + what).c_str(), failures);
+    test::check(states[1] == states[2], ("JIT matches cycle-stepped, " + what).c_str(), failures);
+}
+} // namespace
+
+int main() {
+    int failures = 0;
+
+    // Enables NMI with STA $2000,X in a loop of NOPs, so vblank starts while
+    // the store is running on some frames. The loop's length and alignment
+    // vary so vblank lands on each of its cycles
+    for (uint8_t padding = 0; padding < 4; ++padding) {
+        for (uint8_t nops = 0; nops < 8; ++nops) {
+            std::vector<uint8_t> program = {0xA2, 0x00, 0xA9, 0x80}; // LDX #$00, LDA #$80
+            program.insert(program.end(), padding, 0xEA);
+            uint8_t loop = program.size();
+            program.insert(program.end(), {0x9D, 0x00, 0x20}); // STA $2000,X
+            program.insert(program.end(), nops, 0xEA);
+            program.insert(program.end(), {0x4C, loop, 0x80}); // JMP loop
+            std::string name = "nmi_during_store_" + std::to_string(padding) + "_" + std::to_string(nops);
+            // RTI
+            checkModesAgree(test::writeNROM(name, program, {0x40}), name, failures);
+        }
+    }
+
+    // Turns NMI off and on again in a loop, so it is also enabled during
+    // vblank. The handler acknowledges vblank, for one NMI a frame
+    const std::vector<uint8_t> toggle = {
+        0xA2, 0x00,             // LDX #$00
+        0xA9, 0x00,             // loop: LDA #$00
+        0x8D, 0x00, 0x20,       // STA $2000
+        0xA9, 0x80,             // LDA #$80
+        0x9D, 0x00, 0x20,       // STA $2000,X
+        0xEA, 0xEA, 0xEA,       // NOP x3
+        0x4C, 0x02, 0x80,       // JMP loop
+    };
+    const std::vector<uint8_t> acknowledge = {
+        0xAD, 0x02, 0x20,       // LDA $2002
+        0x40,                   // RTI
+    };
+    checkModesAgree(test::writeNROM("nmi_enable_in_vblank", toggle, acknowledge), "NMI enabled in vblank", failures);
+
+    // Enables NMI with STA $2000,X in the middle of a JIT block. The vblank
+    // flag is still set by then on some frames, and the NMI has to be taken
+    // straight after the store, not at the end of the block
+    std::vector<uint8_t> mid_block = {0xA9, 0x00, 0x8D, 0x00, 0x20}; // LDA #$00, STA $2000
+    mid_block.insert(mid_block.end(), 40, 0xEA);
+    mid_block.insert(mid_block.end(), {0xA9, 0x80, 0x9D, 0x00, 0x20}); // LDA #$80, STA $2000,X
+    mid_block.insert(mid_block.end(), 5, 0xEA);
+    mid_block.insert(mid_block.end(), {0x4C, 0x00, 0x80}); // JMP $8000
+    checkModesAgree(test::writeNROM("nmi_mid_block", mid_block, {0x40}), "NMI raised mid-block", failures);
+
+    // Plays a DMC sample with its IRQ enabled, restarting it from the IRQ
+    // handler. Each restart schedules the next fetch from inside a run, which
+    // has to stop for it rather than for the event it was already heading for
+    const std::vector<uint8_t> dmc = {
+        0xA9, 0x8F, 0x8D, 0x10, 0x40,   // LDA #$8F, STA $4010: IRQ, fastest rate
+        0xA9, 0x01, 0x8D, 0x13, 0x40,   // LDA #$01, STA $4013: 17 bytes
+        0xA9, 0x40, 0x8D, 0x17, 0x40,   // LDA #$40, STA $4017: no frame IRQ
+        0xA9, 0x10, 0x8D, 0x15, 0x40,   // LDA #$10, STA $4015: start
+        0x58,                           // CLI
+        0x4C, 0x15, 0x80,               // JMP *
+    };
+    // Counts the IRQ and restarts the sample
+    const std::vector<uint8_t> restart = {
+        0xE6, 0x10,                     // INC $10
+        0xA9, 0x10, 0x8D, 0x15, 0x40,   // LDA #$10, STA $4015
+        0x40,                           // RTI
+    };
+    std::string dmc_rom = test::writeNROM("dmc_irq_restart", dmc, {}, restart);
+    auto framed = std::make_unique<console::Console>();
+    auto stepped = std::make_unique<console::Console>();
+    framed->loadROM(dmc_rom);
+    stepped->loadROM(dmc_rom);
+    for (int frame = 0; frame < 10; ++frame) {
+        framed->run(cpu::Scheduler::ntsc_cycles_per_frame);
+    }
+    // run() stops on the first instruction boundary at or past its target, so
+    // an instruction at a time ends on the same one
+    while (stepped->processor.cycleCount() < framed->processor.cycleCount()) {
+        stepped->run(1);
+    }
+    std::vector<uint8_t> framed_state, stepped_state;
+    framed->saveState(framed_state);
+    stepped->saveState(stepped_state);
+    test::check(stepped->memory_map.read(0x0010) >= 30, "DMC IRQ about four times a frame", failures);
+    test::check(framed_state == stepped_state, "DMC IRQs on time within a run", failures);
+    return failures ? 1 : 0;
+}
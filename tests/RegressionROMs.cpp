@@ -0,0 +1,227 @@
+#include <filesystem>
+#include <initializer_list>
+
+#include "TestROM.h"
+
+// Writes the ROMs tests/regress/manifest.txt lists into the directory given,
+// for the regress tests. Each one works a different part of the console hard
+// enough that a change in behaviour shows up in its state or frame hash
+
+namespace {
+// Just enough of an assembler for hand-written 6502: bytes go in at the
+// program counter, and branches go back to addresses already emitted
+class Assembler {
+public:
+    explicit Assembler(std::vector<uint8_t>& prg, uint16_t origin) : prg(prg), pc(origin) {}
+
+    uint16_t here() const {
+        return pc;
+    }
+
+    Assembler& operator()(std::initializer_list<uint8_t> bytes) {
+        for (uint8_t byte : bytes) {
+            prg[pc++ - 0x8000] = byte;
+        }
+        return *this;
+    }
+
+    // An instruction with an absolute address operand
+    Assembler& absolute(uint8_t opcode, uint16_t address) {
+        return (*this)({opcode, uint8_t(address), uint8_t(address >> 8)});
+    }
+
+    Assembler& branch(uint8_t opcode, uint16_t target) {
+        return (*this)({opcode, uint8_t(target - (pc + 2))});
+    }
+
+private:
+    std::vector<uint8_t>& prg;
+    uint16_t pc;
+};
+
+constexpr uint8_t LDA_IMMEDIATE = 0xA9, LDA_ABSOLUTE = 0xAD, LDA_ABSOLUTE_X = 0xBD, STA_ABSOLUTE = 0x8D,
+    STA_ABSOLUTE_X = 0x9D, BIT_ABSOLUTE = 0x2C, JMP_ABSOLUTE = 0x4C, JSR = 0x20, BPL = 0x10, BNE = 0xD0;
+
+// Filled with NOPs, with the vectors pointing at $9000 for NMI, $8000 for
+// reset and $A000 for IRQ
+std::vector<uint8_t> emptyPRG() {
+    std::vector<uint8_t> prg(0x8000, 0xEA);
+    const uint8_t vectors[] = {0x00, 0x90, 0x00, 0x80, 0x00, 0xA0};
+    std::copy(std::begin(vectors), std::end(vectors), prg.end() - sizeof(vectors));
+    return prg;
+}
+
+// SEI, CLD, and the stack at $01FF
+void reset(Assembler& code) {
+    code({0x78, 0xD8, 0xA2, 0xFF, 0x9A});
+}
+
+// Arithmetic, shifts and indexed stores churning through a page of RAM, with
+// subroutine calls between passes
+std::vector<uint8_t> cpuROM() {
+    std::vector<uint8_t> prg = emptyPRG();
+    Assembler code(prg, 0x8000);
+    reset(code);
+    uint16_t loop = code.here();
+    code({0xA2, 0x00});                              // LDX #$00
+    uint16_t inner = code.here();
+    code.absolute(LDA_ABSOLUTE_X, 0x0300)
+        ({0x65, 0x00})                               // ADC $00
+        ({0x2A})                                     // ROL A
+        ({0x49, 0x5A})                               // EOR #$5A
+        .absolute(STA_ABSOLUTE_X, 0x0300)
+        .absolute(0x5E, 0x0500)                      // LSR $0500,X
+        ({0xE8})                                     // INX
+        .branch(BNE, inner)
+        .absolute(JSR, 0xB000)
+        ({0xE6, 0x00})                               // INC $00
+        .absolute(JMP_ABSOLUTE, loop);
+
+    Assembler subroutine(prg, 0xB000);
+    subroutine({0x18, 0xA5, 0x00, 0x65, 0x01, 0x85, 0x01}) // CLC, LDA $00, ADC $01, STA $01
+        ({0x38, 0xE5, 0x02, 0x85, 0x02})                     // SEC, SBC $02, STA $02
+        ({0xA4, 0x01, 0xB1, 0x02, 0x99, 0x00, 0x04})         // LDY $01, LDA ($02),Y, STA $0400,Y
+        ({0x60});                                            // RTS
+    return prg;
+}
+
+// Draws a full nametable and 64 sprites, scrolling and moving them from the
+// NMI handler each frame
+std::vector<uint8_t> ppuROM() {
+    std::vector<uint8_t> prg = emptyPRG();
+    Assembler code(prg, 0x8000);
+    reset(code);
+    code({0xA9, 0x00}).absolute(STA_ABSOLUTE, 0x2000).absolute(STA_ABSOLUTE, 0x2001);
+    // Two vblanks for the PPU to warm up
+    for (int i = 0; i < 2; ++i) {
+        uint16_t wait = code.here();
+        code.absolute(BIT_ABSOLUTE, 0x2002).branch(BPL, wait);
+    }
+
+    code({LDA_IMMEDIATE, 0x3F}).absolute(STA_ABSOLUTE, 0x2006)
+        ({LDA_IMMEDIATE, 0x00}).absolute(STA_ABSOLUTE, 0x2006)
+        ({0xA2, 0x00});                              // LDX #$00
+    uint16_t palette = code.here();
+    code.absolute(LDA_ABSOLUTE_X, 0xC000).absolute(STA_ABSOLUTE, 0x2007)
+        ({0xE8, 0xE0, 0x20})                         // INX, CPX #$20
+        .branch(BNE, palette);
+
+    // Tiles and attributes counting up through both nametables
+    code({LDA_IMMEDIATE, 0x20}).absolute(STA_ABSOLUTE, 0x2006)
+        ({LDA_IMMEDIATE, 0x00}).absolute(STA_ABSOLUTE, 0x2006)
+        ({0xA0, 0x08, 0xA2, 0x00});                  // LDY #$08, LDX #$00
+    uint16_t nametable = code.here();
+    code({0x8A}).absolute(STA_ABSOLUTE, 0x2007)      // TXA
+        ({0xE8})                                     // INX
+        .branch(BNE, nametable)
+        ({0x88})                                     // DEY
+        .branch(BNE, nametable);
+
+    code({0xA2, 0x00});                              // LDX #$00
+    uint16_t sprites = code.here();
+    code({0x8A}).absolute(STA_ABSOLUTE_X, 0x0200)   // TXA
+        ({0xE8})
+        .branch(BNE, sprites)
+        ({LDA_IMMEDIATE, 0x88}).absolute(STA_ABSOLUTE, 0x2000)
+        ({LDA_IMMEDIATE, 0x1E}).absolute(STA_ABSOLUTE, 0x2001);
+    uint16_t idle = code.here();
+    code({0xE6, 0x10}).absolute(JMP_ABSOLUTE, idle); // INC $10
+
+    Assembler nmi(prg, 0x9000);
+    nmi({0x48})                                      // PHA
+        ({LDA_IMMEDIATE, 0x02}).absolute(STA_ABSOLUTE, 0x4014)
+        ({0xE6, 0x00})                               // INC $00
+        .absolute(LDA_ABSOLUTE, 0x2002)
+        ({0xA5, 0x00}).absolute(STA_ABSOLUTE, 0x2005)
+        ({0x4A}).absolute(STA_ABSOLUTE, 0x2005)      // LSR A
+        ({0xEE, 0x00, 0x02})                         // INC $0200
+        ({0xEE, 0x07, 0x02})                         // INC $0207
+        ({0x68, 0x40});                              // PLA, RTI
+
+    const uint8_t colours[32] = {
+        0x0F, 0x01, 0x11, 0x21, 0x0F, 0x06, 0x16, 0x26, 0x0F, 0x09, 0x19, 0x29, 0x0F, 0x04, 0x14, 0x24,
+        0x0F, 0x02, 0x12, 0x22, 0x0F, 0x07, 0x17, 0x27, 0x0F, 0x0A, 0x1A, 0x2A, 0x0F, 0x05, 0x15, 0x25,
+    };
+    std::copy(std::begin(colours), std::end(colours), prg.begin() + 0x4000);
+    return prg;
+}
+
+// Both pattern tables, every tile a different pattern
+std::vector<uint8_t> ppuCHR() {
+    std::vector<uint8_t> chr(0x2000);
+    for (std::size_t tile = 0; tile < 0x200; ++tile) {
+        for (std::size_t row = 0; row < 8; ++row) {
+            chr[tile * 16 + row] = uint8_t(tile ^ (row * 0x11));
+            chr[tile * 16 + row + 8] = uint8_t((tile << row) | (tile >> (8 - row)) | row);
+        }
+    }
+    return chr;
+}
+
+// Plays all five channels, retuning the first pulse from the frame counter's
+// IRQ and restarting a looping DMC sample from its own
+std::vector<uint8_t> apuROM() {
+    std::vector<uint8_t> prg = emptyPRG();
+    Assembler code(prg, 0x8000);
+    reset(code);
+    const uint8_t writes[][2] = {
+        {0x00, 0xBF}, {0x01, 0x00}, {0x02, 0xFD}, {0x03, 0x08},    // pulse 1
+        {0x04, 0x7F}, {0x05, 0x99}, {0x06, 0x80}, {0x07, 0x09},    // pulse 2, sweeping
+        {0x08, 0x81}, {0x0A, 0x40}, {0x0B, 0x08},                  // triangle
+        {0x0C, 0x3F}, {0x0E, 0x05}, {0x0F, 0x08},                  // noise
+        {0x10, 0x8F}, {0x12, 0x00}, {0x13, 0x01},                  // DMC at $C000 with IRQ
+        {0x15, 0x1F}, {0x17, 0x00},                                // all on, 4-step with IRQ
+    };
+    for (const auto& write : writes) {
+        code({LDA_IMMEDIATE, write[1]}).absolute(STA_ABSOLUTE, 0x4000 | write[0]);
+    }
+    code({0x58});                                    // CLI
+    uint16_t idle = code.here();
+    code({0xE6, 0x10}).absolute(JMP_ABSOLUTE, idle); // INC $10
+
+    Assembler irq(prg, 0xA000);
+    irq({0x48})                                      // PHA
+        .absolute(LDA_ABSOLUTE, 0x4015)
+        ({0x85, 0x12, 0xE6, 0x01})                   // STA $12, INC $01
+        ({0xA5, 0x01}).absolute(STA_ABSOLUTE, 0x4002)
+        ({0x29, 0x07, 0x09, 0x08}).absolute(STA_ABSOLUTE, 0x4003) // AND #$07, ORA #$08
+        ({LDA_IMMEDIATE, 0x1F}).absolute(STA_ABSOLUTE, 0x4015)
+        ({0x68, 0x40});                              // PLA, RTI
+
+    for (std::size_t i = 0; i < 0x100; ++i) {
+        prg[0x4000 + i] = uint8_t(i * 0x5B);
+    }
+    return prg;
+}
+
+// Turns NMI off and on again in a loop, so it is enabled in vblank too, with
+// the handler acknowledging vblank
+std::vector<uint8_t> nmiROM() {
+    std::vector<uint8_t> prg = emptyPRG();
+    Assembler code(prg, 0x8000);
+    code({0xA2, 0x00});                              // LDX #$00
+    uint16_t loop = code.here();
+    code({LDA_IMMEDIATE, 0x00}).absolute(STA_ABSOLUTE, 0x2000)
+        ({LDA_IMMEDIATE, 0x80}).absolute(STA_ABSOLUTE_X, 0x2000)
+        ({0xEA, 0xEA, 0xEA})
+        .absolute(JMP_ABSOLUTE, loop);
+
+    Assembler nmi(prg, 0x9000);
+    nmi.absolute(LDA_ABSOLUTE, 0x2002)({0xE6, 0x10, 0x40}); // INC $10, RTI
+    return prg;
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: regression_roms directory\n");
+        return 1;
+    }
+    std::filesystem::path directory = argv[1];
+    std::filesystem::create_directories(directory);
+    test::writeNROMFile((directory / "cpu.nes").string(), cpuROM());
+    test::writeNROMFile((directory / "ppu.nes").string(), ppuROM(), ppuCHR());
+    test::writeNROMFile((directory / "apu.nes").string(), apuROM());
+    test::writeNROMFile((directory / "nmi.nes").string(), nmiROM());
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Console.h"
+#include "Rewind.h"
+#include "Scheduler.h"
+#include "TestROM.h"
+
+// Seeking back through a RewindBuffer must give the console exactly the state
+// it had when the frame was captured, however many keyframes have been
+// evicted since and however far back the frame is
+
+namespace {
+// Captures each frame into the buffer, keeping a full save state of each
+// alongside to check seeks against
+class Recorder {
+public:
+    Recorder(console::Console& console, console::RewindBuffer& rewind) : console(console), rewind(rewind) {}
+
+    void captureFrames(int count) {
+        for (int frame = 0; frame < count; ++frame) {
+            console.run(cpu::Scheduler::ntsc_cycles_per_frame);
+            rewind.capture();
+            states.emplace_back();
+            console.saveState(states.back());
+        }
+    }
+
+    // Captures a frame, returns whether it took a full copy of memory. Only
+    // meaningful while nothing is being evicted, so the frame's storage is new
+    bool captureIsKeyframe() {
+        std::size_t usage = rewind.memoryUsage();
+        captureFrames(1);
+        return rewind.memoryUsage() - usage >= STATE_PAGE_COUNT * PAGE_SIZE;
+    }
+
+    void checkSeekBack(std::size_t frames_back, int& failures) {
+        std::string what = "seek back " + std::to_string(frames_back) + " frames";
+        if (!test::check(rewind.seekBack(frames_back), (what + " succeeds").c_str(), failures)) {
+            return;
+        }
+        states.resize(states.size() - frames_back);
+        std::vector<uint8_t> state;
+        console.saveState(state);
+        test::check(state == states.back(), (what + " restores the captured state").c_str(), failures);
+        test::check(rewind.frameCount() <= states.size(), (what + " drops the later frames").c_str(), failures);
+    }
+
+private:
+    console::Console& console;
+    console::RewindBuffer& rewind;
+    std::vector<std::vector<uint8_t>> states;
+};
+} // namespace
+
+int main() {
+    int failures = 0;
+
+    // Writes a different RAM page and PRG-RAM page each frame, chosen by a
+    // frame count the NMI handler keeps, so frames hold different deltas and
+    // some pages go unwritten for several frames
+    const std::vector<uint8_t> program = {
+        0xA9, 0x80, 0x8D, 0x00, 0x20,   // LDA #$80, STA $2000: NMI on
+        0xA9, 0x00, 0x85, 0x20, 0x85, 0x22, // LDA #$00, STA $20, STA $22
+        0xA5, 0x10, 0x29, 0x03,         // loop: LDA $10, AND #$03
+        0x09, 0x04, 0x85, 0x21,         // ORA #$04, STA $21: RAM page 4-7
+        0x09, 0x60, 0x85, 0x23,         // ORA #$60, STA $23: PRG-RAM page $64-$67
+        0xC8, 0x98, 0x45, 0x10,         // INY, TYA, EOR $10
+        0x91, 0x20, 0x91, 0x22,         // STA ($20),Y, STA ($22),Y
+        0x4C, 0x0B, 0x80,               // JMP loop
+    };
+    const std::vector<uint8_t> count_frames = {
+        0xE6, 0x10,                     // INC $10
+        0xAD, 0x02, 0x20,               // LDA $2002
+        0x40,                           // RTI
+    };
+    std::string rom = test::writeNROM("rewind", program, count_frames);
+
+    auto console = std::make_unique<console::Console>();
+    console->loadROM(rom);
+    // Room for two and a half keyframe intervals, so keyframes are evicted
+    // and the frames after them promoted
+    console::RewindBuffer rewind(*console, 10, 4);
+    Recorder recorder(*console, rewind);
+    recorder.captureFrames(25);
+    test::check(rewind.frameCount() == 10, "history is bounded", failures);
+    test::check(!rewind.seekBack(10), "can't seek past the history", failures);
+
+    recorder.checkSeekBack(0, failures);
+    recorder.checkSeekBack(2, failures);
+    recorder.checkSeekBack(3, failures);
+    // Capturing carries on from the frame sought to, evicting again
+    recorder.captureFrames(13);
+    recorder.checkSeekBack(5, failures);
+    recorder.checkSeekBack(rewind.frameCount() - 1, failures);
+    test::check(rewind.frameCount() == 1, "seeking to the oldest frame leaves only it", failures);
+    recorder.captureFrames(7);
+    recorder.checkSeekBack(6, failures);
+
+    // Keyframes carry on every keyframe_interval frames after a seek, counting
+    // from the last one at or before the frame sought to
+    auto keyframed_console = std::make_unique<console::Console>();
+    keyframed_console->loadROM(rom);
+    console::RewindBuffer keyframed(*keyframed_console, 20, 4);
+    Recorder keyframed_recorder(*keyframed_console, keyframed);
+    // Keyframes at 0 and 4
+    keyframed_recorder.captureFrames(6);
+    // To frame 3, three after a keyframe
+    keyframed_recorder.checkSeekBack(2, failures);
+    test::check(keyframed_recorder.captureIsKeyframe(), "keyframe due straight after the seek", failures);
+    test::check(!keyframed_recorder.captureIsKeyframe(), "delta after the keyframe", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace test {
+// Writes an NROM image of 32KiB of PRG-ROM and 8KiB of CHR-ROM to path.
+// Exits if the file can't be written
+inline void writeNROMFile(const std::string& path, const std::vector<uint8_t>& prg,
+    const std::vector<uint8_t>& chr = std::vector<uint8_t>(0x2000, 0)) {
+    FILE* file = fopen(path.c_str(), "wb");
+    const uint8_t header[16] = {'N', 'E', 'S', 0x1A, 2, 1};
+    bool written = file && fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+        fwrite(prg.data(), 1, prg.size(), file) == prg.size() && fwrite(chr.data(), 1, chr.size(), file) == chr.size();
+    if (file) {
+        written = fclose(file) == 0 && written;
+    }
+    if (!written) {
+        fprintf(stderr, "Can't write %s\n", path.c_str());
+        exit(1);
+    }
+}
+
+/**
+ * Writes a 32KiB NROM image with code at $8000, which the reset vector points
+ * at, the NMI vector pointing at nmi_handler (placed at $9000) and the IRQ
+ * vector at irq_handler (placed at $A000), or at $8000 if there is none.
+ * Returns the path of the file, in the temporary directory.
+ */
+inline std::string writeNROM(const std::string& name, const std::vector<uint8_t>& code,
+    const std::vector<uint8_t>& nmi_handler = {}, const std::vector<uint8_t>& irq_handler = {}) {
+    std::vector<uint8_t> prg(0x8000, 0xEA);
+    std::copy(code.begin(), code.end(), prg.begin());
+    std::copy(nmi_handler.begin(), nmi_handler.end(), prg.begin() + 0x1000);
+    std::copy(irq_handler.begin(), irq_handler.end(), prg.begin() + 0x2000);
+    const uint8_t vectors[] = {0x00, 0x90, 0x00, 0x80, 0x00, uint8_t(irq_handler.empty() ? 0x80 : 0xA0)};
+    std::copy(std::begin(vectors), std::end(vectors), prg.end() - sizeof(vectors));
+
+    std::string path = (std::filesystem::temp_directory_path() / (name + ".nes")).string();
+    writeNROMFile(path, prg);
+    return path;
+}
+
+// Reports a failed check and counts it
+inline bool check(bool condition, const char* what, int& failures) {
+    if (!condition) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        ++failures;
+    }
+    return condition;
+}
+} // namespace test
@@ -0,0 +1,547 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CPU.h"
+#include "Memory.h"
+#include "WorkStealingPool.h"
+
+// Checks the CPU against the per-opcode single-step tests from
+// https://github.com/SingleStepTests/65x02 (the nes6502 set). Each file,
+// e.g. a9.json, is an array of cases like
+//   {"name": "a9 0b 12",
+//    "initial": {"pc": 1234, "s": 253, "a": 0, "x": 0, "y": 0, "p": 36, "ram": [[1234, 169], [1235, 11]]},
+//    "final":   {...},
+//    "cycles":  [[1234, 169, "read"], [1235, 11, "read"]]}
+// Every case is run once on the interpreter, checking the state it ends in
+// and the cycles it took, and once on the cycle-stepped core, also checking
+// each bus access. Files are parsed as they're read and opcodes are shared
+// out between threads.
+
+namespace {
+// Failing cases printed per opcode and CPU mode
+constexpr std::size_t examples_per_opcode = 3;
+
+struct BusCycle {
+    uint16_t address;
+    uint8_t value;
+    bool write;
+
+    bool operator==(const BusCycle&) const = default;
+};
+
+struct CPUState {
+    uint16_t pc;
+    uint8_t s, a, x, y, p;
+    std::vector<std::pair<uint16_t, uint8_t>> ram;
+};
+
+// Vectors are reused from case to case, so a file is parsed without
+// allocating once they've grown
+struct TestCase {
+    std::string name;
+    CPUState initial;
+    CPUState final;
+    std::vector<BusCycle> cycles;
+};
+
+/**
+ * Pull parser for the subset of JSON the tests use, reading the file through a
+ * fixed buffer. Nothing but the case being parsed is held in memory.
+ */
+class JsonReader {
+public:
+    JsonReader(FILE* file, const std::string& path) : file(file), path(path), position(nullptr), end(nullptr),
+        buffer_offset(0) {}
+
+    // The next character that isn't whitespace, without consuming it. 0 at
+    // the end of the file
+    inline char peek() {
+        while (fill()) {
+            char c = *position;
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                return c;
+            }
+            ++position;
+        }
+        return 0;
+    }
+
+    inline bool consume(char c) {
+        if (peek() == c) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    inline void expect(char c) {
+        if (!consume(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    uint32_t readUnsigned() {
+        peek();
+        uint32_t value = 0;
+        bool digits = false;
+        while (fill() && *position >= '0' && *position <= '9') {
+            value = value * 10 + (*position++ - '0');
+            digits = true;
+        }
+        if (!digits) {
+            fail("expected a number");
+        }
+        return value;
+    }
+
+    // Escapes are kept as the character escaped, which is all the tests need
+    void readString(std::string& out) {
+        expect('"');
+        out.clear();
+        for (;;) {
+            if (!fill()) {
+                fail("unterminated string");
+            }
+            char c = *position++;
+            if (c == '"') {
+                return;
+            }
+            if (c == '\\') {
+                if (!fill()) {
+                    fail("unterminated string");
+                }
+                c = *position++;
+            }
+            out.push_back(c);
+        }
+    }
+
+    // Skips a value of any type, for keys the tests may add
+    void skipValue() {
+        char c = peek();
+        if (c == '"') {
+            readString(scratch);
+        } else if (c == '{') {
+            ++position;
+            if (consume('}')) {
+                return;
+            }
+            do {
+                readString(scratch);
+                expect(':');
+                skipValue();
+            } while (consume(','));
+            expect('}');
+        } else if (c == '[') {
+            ++position;
+            if (consume(']')) {
+                return;
+            }
+            do {
+                skipValue();
+            } while (consume(','));
+            expect(']');
+        } else {
+            // Numbers, true, false and null
+            bool any = false;
+            while (fill() && (isalnum(*position) || *position == '-' || *position == '+' || *position == '.')) {
+                ++position;
+                any = true;
+            }
+            if (!any) {
+                fail("expected a value");
+            }
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& reason) const {
+        throw std::runtime_error(path + ": " + reason + " at byte " +
+            std::to_string(position ? buffer_offset + (position - buffer.data()) : 0));
+    }
+
+private:
+    inline bool fill() {
+        if (position < end) {
+            return true;
+        }
+        if (end) {
+            buffer_offset += end - buffer.data();
+        }
+        std::size_t size = fread(buffer.data(), 1, buffer.size(), file);
+        position = buffer.data();
+        end = position + size;
+        return size > 0;
+    }
+
+    FILE* file;
+    std::string path;
+    std::array<char, 1 << 16> buffer;
+    const char* position;
+    const char* end;
+    // Of the start of buffer in the file
+    uint64_t buffer_offset;
+    std::string scratch;
+};
+
+void parseState(JsonReader& reader, CPUState& state, std::string& key) {
+    state.ram.clear();
+    reader.expect('{');
+    if (reader.consume('}')) {
+        return;
+    }
+    do {
+        reader.readString(key);
+        reader.expect(':');
+        if (key == "pc") {
+            state.pc = reader.readUnsigned();
+        } else if (key == "s") {
+            state.s = reader.readUnsigned();
+        } else if (key == "a") {
+            state.a = reader.readUnsigned();
+        } else if (key == "x") {
+            state.x = reader.readUnsigned();
+        } else if (key == "y") {
+            state.y = reader.readUnsigned();
+        } else if (key == "p") {
+            state.p = reader.readUnsigned();
+        } else if (key == "ram") {
+            reader.expect('[');
+            if (!reader.consume(']')) {
+                do {
+                    reader.expect('[');
+                    uint16_t address = reader.readUnsigned();
+                    reader.expect(',');
+                    uint8_t value = reader.readUnsigned();
+                    reader.expect(']');
+                    state.ram.emplace_back(address, value);
+                } while (reader.consume(','));
+                reader.expect(']');
+            }
+        } else {
+            reader.skipValue();
+        }
+    } while (reader.consume(','));
+    reader.expect('}');
+}
+
+void parseCase(JsonReader& reader, TestCase& test) {
+    // Keys are read into one string for the whole case
+    std::string key;
+    test.cycles.clear();
+    reader.expect('{');
+    if (reader.consume('}')) {
+        return;
+    }
+    do {
+        reader.readString(key);
+        reader.expect(':');
+        if (key == "name") {
+            reader.readString(test.name);
+        } else if (key == "initial") {
+            parseState(reader, test.initial, key);
+        } else if (key == "final") {
+            parseState(reader, test.final, key);
+        } else if (key == "cycles") {
+            reader.expect('[');
+            if (!reader.consume(']')) {
+                do {
+                    reader.expect('[');
+                    BusCycle cycle;
+                    cycle.address = reader.readUnsigned();
+                    reader.expect(',');
+                    cycle.value = reader.readUnsigned();
+                    reader.expect(',');
+                    reader.readString(key);
+                    cycle.write = key == "write";
+                    reader.expect(']');
+                    test.cycles.push_back(cycle);
+                } while (reader.consume(','));
+                reader.expect(']');
+            }
+        } else {
+            reader.skipValue();
+        }
+    } while (reader.consume(','));
+    reader.expect('}');
+}
+
+struct BusRecorder : cpu::CPU::BusMonitor {
+    void access(uint64_t, uint16_t address, uint8_t value, bool write) override {
+        accesses.push_back({address, value, write});
+    }
+    std::vector<BusCycle> accesses;
+};
+
+// A CPU with nothing but RAM across the whole address space
+struct Machine {
+    explicit Machine(cpu::CPU::ExecutionMode mode) : processor(memory_map) {
+        memory_map.mapReadWrite(0, MEMORY_SIZE, ram.data());
+        processor.setExecutionMode(mode);
+        processor.setBusMonitor(&bus);
+    }
+
+    memory::MemoryMap memory_map;
+    std::array<uint8_t, MEMORY_SIZE> ram;
+    BusRecorder bus;
+    cpu::CPU processor;
+};
+
+void appendf(std::string& out, const char* format, unsigned a, unsigned b) {
+    char text[64];
+    snprintf(text, sizeof(text), format, a, b);
+    out += text;
+}
+
+std::string describeCycle(const BusCycle& cycle) {
+    char text[32];
+    snprintf(text, sizeof(text), "%s $%04X = %02X", cycle.write ? "write" : "read", cycle.address, cycle.value);
+    return text;
+}
+
+// Runs the case, returns what differs from its final state, or an empty
+// string if nothing does. Throws opcodeException for opcodes the CPU doesn't
+// implement
+std::string runCase(Machine& machine, const TestCase& test, bool check_bus) {
+    for (const auto& [address, value] : test.initial.ram) {
+        machine.ram[address] = value;
+    }
+    if (!check_bus) {
+        // The decode cache can't see RAM written behind the memory map's
+        // back, remapping drops it
+        machine.memory_map.mapReadWrite(0, MEMORY_SIZE, machine.ram.data());
+    }
+    machine.bus.accesses.clear();
+    const CPUState& initial = test.initial;
+    machine.processor.setRegisters({initial.a, initial.x, initial.y, initial.p, initial.s, initial.pc});
+    uint64_t start = machine.processor.cycleCount();
+    machine.processor.processNextOpcode();
+    unsigned cycles = machine.processor.cycleCount() - start;
+
+    // Only what differs, actual then expected
+    std::string diff;
+    cpu::CPU::Registers registers = machine.processor.registers();
+    const CPUState& expected = test.final;
+    if (registers.program_counter != expected.pc) {
+        appendf(diff, ", PC %04X want %04X", registers.program_counter, expected.pc);
+    }
+    if (registers.accumulator != expected.a) {
+        appendf(diff, ", A %02X want %02X", registers.accumulator, expected.a);
+    }
+    if (registers.X != expected.x) {
+        appendf(diff, ", X %02X want %02X", registers.X, expected.x);
+    }
+    if (registers.Y != expected.y) {
+        appendf(diff, ", Y %02X want %02X", registers.Y, expected.y);
+    }
+    if (registers.stack_pointer != expected.s) {
+        appendf(diff, ", S %02X want %02X", registers.stack_pointer, expected.s);
+    }
+    // BREAK and ALWAYS1 aren't stored in the register
+    uint8_t flags = (registers.status ^ expected.p) & ~0x30;
+    if (flags) {
+        appendf(diff, ", P %02X want %02X (", registers.status, expected.p);
+        for (int bit = 7; bit >= 0; --bit) {
+            if (flags & 1 << bit) {
+                diff += "CZIDB-VN"[bit];
+            }
+        }
+        diff += ")";
+    }
+    for (const auto& [address, value] : expected.ram) {
+        if (machine.ram[address] != value) {
+            char text[32];
+            snprintf(text, sizeof(text), ", $%04X %02X want %02X", address, machine.ram[address], value);
+            diff += text;
+        }
+    }
+    if (cycles != test.cycles.size()) {
+        appendf(diff, ", %u cycles want %u", cycles, test.cycles.size());
+    }
+    if (check_bus && machine.bus.accesses != test.cycles) {
+        const std::vector<BusCycle>& accesses = machine.bus.accesses;
+        std::size_t cycle = std::mismatch(accesses.begin(), accesses.end(), test.cycles.begin(), test.cycles.end()).first -
+            accesses.begin();
+        diff += ", cycle " + std::to_string(cycle) + " " +
+            (cycle < accesses.size() ? describeCycle(accesses[cycle]) : "nothing") + " want " +
+            (cycle < test.cycles.size() ? describeCycle(test.cycles[cycle]) : "nothing");
+    }
+    return diff.empty() ? diff : diff.substr(2);
+}
+
+struct ModeResult {
+    uint64_t failures = 0;
+    // "name  disassembly: diff" of the first few
+    std::vector<std::string> examples;
+};
+
+struct OpcodeResult {
+    std::filesystem::path path;
+    uint8_t opcode;
+    uint64_t cases = 0;
+    // The CPU threw an opcodeException, so the opcode isn't one it implements
+    bool unsupported = false;
+    ModeResult interpreter;
+    ModeResult cycle_stepped;
+    // Why the file couldn't be read
+    std::string error;
+};
+
+void record(ModeResult& result, const TestCase& test, const std::string& diff) {
+    if (++result.failures > examples_per_opcode) {
+        return;
+    }
+    uint8_t bytes[3] = {};
+    for (const auto& [address, value] : test.initial.ram) {
+        for (unsigned i = 0; i < 3; ++i) {
+            if (address == static_cast<uint16_t>(test.initial.pc + i)) {
+                bytes[i] = value;
+            }
+        }
+    }
+    result.examples.push_back(test.name + "  " + cpu::CPU::disassemble(bytes, test.initial.pc) + ": " + diff);
+}
+
+void runOpcode(OpcodeResult& result) {
+    FILE* file = fopen(result.path.c_str(), "rb");
+    if (!file) {
+        result.error = "Can't open " + result.path.string();
+        return;
+    }
+    // Machines are big, keep them off the worker's stack
+    auto interpreter = std::make_unique<Machine>(cpu::CPU::ExecutionMode::INTERPRETER);
+    auto cycle_stepped = std::make_unique<Machine>(cpu::CPU::ExecutionMode::CYCLE_STEPPED);
+    JsonReader reader(file, result.path.string());
+    TestCase test;
+    try {
+        reader.expect('[');
+        if (!reader.consume(']')) {
+            do {
+                parseCase(reader, test);
+                ++result.cases;
+                std::string diff = runCase(*interpreter, test, false);
+                if (!diff.empty()) {
+                    record(result.interpreter, test, diff);
+                }
+                diff = runCase(*cycle_stepped, test, true);
+                if (!diff.empty()) {
+                    record(result.cycle_stepped, test, diff);
+                }
+            } while (reader.consume(','));
+            reader.expect(']');
+        }
+    } catch (opcodeException&) {
+        result.unsupported = true;
+    } catch (std::runtime_error& e) {
+        result.error = e.what();
+    }
+    fclose(file);
+}
+
+void printMode(const char* mode, const ModeResult& result, uint64_t cases) {
+    if (!result.failures) {
+        return;
+    }
+    printf("  %s: %lu of %lu cases failed\n", mode, static_cast<unsigned long>(result.failures),
+        static_cast<unsigned long>(cases));
+    for (const std::string& example : result.examples) {
+        printf("    %s\n", example.c_str());
+    }
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned jobs = 0;
+    std::string directory;
+    std::vector<int> only;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = strtoul(argv[++i], nullptr, 10);
+        } else if (directory.empty() && argv[i][0] != '-') {
+            directory = argv[i];
+        } else if (argv[i][0] != '-' && strlen(argv[i]) == 2 && isxdigit(argv[i][0]) && isxdigit(argv[i][1])) {
+            only.push_back(strtoul(argv[i], nullptr, 16));
+        } else {
+            directory.clear();
+            break;
+        }
+    }
+    if (directory.empty()) {
+        std::cerr << "Usage: singlestep [--jobs N] path/to/nes6502/v1 [opcode...]" << std::endl
+                  << "  runs every xx.json in the directory, or only the opcodes given in hex" << std::endl;
+        return 1;
+    }
+
+    std::vector<OpcodeResult> results;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() != 7 || name.substr(2) != ".json" || !isxdigit(name[0]) || !isxdigit(name[1])) {
+            continue;
+        }
+        int opcode = strtoul(name.substr(0, 2).c_str(), nullptr, 16);
+        if (only.empty() || std::find(only.begin(), only.end(), opcode) != only.end()) {
+            OpcodeResult result;
+            result.path = entry.path();
+            result.opcode = opcode;
+            results.push_back(std::move(result));
+        }
+    }
+    if (error) {
+        std::cerr << "Can't open " << directory << ": " << error.message() << std::endl;
+        return 1;
+    }
+    std::sort(results.begin(), results.end(), [](const OpcodeResult& a, const OpcodeResult& b) {
+        return a.opcode < b.opcode;
+    });
+    if (jobs == 0) {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        threading::WorkStealingPool pool(jobs);
+        for (OpcodeResult& result : results) {
+            // Each task writes only its own result
+            pool.submit([&result] {
+                runOpcode(result);
+            });
+        }
+        pool.wait();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::size_t passed = 0, failed = 0, skipped = 0;
+    uint64_t cases = 0;
+    for (const OpcodeResult& result : results) {
+        if (result.unsupported) {
+            ++skipped;
+            continue;
+        }
+        cases += result.cases;
+        if (result.error.empty() && !result.interpreter.failures && !result.cycle_stepped.failures) {
+            ++passed;
+            continue;
+        }
+        ++failed;
+        printf("%02X\n", result.opcode);
+        if (!result.error.empty()) {
+            printf("  %s\n", result.error.c_str());
+        }
+        printMode("interpreter", result.interpreter, result.cases);
+        printMode("cycle-stepped", result.cycle_stepped, result.cases);
+    }
+    printf("%zu opcodes passed, %zu failed, %zu skipped as not implemented; %lu cases in %.2f s on %u threads\n",
+        passed, failed, skipped, static_cast<unsigned long>(cases), elapsed.count(), jobs);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "CPU.h"
+#include "Trace.h"
+
+// Converts a binary trace written by nes_emulator.exe --trace into the text
+// format of the nestest log, so it can be diffed against reference emulators:
+// C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+
+namespace {
+// Dots per scanline and scanlines per frame of the NTSC PPU, which runs at
+// three dots per CPU cycle
+constexpr uint64_t ppu_dots = 341;
+constexpr uint64_t ppu_scanlines = 262;
+
+void printRecord(const cpu::TraceRecord& record, FILE* out) {
+    uint8_t bytes[3] = {record.opcode, record.operand[0], record.operand[1]};
+    char hex[16] = "";
+    for (uint8_t i = 0; i < record.length && i < 3; ++i) {
+        sprintf(hex + strlen(hex), "%02X ", bytes[i]);
+    }
+    uint64_t ppu_position = record.cycle * 3;
+    fprintf(out, "%04X  %-10s%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3lu,%3lu CYC:%lu\n",
+        record.program_counter, hex, cpu::CPU::disassemble(bytes, record.program_counter).c_str(),
+        record.accumulator, record.x, record.y, record.processor_status, record.stack_pointer,
+        static_cast<unsigned long>(ppu_position / ppu_dots % ppu_scanlines),
+        static_cast<unsigned long>(ppu_position % ppu_dots),
+        static_cast<unsigned long>(record.cycle));
+}
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: trace2nestest trace.bin [out.log]" << std::endl;
+        return 1;
+    }
+    FILE* in = fopen(argv[1], "rb");
+    if (!in) {
+        std::cerr << "Can't open " << argv[1] << std::endl;
+        return 1;
+    }
+    FILE* out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        std::cerr << "Can't open " << argv[2] << std::endl;
+        return 1;
+    }
+
+    cpu::TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, cpu::trace_magic, sizeof(header.magic)) != 0 ||
+        header.version != cpu::trace_version || header.record_size != sizeof(cpu::TraceRecord)) {
+        std::cerr << argv[1] << " isn't a version " << cpu::trace_version << " trace" << std::endl;
+        return 1;
+    }
+
+    std::vector<cpu::TraceRecord> records(4096);
+    std::size_t count;
+    while ((count = fread(records.data(), sizeof(cpu::TraceRecord), records.size(), in)) > 0) {
+        for (std::size_t i = 0; i < count; ++i) {
+            printRecord(records[i], out);
+        }
+    }
+
+    fclose(in);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}